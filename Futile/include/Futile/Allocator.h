@@ -3,6 +3,7 @@
 
 
 #include "Futile/Assert.h"
+#include "Futile/MemoryPool.h"
 #include <algorithm>
 #include <cstddef>
 #include <cstdlib>
@@ -108,6 +109,47 @@ private:
 };
 
 
+/**
+ * Allocator_Pool manages memory with a process-wide pool per buffer size.
+ * Creating or copying a buffer doesn't call malloc once its pool has grown.
+ * Big buffers fall back to malloc/free.
+ */
+template<class T>
+class Allocator_Pool
+{
+public:
+    Allocator_Pool();
+
+    Allocator_Pool(std::size_t inSize);
+
+    Allocator_Pool(std::size_t inSize, const T& inInitialValue);
+
+    Allocator_Pool(const Allocator_Pool& rhs);
+
+    Allocator_Pool& operator=(Allocator_Pool rhs); // rhs by value! (copy& swap idiom)
+
+    ~Allocator_Pool();
+
+    void swap(Allocator_Pool<T>& rhs);
+
+    T& get(std::size_t inIndex);
+
+    const T& get(std::size_t inIndex) const;
+
+    void set(std::size_t inIndex, const T& inValue);
+
+    std::size_t size() const;
+
+private:
+    static T* Allocate(std::size_t inSize);
+
+    static void Release(T* inBuffer, std::size_t inSize);
+
+    T* mBuffer;
+    std::size_t mSize;
+};
+
+
 //
 // Inlines
 //
@@ -335,6 +377,120 @@ std::size_t Allocator_New<T>::size() const
 }
 
 
+template<class T>
+Allocator_Pool<T>::Allocator_Pool() :
+    mBuffer(0),
+    mSize(0)
+{
+}
+
+
+template<class T>
+Allocator_Pool<T>::Allocator_Pool(std::size_t inSize) :
+    mBuffer(Allocate(inSize)),
+    mSize(inSize)
+{
+}
+
+
+template<class T>
+Allocator_Pool<T>::Allocator_Pool(std::size_t inSize, const T& inInitialValue) :
+    mBuffer(Allocate(inSize)),
+    mSize(inSize)
+{
+    std::fill(mBuffer, mBuffer + mSize, inInitialValue);
+}
+
+
+template<class T>
+Allocator_Pool<T>::Allocator_Pool(const Allocator_Pool& rhs) :
+    mBuffer(Allocate(rhs.mSize)),
+    mSize(rhs.mSize)
+{
+    std::copy(rhs.mBuffer, rhs.mBuffer + rhs.mSize, mBuffer);
+}
+
+
+template<class T>
+Allocator_Pool<T>& Allocator_Pool<T>::operator=(Allocator_Pool<T> rhs)
+{
+    swap(rhs);
+    return *this;
+}
+
+
+template<class T>
+Allocator_Pool<T>::~Allocator_Pool()
+{
+    Release(mBuffer, mSize);
+}
+
+
+template<class T>
+void Allocator_Pool<T>::swap(Allocator_Pool<T>& rhs)
+{
+    std::swap(mBuffer, rhs.mBuffer);
+    std::swap(mSize, rhs.mSize);
+}
+
+
+template<class T>
+T* Allocator_Pool<T>::Allocate(std::size_t inSize)
+{
+    Memory::Pool::FixedSizePool* pool = Memory::Pool::GetSharedPool(sizeof(T) * inSize);
+    return static_cast<T*>(pool ? pool->acquire() : malloc(sizeof(T) * inSize));
+}
+
+
+template<class T>
+void Allocator_Pool<T>::Release(T* inBuffer, std::size_t inSize)
+{
+    if (!inBuffer)
+    {
+        return;
+    }
+
+    Memory::Pool::FixedSizePool* pool = Memory::Pool::GetSharedPool(sizeof(T) * inSize);
+    if (pool)
+    {
+        pool->release(inBuffer);
+    }
+    else
+    {
+        free(inBuffer);
+    }
+}
+
+
+template<class T>
+T& Allocator_Pool<T>::get(std::size_t inIndex)
+{
+    return mBuffer[inIndex];
+}
+
+
+template<class T>
+const T& Allocator_Pool<T>::get(std::size_t inIndex) const
+{
+    return mBuffer[inIndex];
+}
+
+
+template<class T>
+void Allocator_Pool<T>::set(std::size_t inIndex, const T& inValue)
+{
+    Assert(inIndex <= size());
+    mBuffer[inIndex] = inValue;
+}
+
+
+template<class T>
+std::size_t Allocator_Pool<T>::size() const
+{
+    return mSize;
+}
+
+
 } // namespace Futile
 
 
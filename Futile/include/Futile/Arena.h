@@ -0,0 +1,148 @@
+#ifndef FUTILE_ARENA_H_INCLUDED
+#define FUTILE_ARENA_H_INCLUDED
+
+
+#include "Futile/Threading.h"
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+
+namespace Futile {
+
+
+/**
+ * Arena hands out memory from large chunks.
+ *
+ * Individual allocations are never freed. All chunks are released at once
+ * when the arena is destroyed, so it suits many short-lived objects that die
+ * together. The arena never calls destructors, so only objects that own no
+ * memory outside the arena may be placed in it, and they are not destroyed.
+ * Allocating is thread-safe and usually lock-free.
+ */
+class Arena : boost::noncopyable
+{
+public:
+    explicit Arena(std::size_t inChunkSize = 1024 * 1024);
+
+    ~Arena();
+
+    // Returns memory that is suitably aligned for any type.
+    void* allocate(std::size_t inSize);
+
+    // Returns the number of bytes that were reserved from the system.
+    std::size_t capacity() const;
+
+private:
+    struct Chunk;
+
+    Chunk* createChunk(std::size_t inSize, Chunk* inPrevious);
+
+    void* allocateSlow(std::size_t inSize);
+
+    std::size_t mChunkSize;
+    std::atomic<Chunk*> mChunk;
+    std::size_t mCapacity;
+    mutable Mutex mMutex;
+};
+
+
+typedef boost::shared_ptr<Arena> ArenaPtr;
+
+
+/**
+ * ArenaAllocator allocates from an Arena, or from the heap if it has none.
+ * It doesn't keep the arena alive. Containers that use an arena must not be
+ * destroyed after it, or be left to the arena without being destroyed.
+ */
+template<class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind
+    {
+        typedef ArenaAllocator<U> other;
+    };
+
+    explicit ArenaAllocator(Arena* inArena = 0) :
+        mArena(inArena)
+    {
+    }
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& rhs) :
+        mArena(rhs.arena())
+    {
+    }
+
+    Arena* arena() const
+    {
+        return mArena;
+    }
+
+    T* allocate(std::size_t inCount, const void* = 0)
+    {
+        return static_cast<T*>(mArena ? mArena->allocate(inCount * sizeof(T)) : ::operator new(inCount * sizeof(T)));
+    }
+
+    void deallocate(T* inPointer, std::size_t)
+    {
+        // Arena memory is released with the arena.
+        if (!mArena)
+        {
+            ::operator delete(inPointer);
+        }
+    }
+
+    std::size_t max_size() const
+    {
+        return std::size_t(-1) / sizeof(T);
+    }
+
+    template<class U, class... Args>
+    void construct(U* inPointer, Args&&... inArgs)
+    {
+        new (inPointer) U(std::forward<Args>(inArgs)...);
+    }
+
+    template<class U>
+    void destroy(U* inPointer)
+    {
+        inPointer->~U();
+    }
+
+private:
+    Arena* mArena;
+};
+
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+    return lhs.arena() == rhs.arena();
+}
+
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+    return !(lhs == rhs);
+}
+
+
+} // namespace Futile
+
+
+#endif // FUTILE_ARENA_H_INCLUDED
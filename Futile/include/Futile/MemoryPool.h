@@ -5,10 +5,9 @@
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <algorithm>
 #include <cstddef>
-#include <stdexcept>
-#include <vector>
 
 
 namespace Futile {
@@ -226,9 +225,10 @@ public:
 
     ~SharedPtr()
     {
-        if (--mValueWithRefCount->mRefCount)
+        if (--mValueWithRefCount->mRefCount == 0)
         {
             Base::destroy();
+            delete mValueWithRefCount;
         }
     }
 
@@ -300,7 +300,51 @@ private:
 
 
 /**
- * MemoryPool that priorizes fast destruction.
+ * FixedSizePool hands out memory slots of one size.
+ *
+ * Acquire and release are O(1), because the free slots form a linked list.
+ * Each thread keeps a small cache of free slots, so most calls don't lock.
+ * The pool grows by one block of slots whenever it runs out. The blocks are
+ * returned to the system once the pool and the caches of all threads that
+ * used it are gone. Thread-safe.
+ */
+class FixedSizePool : boost::noncopyable
+{
+public:
+    FixedSizePool(std::size_t inSlotSize, std::size_t inSlotsPerBlock);
+
+    ~FixedSizePool();
+
+    std::size_t slotSize() const;
+
+    // Returns the number of slots that were allocated from the system.
+    std::size_t capacity() const;
+
+    void* acquire();
+
+    // The slot must have been acquired from this pool.
+    void release(void* inSlot);
+
+private:
+    struct Shared;
+    struct Cache;
+
+    Cache& getCache();
+
+    boost::shared_ptr<Shared> mShared;
+    boost::thread_specific_ptr<Cache> mCache;
+};
+
+
+/**
+ * Returns a process-wide pool for buffers of the given size, or null if the
+ * size is too big to be pooled. The pools live until the process exits.
+ */
+FixedSizePool* GetSharedPool(std::size_t inByteCount);
+
+
+/**
+ * MemoryPool stores objects of one type (see FixedSizePool).
  */
 template<typename ValueType>
 class MemoryPool : boost::noncopyable
@@ -311,61 +355,18 @@ private:
 public:
     typedef ValueType Value;
 
-    MemoryPool(std::size_t inItemCount) :
-        mData(sizeof(Value)* inItemCount),
-        mItems(),
-        mUsedItems(),
-        mFreeItems(inItemCount)
-    {
-        for (std::size_t idx = 0; idx < inItemCount; ++idx)
-        {
-            char * data = &mData[idx * sizeof(Value)];
-            Value * value = reinterpret_cast<Value*>(data);
-            mItems.push_back(Item(value, idx));
-            mFreeItems[inItemCount - (idx + 1)] = idx;
-        }
-    }
-
-    ~MemoryPool()
+    // The pool grows by inItemCount items at a time.
+    explicit MemoryPool(std::size_t inItemCount) :
+        mPool(sizeof(Value), inItemCount)
     {
     }
 
     /**
-     * Returns the max memory size of the pool.
+     * Returns the number of items that were allocated from the system.
      */
-    std::size_t size() const
-    {
-        return mData.size();
-    }
-
-    std::size_t available() const
+    std::size_t capacity() const
     {
-        return mFreeItems.size();
-    }
-
-    std::size_t used() const
-    {
-        return mUsedItems.size();
-    }
-
-    std::size_t indexOf(const Value* inValue) const
-    {
-        return inValue - reinterpret_cast<const Value*>(mData.data());
-    }
-
-    std::size_t indexOf(const WrappedPointer<Value>& inWrappedPointer) const
-    {
-        return indexOf(inWrappedPointer.get());
-    }
-
-    std::size_t offsetOf(const Value* inValue) const
-    {
-        return indexOf(inValue) * sizeof(Value);
-    }
-
-    std::size_t offsetOf(const WrappedPointer<Value>& inWrappedPointer) const
-    {
-        return offsetOf(inWrappedPointer.get());
+        return mPool.capacity();
     }
 
     /**
@@ -380,14 +381,7 @@ public:
      */
     Value * acquire()
     {
-        if (mFreeItems.empty())
-        {
-            throw std::runtime_error("MemoryPool is full.");
-        }
-        mFreeItems.back();
-        mUsedItems.push_back(mFreeItems.back());
-        mFreeItems.pop_back();
-        return mItems[mUsedItems.back()].mValue;
+        return static_cast<Value*>(mPool.acquire());
     }
 
     /**
@@ -395,42 +389,11 @@ public:
      */
     void release(const Value* inValue)
     {
-        for (std::size_t usedIdx = mUsedItems.size() - 1; usedIdx != std::size_t(-1); --usedIdx)
-        {
-            std::size_t itemIndex = mUsedItems[usedIdx];
-            if (mItems[itemIndex].mValue == inValue)
-            {
-                std::swap(mUsedItems[usedIdx], mUsedItems.back());
-                mFreeItems.push_back(mUsedItems.back());
-                mUsedItems.pop_back();
-            }
-        }
+        mPool.release(const_cast<Value*>(inValue));
     }
 
 private:
-    // Contigious container containing all data.
-    std::vector<char> mData;
-
-    class Item
-    {
-    public:
-        Item(Value* inValue, std::size_t inIndex) :
-            mValue(inValue),
-            mIndex(inIndex)
-        {
-        }
-
-        Value* mValue;
-        std::size_t mIndex;
-    };
-
-    std::vector<Item> mItems;
-
-    typedef std::vector<std::size_t> UsedItems;
-    UsedItems mUsedItems;
-
-    typedef std::vector<std::size_t> FreeItems;
-    FreeItems mFreeItems;
+    FixedSizePool mPool;
 };
 
 
@@ -0,0 +1,130 @@
+#ifndef FUTILE_RANDOMSTREAM_H_INCLUDED
+#define FUTILE_RANDOMSTREAM_H_INCLUDED
+
+
+#include <cstdint>
+#include <utility>
+
+
+namespace Futile {
+
+
+/**
+ * RandomStream is a small, fast and splittable pseudo-random generator (SplitMix64).
+ *
+ * The same seed always gives the same sequence, on every platform. split()
+ * derives an independent stream, for example for a child game, so that
+ * objects never have to share a generator. Not thread-safe.
+ *
+ * It can be passed to the standard distributions, but their results differ
+ * between standard libraries. Use nextBelow() and shuffle() for results that
+ * must be reproducible.
+ */
+class RandomStream
+{
+public:
+    typedef std::uint64_t result_type;
+
+    explicit RandomStream(std::uint64_t inSeed) :
+        mState(Mix(inSeed)),
+        mGamma(cGoldenGamma)
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+
+    static constexpr result_type max() { return ~result_type(0); }
+
+    result_type operator()()
+    {
+        return next();
+    }
+
+    std::uint64_t next()
+    {
+        mState += mGamma;
+        return Mix(mState);
+    }
+
+    // Returns a value in [0, inBound) without modulo bias. The bound must not be zero.
+    std::uint32_t nextBelow(std::uint32_t inBound)
+    {
+        // Multiply and keep the high half, reject the few values that would be overrepresented.
+        std::uint64_t product = (next() >> 32) * inBound;
+        std::uint32_t low = static_cast<std::uint32_t>(product);
+        if (low < inBound)
+        {
+            std::uint32_t threshold = (0u - inBound) % inBound;
+            while (low < threshold)
+            {
+                product = (next() >> 32) * inBound;
+                low = static_cast<std::uint32_t>(product);
+            }
+        }
+        return static_cast<std::uint32_t>(product >> 32);
+    }
+
+    bool nextBool()
+    {
+        return (next() >> 63) != 0;
+    }
+
+    // Returns a new stream that doesn't overlap with this one. Advances this stream.
+    RandomStream split()
+    {
+        std::uint64_t state = next();
+        std::uint64_t gamma = MixGamma(next());
+        return RandomStream(state, gamma);
+    }
+
+    // Fisher-Yates shuffle of [inBegin, inEnd).
+    template<class RandomAccessIterator>
+    void shuffle(RandomAccessIterator inBegin, RandomAccessIterator inEnd)
+    {
+        for (std::uint32_t size = static_cast<std::uint32_t>(inEnd - inBegin); size > 1; --size)
+        {
+            using std::swap;
+            swap(inBegin[size - 1], inBegin[nextBelow(size)]);
+        }
+    }
+
+private:
+    static const std::uint64_t cGoldenGamma = 0x9E3779B97F4A7C15ULL;
+
+    RandomStream(std::uint64_t inState, std::uint64_t inGamma) :
+        mState(inState),
+        mGamma(inGamma)
+    {
+    }
+
+    static std::uint64_t Mix(std::uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // Gammas must be odd and have enough bit transitions, otherwise the stream is weak.
+    static std::uint64_t MixGamma(std::uint64_t x)
+    {
+        x = (x ^ (x >> 33)) * 0xFF51AFD7ED558CCDULL;
+        x = (x ^ (x >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+        x = (x ^ (x >> 33)) | 1;
+        std::uint64_t transitions = x ^ (x >> 1);
+        int count = 0;
+        for (; transitions != 0; transitions &= transitions - 1)
+        {
+            ++count;
+        }
+        return count < 24 ? x ^ 0xAAAAAAAAAAAAAAAAULL : x;
+    }
+
+    std::uint64_t mState;
+    std::uint64_t mGamma;
+};
+
+
+} // namespace Futile
+
+
+#endif // FUTILE_RANDOMSTREAM_H_INCLUDED
@@ -0,0 +1,114 @@
+#ifndef FUTILE_RINGBUFFER_H_INCLUDED
+#define FUTILE_RINGBUFFER_H_INCLUDED
+
+
+#include "Futile/Assert.h"
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <vector>
+
+
+namespace Futile {
+
+
+/**
+ * RingBuffer<T> is a fixed-capacity double-ended queue.
+ *
+ * All slots are allocated up front. Items are popped by swapping them with
+ * the caller's object, so no allocations or copies happen after construction.
+ * The capacity is rounded up to a power of two. Not thread-safe.
+ */
+template<class T>
+class RingBuffer : boost::noncopyable
+{
+public:
+    explicit RingBuffer(std::size_t inCapacity) :
+        mItems(RoundUpToPowerOfTwo(inCapacity)),
+        mMask(mItems.size() - 1),
+        mBegin(0),
+        mSize(0)
+    {
+    }
+
+    std::size_t capacity() const
+    {
+        return mItems.size();
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    bool full() const
+    {
+        return mSize == mItems.size();
+    }
+
+    void push_back(const T& inItem)
+    {
+        Assert(!full());
+        mItems[(mBegin + mSize) & mMask] = inItem;
+        mSize++;
+    }
+
+    void pop_front(T& outItem)
+    {
+        Assert(!empty());
+        take(mBegin, outItem);
+        mBegin = (mBegin + 1) & mMask;
+        mSize--;
+    }
+
+    void pop_back(T& outItem)
+    {
+        Assert(!empty());
+        take((mBegin + mSize - 1) & mMask, outItem);
+        mSize--;
+    }
+
+    void clear()
+    {
+        while (!empty())
+        {
+            T item;
+            pop_front(item);
+        }
+    }
+
+private:
+    static std::size_t RoundUpToPowerOfTwo(std::size_t inValue)
+    {
+        std::size_t result = 1;
+        while (result < inValue)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void take(std::size_t inIndex, T& outItem)
+    {
+        using std::swap;
+        swap(mItems[inIndex], outItem);
+
+        // Release whatever the slot received from outItem.
+        mItems[inIndex] = T();
+    }
+
+    std::vector<T> mItems;
+    std::size_t mMask;
+    std::size_t mBegin;
+    std::size_t mSize;
+};
+
+
+} // namespace Futile
+
+
+#endif // FUTILE_RINGBUFFER_H_INCLUDED
@@ -0,0 +1,173 @@
+#ifndef FUTILE_TASK_H_INCLUDED
+#define FUTILE_TASK_H_INCLUDED
+
+
+#include "Futile/Assert.h"
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace Futile {
+
+
+/**
+ * Task is a function object without arguments, like boost::function<void()>.
+ *
+ * The target is stored in a fixed buffer inside the Task object, so creating,
+ * copying and destroying a task never allocates. Targets that don't fit are
+ * rejected at compile time. Big arguments should be passed by pointer.
+ */
+class Task
+{
+public:
+    // Enough for a boost::bind of a member function with a few arguments.
+    static const std::size_t cStorageSize = 96;
+
+    Task() :
+        mOperations(0)
+    {
+    }
+
+    template<class F>
+    Task(const F& inFunction, typename std::enable_if<!std::is_same<F, Task>::value>::type* = 0) :
+        mOperations(&Operations<F>::cTable)
+    {
+        static_assert(sizeof(F) <= cStorageSize, "The function object does not fit in a Task.");
+        static_assert(std::alignment_of<F>::value <= std::alignment_of<Storage>::value, "The function object is overaligned.");
+        new (&mStorage) F(inFunction);
+    }
+
+    Task(const Task& rhs) :
+        mOperations(0)
+    {
+        assign(rhs);
+    }
+
+    Task(Task&& rhs) :
+        mOperations(0)
+    {
+        take(rhs);
+    }
+
+    ~Task()
+    {
+        reset();
+    }
+
+    Task& operator=(const Task& rhs)
+    {
+        if (this != &rhs)
+        {
+            reset();
+            assign(rhs);
+        }
+        return *this;
+    }
+
+    Task& operator=(Task&& rhs)
+    {
+        if (this != &rhs)
+        {
+            reset();
+            take(rhs);
+        }
+        return *this;
+    }
+
+    void operator()() const
+    {
+        Assert(mOperations);
+        mOperations->invoke(&mStorage);
+    }
+
+    bool empty() const
+    {
+        return mOperations == 0;
+    }
+
+    void reset()
+    {
+        if (mOperations)
+        {
+            mOperations->destroy(&mStorage);
+            mOperations = 0;
+        }
+    }
+
+private:
+    typedef std::aligned_storage<cStorageSize>::type Storage;
+
+    struct OperationTable
+    {
+        void (*invoke)(void*);
+        void (*copy)(const void*, void*);
+        void (*move)(void*, void*);
+        void (*destroy)(void*);
+    };
+
+    template<class F>
+    struct Operations
+    {
+        static void Invoke(void* inFunction)
+        {
+            (*static_cast<F*>(inFunction))();
+        }
+
+        static void Copy(const void* inFunction, void* outStorage)
+        {
+            new (outStorage) F(*static_cast<const F*>(inFunction));
+        }
+
+        static void Move(void* inFunction, void* outStorage)
+        {
+            new (outStorage) F(std::move(*static_cast<F*>(inFunction)));
+        }
+
+        static void Destroy(void* inFunction)
+        {
+            static_cast<F*>(inFunction)->~F();
+        }
+
+        static const OperationTable cTable;
+    };
+
+    void assign(const Task& rhs)
+    {
+        if (rhs.mOperations)
+        {
+            rhs.mOperations->copy(&rhs.mStorage, &mStorage);
+            mOperations = rhs.mOperations;
+        }
+    }
+
+    void take(Task& rhs)
+    {
+        if (rhs.mOperations)
+        {
+            rhs.mOperations->move(&rhs.mStorage, &mStorage);
+            mOperations = rhs.mOperations;
+            rhs.reset();
+        }
+    }
+
+    const OperationTable* mOperations;
+    mutable Storage mStorage;
+};
+
+
+template<class F>
+const Task::OperationTable Task::Operations<F>::cTable =
+{
+    &Task::Operations<F>::Invoke,
+    &Task::Operations<F>::Copy,
+    &Task::Operations<F>::Move,
+    &Task::Operations<F>::Destroy
+};
+
+
+} // namespace Futile
+
+
+#endif // FUTILE_TASK_H_INCLUDED
@@ -3,11 +3,12 @@
 
 
 #include "Futile/Enum.h"
+#include "Futile/RingBuffer.h"
+#include "Futile/Task.h"
 #include "Futile/Threading.h"
 #include <boost/bind/bind.hpp>
-#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
-#include <list>
+#include <atomic>
 
 
 namespace Futile {
@@ -50,13 +51,17 @@ public:
 
     inline const std::string& name() const { return mName; }
 
-    typedef boost::function<void()> Task;
+    typedef Futile::Task Task;
 
-    // Adds a task to the queue.
+    // Adds a task to the queue. Never blocks on a busy worker. If the queue
+    // is full then the task runs right away on the calling thread.
     // The task should be interruptable. This can be achieved by letting it
     // periodically call the boost::this_thread::interruption_point() function.
     void schedule(const Task& inTask);
 
+    // Number of pending tasks that fit in the preallocated queue.
+    static const std::size_t cQueueCapacity = 1024;
+
     // Returns the number of pending tasks.
     std::size_t size() const;
 
@@ -71,6 +76,9 @@ public:
     // Wait for the Worker to finish all tasks.
     void wait();
 
+    // Like wait(), but gives up at inDeadline. Returns false if it did.
+    bool wait(const boost::system_time& inDeadline);
+
     // Wait for a certain status.
     void waitForStatus(WorkerStatus inStatus);
 
@@ -100,24 +108,53 @@ private:
     Worker& operator=(const Worker&);
 
     friend class WorkerPool;
+
+    // Creates a worker that steals tasks from the other workers of the pool when its own queue is empty.
+    Worker(const std::string& inName, WorkerPool& inPool);
+
     void setQuitFlag();
     bool getQuitFlag() const;
 
     void setStatus(WorkerStatus inStatus);
 
     void run();
-    Task nextTask();
+    void nextTask(Task& outTask);
     void processTask();
 
+    // Spins for a short while. Returns true if a task may have become available.
+    bool spinForTask(std::size_t inScheduleCount);
+
+    // Adds the task to the queue and wakes the worker if needed.
+    // Returns false if the queue is full.
+    bool push(const Task& inTask);
+
+    // The caller must hold mQueueMutex.
+    void popTask(Task& outTask, bool inFromBack);
+    void clearQueue();
+
     std::string mName;
+    WorkerPool* mPool;
     WorkerStatus mStatus;
     mutable Mutex mStatusMutex;
     Futile::Condition mStatusCondition;
 
-    std::list<Task> mQueue;
+    // The worker takes tasks from the front, thieves take them from the back.
+    RingBuffer<Task> mQueue;
+    std::atomic<std::size_t> mQueueSize;
     mutable Mutex mQueueMutex;
     Condition mQueueCondition;
 
+    // Set while the worker is out of tasks and reports WorkerStatus_Waiting.
+    // Only then does schedule() need to touch the status and wake the worker.
+    bool mIdle;
+
+    // Set while the worker sleeps on mQueueCondition. Written with mQueueMutex
+    // held, but the pool reads it without locking to find a worker to wake.
+    std::atomic<bool> mParked;
+
+    // Number of spins before parking. Grows when spinning pays off.
+    std::size_t mSpinCount;
+
     mutable Mutex mQuitFlagMutex;
     bool mQuitFlag;
 
@@ -4,6 +4,7 @@
 
 #include "Futile/Array.h"
 #include "Futile/Worker.h"
+#include <atomic>
 #include <vector>
 #include <boost/shared_ptr.hpp>
 
@@ -13,6 +14,9 @@ namespace Futile {
 
 /**
  * WorkerPool manages a pool of Worker objects.
+ *
+ * Tasks are distributed round-robin. A worker that runs out of tasks
+ * steals the most recently scheduled task from another worker's queue.
  */
 class WorkerPool
 {
@@ -35,8 +39,13 @@ public:
     void resize(std::size_t inSize);
 
     // Wait until all Workers have finished their queue
+    // and no stolen tasks are running anymore.
+    // The tasks may schedule new tasks on the pool in the meantime.
     void wait();
 
+    // Like wait(), but gives up at inDeadline. Returns false if it did.
+    bool wait(const boost::system_time& inDeadline);
+
     // Interrupts all workers.
     // This call is blocking until all workers have stopped.
     void interruptAndClearQueue();
@@ -46,13 +55,33 @@ private:
     WorkerPool(const WorkerPool&);
     WorkerPool& operator=(const WorkerPool&);
 
-    void interruptRange(std::size_t inBegin, std::size_t inCount);
+    friend class Worker;
+
+    typedef boost::shared_ptr<Worker> WorkerPtr;
+    typedef std::vector<WorkerPtr> Workers;
+
+    // Returns a copy of the workers, so that they can be waited for without locking the pool.
+    Workers getWorkers() const;
+
+    // Clears the queues of the given workers and waits until their tasks are interrupted.
+    static void interrupt(const Workers& inWorkers);
+
+    // Returns true if all workers are waiting and all queues are empty.
+    static bool idle(const Workers& inWorkers);
+
+    // Moves a task from the back of another worker's queue to the thief.
+    // Returns false if there was nothing to steal.
+    bool steal(Worker& inThief, Worker::Task& outTask);
 
     std::string mName;
     std::size_t mRotation;
 
-    typedef boost::shared_ptr<Worker> WorkerPtr;
-    typedef std::vector<WorkerPtr> Workers;
+    // Workers that can steal and be stolen from. Declared before mWorkers
+    // because workers may try to steal until they are destroyed.
+    std::vector<Worker*> mStealTargets;
+    Mutex mStealMutex;
+    std::atomic<std::size_t> mScheduleCount;
+
     Workers mWorkers;
 
     mutable Mutex mMutex;
@@ -0,0 +1,112 @@
+#include "Futile/Config.h"
+#include "Futile/Arena.h"
+#include "Futile/Assert.h"
+#include <algorithm>
+
+
+namespace Futile {
+
+
+// Every allocation is rounded up to this alignment.
+static const std::size_t cAlignment = 16;
+
+
+static std::size_t Align(std::size_t inSize)
+{
+    return (inSize + cAlignment - 1) & ~(cAlignment - 1);
+}
+
+
+struct Arena::Chunk
+{
+    Chunk(std::size_t inSize, Chunk* inPrevious) :
+        mPrevious(inPrevious),
+        mSize(inSize),
+        mUsed(0)
+    {
+    }
+
+    char* data()
+    {
+        return reinterpret_cast<char*>(this) + Align(sizeof(Chunk));
+    }
+
+    Chunk* mPrevious;
+    std::size_t mSize;
+
+    // May exceed mSize after failed allocations.
+    std::atomic<std::size_t> mUsed;
+};
+
+
+Arena::Arena(std::size_t inChunkSize) :
+    mChunkSize(Align(inChunkSize)),
+    mChunk(),
+    mCapacity(0),
+    mMutex()
+{
+    mChunk.store(createChunk(mChunkSize, 0), std::memory_order_relaxed);
+}
+
+
+Arena::~Arena()
+{
+    Chunk* chunk = mChunk.load(std::memory_order_relaxed);
+    while (chunk)
+    {
+        Chunk* previous = chunk->mPrevious;
+        chunk->~Chunk();
+        ::operator delete(chunk);
+        chunk = previous;
+    }
+}
+
+
+Arena::Chunk* Arena::createChunk(std::size_t inSize, Chunk* inPrevious)
+{
+    void* memory = ::operator new(Align(sizeof(Chunk)) + inSize);
+    mCapacity += inSize;
+    return new (memory) Chunk(inSize, inPrevious);
+}
+
+
+void* Arena::allocate(std::size_t inSize)
+{
+    std::size_t size = Align(inSize);
+    Chunk* chunk = mChunk.load(std::memory_order_acquire);
+    std::size_t offset = chunk->mUsed.fetch_add(size, std::memory_order_relaxed);
+    if (offset + size <= chunk->mSize)
+    {
+        return chunk->data() + offset;
+    }
+    return allocateSlow(size);
+}
+
+
+void* Arena::allocateSlow(std::size_t inSize)
+{
+    ScopedLock lock(mMutex);
+
+    // Another thread may have added a chunk in the meantime.
+    Chunk* chunk = mChunk.load(std::memory_order_relaxed);
+    std::size_t offset = chunk->mUsed.fetch_add(inSize, std::memory_order_relaxed);
+    if (offset + inSize <= chunk->mSize)
+    {
+        return chunk->data() + offset;
+    }
+
+    chunk = createChunk(std::max(mChunkSize, inSize), chunk);
+    chunk->mUsed.store(inSize, std::memory_order_relaxed);
+    mChunk.store(chunk, std::memory_order_release);
+    return chunk->data();
+}
+
+
+std::size_t Arena::capacity() const
+{
+    ScopedLock lock(mMutex);
+    return mCapacity;
+}
+
+
+} // namespace Futile
@@ -0,0 +1,252 @@
+#include "Futile/Config.h"
+#include "Futile/MemoryPool.h"
+#include "Futile/Assert.h"
+#include "Futile/Threading.h"
+#include <atomic>
+#include <new>
+#include <vector>
+
+
+namespace Futile {
+namespace Memory {
+namespace Pool {
+
+
+// Slots are aligned for any type.
+static const std::size_t cAlignment = 16;
+
+// A thread cache holds at most this many free slots. It exchanges half
+// of them with the shared free list at a time.
+static const std::size_t cCacheSize = 64;
+
+// Buffers up to this size are pooled by GetSharedPool.
+static const std::size_t cMaxSharedSize = 4096;
+
+// Number of GetSharedPool slots that are allocated at a time.
+static const std::size_t cSharedBlockSize = 256;
+
+
+struct Slot
+{
+    Slot* mNext;
+};
+
+
+// Links up to inCount slots from the front of ioList into a separate list.
+static Slot* TakeSlots(Slot*& ioList, std::size_t inCount, std::size_t& outCount)
+{
+    Slot* head = ioList;
+    Slot* tail = 0;
+    outCount = 0;
+    while (ioList && outCount != inCount)
+    {
+        tail = ioList;
+        ioList = ioList->mNext;
+        outCount++;
+    }
+    if (tail)
+    {
+        tail->mNext = 0;
+    }
+    return outCount ? head : 0;
+}
+
+
+struct FixedSizePool::Shared : boost::noncopyable
+{
+    Shared(std::size_t inSlotSize, std::size_t inSlotsPerBlock) :
+        mSlotSize((std::max(inSlotSize, sizeof(Slot)) + cAlignment - 1) & ~(cAlignment - 1)),
+        mSlotsPerBlock(std::max<std::size_t>(inSlotsPerBlock, 1)),
+        mMutex(),
+        mFree(0),
+        mBlocks()
+    {
+    }
+
+    ~Shared()
+    {
+        for (std::size_t idx = 0; idx != mBlocks.size(); ++idx)
+        {
+            ::operator delete(mBlocks[idx]);
+        }
+    }
+
+    // Returns a list of up to inCount free slots. Grows the pool if there are none.
+    Slot* take(std::size_t inCount, std::size_t& outCount)
+    {
+        ScopedLock lock(mMutex);
+        if (!mFree)
+        {
+            grow();
+        }
+        return TakeSlots(mFree, inCount, outCount);
+    }
+
+    // Returns the list of slots [inHead, inTail] to the free list.
+    void give(Slot* inHead, Slot* inTail)
+    {
+        ScopedLock lock(mMutex);
+        inTail->mNext = mFree;
+        mFree = inHead;
+    }
+
+    void grow()
+    {
+        char* block = static_cast<char*>(::operator new(mSlotSize * mSlotsPerBlock));
+        mBlocks.push_back(block);
+        for (std::size_t idx = mSlotsPerBlock; idx != 0; --idx)
+        {
+            Slot* slot = reinterpret_cast<Slot*>(block + (idx - 1) * mSlotSize);
+            slot->mNext = mFree;
+            mFree = slot;
+        }
+    }
+
+    const std::size_t mSlotSize;
+    const std::size_t mSlotsPerBlock;
+    mutable Mutex mMutex;
+    Slot* mFree;
+    std::vector<void*> mBlocks;
+};
+
+
+// The cache shares ownership of the slots, so it can return
+// them when its thread exits after the pool was destroyed.
+struct FixedSizePool::Cache : boost::noncopyable
+{
+    Cache(const boost::shared_ptr<Shared>& inShared) :
+        mShared(inShared),
+        mHead(0),
+        mCount(0)
+    {
+    }
+
+    ~Cache()
+    {
+        flush(mCount);
+    }
+
+    void refill()
+    {
+        Assert(!mHead);
+        mHead = mShared->take(cCacheSize / 2, mCount);
+    }
+
+    void flush(std::size_t inCount)
+    {
+        std::size_t count = 0;
+        Slot* head = TakeSlots(mHead, inCount, count);
+        if (head)
+        {
+            Slot* tail = head;
+            while (tail->mNext)
+            {
+                tail = tail->mNext;
+            }
+            mShared->give(head, tail);
+            mCount -= count;
+        }
+    }
+
+    boost::shared_ptr<Shared> mShared;
+    Slot* mHead;
+    std::size_t mCount;
+};
+
+
+FixedSizePool::FixedSizePool(std::size_t inSlotSize, std::size_t inSlotsPerBlock) :
+    mShared(new Shared(inSlotSize, inSlotsPerBlock)),
+    mCache()
+{
+}
+
+
+FixedSizePool::~FixedSizePool()
+{
+}
+
+
+std::size_t FixedSizePool::slotSize() const
+{
+    return mShared->mSlotSize;
+}
+
+
+std::size_t FixedSizePool::capacity() const
+{
+    ScopedLock lock(mShared->mMutex);
+    return mShared->mBlocks.size() * mShared->mSlotsPerBlock;
+}
+
+
+FixedSizePool::Cache& FixedSizePool::getCache()
+{
+    // A cache that belongs to a destroyed pool at the same address is replaced.
+    Cache* cache = mCache.get();
+    if (!cache || cache->mShared != mShared)
+    {
+        cache = new Cache(mShared);
+        mCache.reset(cache);
+    }
+    return *cache;
+}
+
+
+void* FixedSizePool::acquire()
+{
+    Cache& cache = getCache();
+    if (!cache.mHead)
+    {
+        cache.refill();
+    }
+    Slot* slot = cache.mHead;
+    cache.mHead = slot->mNext;
+    cache.mCount--;
+    return slot;
+}
+
+
+void FixedSizePool::release(void* inSlot)
+{
+    Assert(inSlot);
+    Cache& cache = getCache();
+    Slot* slot = static_cast<Slot*>(inSlot);
+    slot->mNext = cache.mHead;
+    cache.mHead = slot;
+    cache.mCount++;
+    if (cache.mCount > cCacheSize)
+    {
+        cache.flush(cCacheSize / 2);
+    }
+}
+
+
+FixedSizePool* GetSharedPool(std::size_t inByteCount)
+{
+    if (inByteCount == 0 || inByteCount > cMaxSharedSize)
+    {
+        return 0;
+    }
+
+    // One pool per multiple of the alignment. The pools are never destroyed,
+    // because buffers in static objects may be released at any time.
+    static std::atomic<FixedSizePool*> fPools[cMaxSharedSize / cAlignment];
+    static Mutex fMutex;
+
+    std::size_t index = (inByteCount - 1) / cAlignment;
+    FixedSizePool* pool = fPools[index].load(std::memory_order_acquire);
+    if (!pool)
+    {
+        ScopedLock lock(fMutex);
+        pool = fPools[index].load(std::memory_order_relaxed);
+        if (!pool)
+        {
+            pool = new FixedSizePool((index + 1) * cAlignment, cSharedBlockSize);
+            fPools[index].store(pool, std::memory_order_release);
+        }
+    }
+    return pool;
+}
+
+
+} } } // namespace Futile::Memory::Pool
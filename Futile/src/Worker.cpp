@@ -1,5 +1,6 @@
 #include "Futile/Config.h"
 #include "Futile/Worker.h"
+#include "Futile/WorkerPool.h"
 #include "Futile/Logging.h"
 #include "Futile/MakeString.h"
 
@@ -46,9 +47,38 @@ void SetThreadName(DWORD inThreadId, const std::string& inThreadName)
 namespace Futile {
 
 
+// Bounds for the number of times an idle worker yields before it parks.
+static const std::size_t cMinSpinCount = 4;
+static const std::size_t cMaxSpinCount = 256;
+
+
+const std::size_t Worker::cQueueCapacity;
+
+
 Worker::Worker(const std::string& inName) :
     mName(inName),
+    mPool(0),
     mStatus(WorkerStatus_Initial),
+    mQueue(cQueueCapacity),
+    mQueueSize(0),
+    mIdle(false),
+    mParked(false),
+    mSpinCount(cMinSpinCount),
+    mQuitFlag(false)
+{
+    mThread.reset(new boost::thread(boost::bind(&Worker::run, this)));
+}
+
+
+Worker::Worker(const std::string& inName, WorkerPool& inPool) :
+    mName(inName),
+    mPool(&inPool),
+    mStatus(WorkerStatus_Initial),
+    mQueue(cQueueCapacity),
+    mQueueSize(0),
+    mIdle(false),
+    mParked(false),
+    mSpinCount(cMinSpinCount),
     mQuitFlag(false)
 {
     mThread.reset(new boost::thread(boost::bind(&Worker::run, this)));
@@ -61,7 +91,7 @@ Worker::~Worker()
         setQuitFlag();
         ScopedLock queueLock(mQueueMutex);
         ScopedLock statusLock(mStatusMutex);
-        mQueue.clear();
+        clearQueue();
         mThread->interrupt();
         mQueueCondition.notify_all();
         mStatusCondition.notify_all();
@@ -106,6 +136,20 @@ void Worker::wait()
 }
 
 
+bool Worker::wait(const boost::system_time& inDeadline)
+{
+    ScopedLock lock(mStatusMutex);
+    while (mStatus != WorkerStatus_Waiting)
+    {
+        if (!mStatusCondition.timed_wait(lock, inDeadline))
+        {
+            return mStatus == WorkerStatus_Waiting;
+        }
+    }
+    return true;
+}
+
+
 void Worker::waitForStatus(WorkerStatus inStatus)
 {
     ScopedLock lock(mStatusMutex);
@@ -118,15 +162,13 @@ void Worker::waitForStatus(WorkerStatus inStatus)
 
 std::size_t Worker::size() const
 {
-    ScopedLock lock(mQueueMutex);
-    return mQueue.size();
+    return mQueueSize;
 }
 
 
 bool Worker::empty() const
 {
-    ScopedLock lock(mQueueMutex);
-    return mQueue.empty();
+    return mQueueSize == 0;
 }
 
 
@@ -147,7 +189,7 @@ void Worker::interrupt(bool inJoin)
 void Worker::interruptAndClearQueue(bool inJoin)
 {
     ScopedLock queueLock(mQueueMutex);
-    mQueue.clear();
+    clearQueue();
     ScopedLock statusLock(mStatusMutex);
     mThread->interrupt();
     mQueueCondition.notify_all();
@@ -161,36 +203,136 @@ void Worker::interruptAndClearQueue(bool inJoin)
 
 void Worker::schedule(const Worker::Task& inTask)
 {
-    std::list<Task> list(1, inTask);
+    if (!push(inTask))
+    {
+        // The queue doesn't grow, and waiting for room would deadlock
+        // a task that schedules on its own worker.
+        inTask();
+    }
+}
 
-    ScopedLock lock(mQueueMutex);
 
-    mQueue.splice(mQueue.end(), std::move(list));
+bool Worker::push(const Task& inTask)
+{
+    ScopedLock lock(mQueueMutex);
+    if (mQueue.full())
+    {
+        return false;
+    }
+    mQueue.push_back(inTask);
+    mQueueSize++;
 
+    // A busy worker will find the task without help.
+    if (mIdle)
     {
-        ScopedLock statusLock(mStatusMutex);
-        if (mStatus <= WorkerStatus_Waiting)
         {
-            mStatus = WorkerStatus_Scheduled;
+            ScopedLock statusLock(mStatusMutex);
+            if (mStatus <= WorkerStatus_Waiting)
+            {
+                mStatus = WorkerStatus_Scheduled;
+            }
+        }
+
+        if (mParked)
+        {
+            mQueueCondition.notify_one();
         }
     }
+    return true;
+}
 
-    mQueueCondition.notify_all();
+
+void Worker::popTask(Task& outTask, bool inFromBack)
+{
+    if (inFromBack)
+    {
+        mQueue.pop_back(outTask);
+    }
+    else
+    {
+        mQueue.pop_front(outTask);
+    }
+    mQueueSize--;
+}
+
+
+void Worker::clearQueue()
+{
+    mQueue.clear();
+    mQueueSize = 0;
+}
+
+
+bool Worker::spinForTask(std::size_t inScheduleCount)
+{
+    for (std::size_t idx = 0; idx != mSpinCount; ++idx)
+    {
+        if (mQueueSize != 0 || (mPool && inScheduleCount != mPool->mScheduleCount))
+        {
+            mSpinCount = std::min(2 * mSpinCount, cMaxSpinCount);
+            return true;
+        }
+        boost::this_thread::yield();
+    }
+    mSpinCount = std::max(mSpinCount / 2, cMinSpinCount);
+    return false;
 }
 
 
-Worker::Task Worker::nextTask()
+void Worker::nextTask(Task& outTask)
 {
     ScopedLock lock(mQueueMutex);
+
+    // An interrupted wait leaves the flag set.
+    mParked = false;
+
     while (mQueue.empty())
     {
+        // If a task is scheduled on another worker in the meantime then we
+        // look again, because its wake-up call may have been sent too early.
+        std::size_t scheduleCount = mPool ? std::size_t(mPool->mScheduleCount) : 0;
+        if (mPool)
+        {
+            // Look for work in the other queues before going to sleep.
+            lock.unlock();
+            if (mPool->steal(*this, outTask))
+            {
+                return;
+            }
+            lock.lock();
+            if (!mQueue.empty())
+            {
+                continue;
+            }
+        }
+
+        mIdle = true;
         setStatus(WorkerStatus_Waiting);
+
+        // Tasks tend to arrive in bursts, so spin a little before parking.
+        lock.unlock();
+        bool found = spinForTask(scheduleCount);
+        lock.lock();
+        if (found || !mQueue.empty())
+        {
+            continue;
+        }
+
+        // The flag is set before the schedule count is read again, and the
+        // pool reads the flag after it increased the count. So either we
+        // see the new task or the pool sees that we are parked.
+        mParked = true;
+        if (mPool && scheduleCount != mPool->mScheduleCount)
+        {
+            mParked = false;
+            continue;
+        }
         mQueueCondition.wait(lock);
+        mParked = false;
         boost::this_thread::interruption_point();
     }
-    Task task = mQueue.front();
-    mQueue.erase(mQueue.begin());
-    return task;
+    mIdle = false;
+    popTask(outTask, false);
 }
 
 
@@ -199,7 +341,8 @@ void Worker::processTask()
     try
     {
         // Get the next task.
-        Task task = nextTask();
+        Task task;
+        nextTask(task);
 
         // Run the task.
         setStatus(WorkerStatus_Working);
@@ -12,19 +12,22 @@ namespace Futile {
 WorkerPool::WorkerPool(const std::string& inName, std::size_t inSize) :
     mName(inName),
     mRotation(0),
+    mStealTargets(),
+    mStealMutex(),
+    mScheduleCount(0),
     mWorkers(),
     mMutex()
 {
-    for (std::size_t idx = 0; idx != inSize; ++idx)
-    {
-        WorkerPtr workerPtr(new Worker(MakeString() << inName << mWorkers.size()));
-        mWorkers.push_back(workerPtr);
-    }
+    resize(inSize);
 }
 
 
 WorkerPool::~WorkerPool()
 {
+    {
+        ScopedLock stealLock(mStealMutex);
+        mStealTargets.clear();
+    }
     interruptAndClearQueue();
 }
 
@@ -33,7 +36,74 @@ void WorkerPool::schedule(const Worker::Task& inTask)
 {
     ScopedLock lock(mMutex);
     mRotation = (mRotation + 1) % mWorkers.size();
-    mWorkers[mRotation]->schedule(inTask);
+    mScheduleCount++;
+    Worker& target = *mWorkers[mRotation];
+    if (!target.push(inTask))
+    {
+        // See Worker::schedule.
+        lock.unlock();
+        inTask();
+        return;
+    }
+
+    // If the target is busy then wake up one parked worker so that it can steal
+    // the task. Workers that are still spinning will find it without help.
+    if (target.status() != WorkerStatus_Working)
+    {
+        return;
+    }
+    for (std::size_t offset = 1; offset != mWorkers.size(); ++offset)
+    {
+        Worker& worker = *mWorkers[(mRotation + offset) % mWorkers.size()];
+        if (worker.mParked)
+        {
+            ScopedLock queueLock(worker.mQueueMutex);
+            if (worker.mParked)
+            {
+                // Cleared here so that the next task wakes another worker.
+                worker.mParked = false;
+                worker.mQueueCondition.notify_one();
+                return;
+            }
+        }
+    }
+}
+
+
+bool WorkerPool::steal(Worker& inThief, Worker::Task& outTask)
+{
+    ScopedLock stealLock(mStealMutex);
+    std::size_t count = mStealTargets.size();
+    std::size_t thiefIdx = 0;
+    while (thiefIdx != count && mStealTargets[thiefIdx] != &inThief)
+    {
+        thiefIdx++;
+    }
+    if (thiefIdx == count)
+    {
+        // The thief is being removed from the pool.
+        return false;
+    }
+
+    for (std::size_t offset = 1; offset != count; ++offset)
+    {
+        Worker& victim = *mStealTargets[(thiefIdx + offset) % count];
+        if (victim.mQueueSize == 0)
+        {
+            continue;
+        }
+
+        ScopedLock queueLock(victim.mQueueMutex);
+        if (!victim.mQueue.empty())
+        {
+            victim.popTask(outTask, true);
+
+            // The thief must look busy before the victim's queue is unlocked. See idle().
+            inThief.setStatus(WorkerStatus_Working);
+            return true;
+        }
+    }
+    return false;
 }
 
 
@@ -46,44 +116,109 @@ std::size_t WorkerPool::size() const
 
 void WorkerPool::resize(std::size_t inSize)
 {
-    ScopedLock lock(mMutex);
-    if (inSize > mWorkers.size())
+    Workers removedWorkers;
     {
+        ScopedLock lock(mMutex);
         while (mWorkers.size() < inSize)
         {
-            WorkerPtr workerPtr(new Worker(MakeString() << mName << mWorkers.size()));
+            WorkerPtr workerPtr(new Worker(MakeString() << mName << mWorkers.size(), *this));
             mWorkers.push_back(workerPtr);
+            ScopedLock stealLock(mStealMutex);
+            mStealTargets.push_back(workerPtr.get());
+        }
+
+        if (inSize < mWorkers.size()) // Deletes a few workers
+        {
+            {
+                // Removed workers must not steal tasks that would then be interrupted.
+                ScopedLock stealLock(mStealMutex);
+                mStealTargets.resize(inSize);
+            }
+            removedWorkers.assign(mWorkers.begin() + inSize, mWorkers.end());
+            mWorkers.resize(inSize);
         }
     }
-    else if (inSize < mWorkers.size()) // Deletes a few workers
+    interrupt(removedWorkers);
+}
+
+
+WorkerPool::Workers WorkerPool::getWorkers() const
+{
+    ScopedLock lock(mMutex);
+    return mWorkers;
+}
+
+
+void WorkerPool::wait()
+{
+    // The pool is not locked while waiting, because the
+    // running tasks may want to schedule new tasks.
+    Workers workers = getWorkers();
+
+    // A worker that we already waited for may have stolen
+    // a task from one that we didn't wait for yet.
+    do
     {
-        interruptRange(inSize, mWorkers.size() - inSize);
-        mWorkers.resize(inSize);
+        for (std::size_t idx = 0; idx != workers.size(); ++idx)
+        {
+            Worker& worker = *workers[idx];
+            worker.wait();
+        }
     }
+    while (!idle(workers));
 }
 
 
-void WorkerPool::wait()
+bool WorkerPool::wait(const boost::system_time& inDeadline)
 {
-    ScopedLock lock(mMutex);
-    for (std::size_t idx = 0; idx != mWorkers.size(); ++idx)
+    Workers workers = getWorkers();
+    do
     {
-        Worker& worker = *mWorkers[idx];
-        worker.wait();
+        for (std::size_t idx = 0; idx != workers.size(); ++idx)
+        {
+            Worker& worker = *workers[idx];
+            if (!worker.wait(inDeadline))
+            {
+                return false;
+            }
+        }
+    }
+    while (!idle(workers));
+    return true;
+}
+
+
+bool WorkerPool::idle(const Workers& inWorkers)
+{
+    // With all queues locked no task can change hands.
+    LockMany<Mutex> locker;
+    for (std::size_t idx = 0; idx != inWorkers.size(); ++idx)
+    {
+        locker.lock(inWorkers[idx]->mQueueMutex);
+    }
+
+    for (std::size_t idx = 0; idx != inWorkers.size(); ++idx)
+    {
+        const Worker& worker = *inWorkers[idx];
+        if (!worker.mQueue.empty() || worker.status() != WorkerStatus_Waiting)
+        {
+            return false;
+        }
     }
+    return true;
 }
 
 
-void WorkerPool::interruptRange(std::size_t inBegin, std::size_t inCount)
+void WorkerPool::interrupt(const Workers& inWorkers)
 {
     LockMany<Mutex> locker;
 
     //
     // Lock all workers.
     //
-    for (std::size_t idx = inBegin; idx != inBegin + inCount; ++idx)
+    for (std::size_t idx = 0; idx != inWorkers.size(); ++idx)
     {
-        Worker& worker = *mWorkers[idx];
+        Worker& worker = *inWorkers[idx];
         locker.lock(worker.mQueueMutex);
 
         // Keep queue locked for now.
@@ -92,22 +227,25 @@ void WorkerPool::interruptRange(std::size_t inBegin, std::size_t inCount)
     //
     // Clear queues and interrupt the work.
     //
-    for (std::size_t idx = inBegin; idx != inBegin + inCount; ++idx)
+    for (std::size_t idx = 0; idx != inWorkers.size(); ++idx)
     {
-        Worker& worker = *mWorkers[idx];
+        Worker& worker = *inWorkers[idx];
 
-        worker.mQueue.clear();
+        worker.clearQueue();
         worker.interrupt(false);
 
         // NOTE: don't wait here, because that would be wasteful.
     }
 
+    // The interrupted tasks may need a queue to finish.
+    locker.unlockAll();
+
     //
     // Wait until all workers are ready.
     //
-    for (std::size_t idx = inBegin; idx != inBegin + inCount; ++idx)
+    for (std::size_t idx = 0; idx != inWorkers.size(); ++idx)
     {
-        Worker& worker = *mWorkers[idx];
+        Worker& worker = *inWorkers[idx];
         ScopedLock statusLock(worker.mStatusMutex);
         if (worker.mStatus == WorkerStatus_Working)
         {
@@ -119,8 +257,8 @@ void WorkerPool::interruptRange(std::size_t inBegin, std::size_t inCount)
 
 void WorkerPool::interruptAndClearQueue()
 {
-    ScopedLock lock(mMutex);
-    interruptRange(0, mWorkers.size());
+    // Not locked while waiting, see wait().
+    interrupt(getWorkers());
 }
 
 
@@ -5,6 +5,7 @@
 #include "Tetris/BlockType.h"
 #include "Tetris/BlockTypes.h"
 #include "Tetris/NodePtr.h"
+#include "Futile/Arena.h"
 
 
 namespace Tetris {
@@ -24,17 +25,29 @@ class GameState;
  */
 void CarveBestPath(NodePtr startNode, NodePtr endNode);
 
-bool IsGameOver(const GameState& inGameState, BlockType inBlockType, int inRotation);
+// Returns true if the block can't be spawned, see GetSpawnBlock.
+bool IsGameOver(const GameState& inGameState, BlockType inBlockType);
 
 void GenerateOffspring(NodePtr ioGameStateNode,
                        BlockTypes inBlockTypes,
                        std::size_t inOffset,
                        const Evaluator& inEvaluator);
 
+// The child nodes are placed in inArena if it is set. Such nodes are not
+// reference counted, and they are released with the arena (see GameStateNode::Create).
 void GenerateOffspring(NodePtr ioGameStateNode,
                        BlockType inBlockType,
                        const Evaluator& inEvaluator,
-                       ChildNodes& outChildNodes);
+                       ChildNodes& outChildNodes,
+                       Futile::Arena* inArena = 0);
+
+// Like the function above, but only the best inMaxCount children are created.
+void GenerateOffspring(NodePtr ioGameStateNode,
+                       BlockType inBlockType,
+                       const Evaluator& inEvaluator,
+                       std::size_t inMaxCount,
+                       ChildNodes& outChildNodes,
+                       Futile::Arena* inArena = 0);
 
 
 } // namespace Tetris
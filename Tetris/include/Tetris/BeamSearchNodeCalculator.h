@@ -0,0 +1,38 @@
+#ifndef TETRIS_BEAMSEARCHNODECALCULATOR_H_INCLUDED
+#define TETRIS_BEAMSEARCHNODECALCULATOR_H_INCLUDED
+
+
+#include "Tetris/NodeCalculatorImpl.h"
+
+
+namespace Tetris {
+
+
+/**
+ * BeamSearchNodeCalculator keeps the best inWidths[depth] nodes of each depth,
+ * regardless of their parents. The amount of work grows linearly with the
+ * search depth instead of exponentially.
+ */
+class BeamSearchNodeCalculator : public NodeCalculatorImpl
+{
+public:
+    BeamSearchNodeCalculator(NodePtr inNode,
+                             const BlockTypes& inBlockTypes,
+                             const std::vector<int>& inWidths,
+                             const Evaluator& inEvaluator,
+                             Futile::WorkerPool& inWorkerPool);
+
+    virtual ~BeamSearchNodeCalculator();
+
+private:
+    virtual void populate();
+
+    // Runs on a pool worker.
+    void generateCandidates(NodePtr inNode, BlockType inBlockType, ChildNodes* outCandidates);
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_BEAMSEARCHNODECALCULATOR_H_INCLUDED
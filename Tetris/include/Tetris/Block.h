@@ -4,6 +4,7 @@
 
 #include "Tetris/Grid.h"
 #include "Futile/TypedWrapper.h"
+#include <cstdint>
 #include <memory>
 
 
@@ -16,41 +17,37 @@ Futile_TypedWrapper(Row, std::size_t);
 Futile_TypedWrapper(Column, std::size_t);
 
 
-// Forward declarations.
-class BlockImpl;
 typedef char BlockType;
 
 
 /**
  * Represents a Tetris block.
+ *
+ * A block is a small value: its type, rotation and position. The shape is
+ * looked up in the static tables of GetGrid and GetRowMasks, so blocks can be
+ * copied freely without allocations.
  */
 class Block
 {
 public:
     Block(BlockType inType, Rotation inRotation, Row inRow, Column inColumn);
 
-    Block(const Block& inBlock);
+    int identification() const { return 4 * (mType - 1) + mRotation; }
 
-    Block& operator=(const Block& inBlock);
-
-    ~Block();
-
-    int identification() const;
-
-    BlockType type() const;
+    BlockType type() const { return mType; }
 
     // Get the grid associated with this block
     const Grid& grid() const;
 
-    std::size_t row() const;
+    std::size_t row() const { return mRow; }
 
     std::size_t rowCount() const;
 
-    std::size_t column() const;
+    std::size_t column() const { return mColumn; }
 
     std::size_t columnCount() const;
 
-    std::size_t rotation() const;
+    std::size_t rotation() const { return mRotation; }
 
     std::size_t numRotations() const;
 
@@ -63,7 +60,10 @@ public:
     void setRotation(std::size_t inRotation);
 
 private:
-    BlockImpl* mImpl;
+    std::uint16_t mRow;
+    BlockType mType;
+    std::uint8_t mRotation;
+    std::uint8_t mColumn;
 };
 
 
@@ -78,6 +78,10 @@ int GetBlockIdentifier(BlockType inType, int inRotation);
 // Gets the Grid object that is associated with a block identifier
 const Grid& GetGrid(int inBlockIdentifier);
 
+// Gets the occupancy of each row of the block's grid (see RowMask).
+// The returned array has GetGrid(inBlockIdentifier).rowCount() elements.
+const RowMask* GetRowMasks(int inBlockIdentifier);
+
 
 } // namespace Tetris
 
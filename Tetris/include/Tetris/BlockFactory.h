@@ -3,7 +3,8 @@
 
 
 #include "Tetris/BlockTypes.h"
-#include "Futile/Threading.h"
+#include "Futile/RandomStream.h"
+#include <boost/scoped_ptr.hpp>
 #include <memory>
 
 
@@ -30,23 +31,50 @@ private:
 
 
 // The default block factory
+//
+// Each factory owns its random stream, so factories never share state and the
+// same seed always gives the same blocks. Blocks are shuffled a batch of bags
+// at a time. A factory is not thread-safe, GameImpl only uses it under its lock.
 class BlockFactory : public AbstractBlockFactory
 {
 public:
     // The size of the bag of blocks that shuffled and taken from.
+    // The seed is taken from the clock.
     BlockFactory(int inBagSize = 1);
 
+    // Creates a factory that always produces the same blocks for the same seed.
+    BlockFactory(int inBagSize, unsigned inSeed);
+
+    // Creates a factory that draws from the given stream, see split().
+    BlockFactory(int inBagSize, const Futile::RandomStream& inRandom);
+
     virtual ~BlockFactory();
 
     // Returns a random block type.
     virtual BlockType getNext() const;
 
+    // Gets the contents of a full bag, sorted by block type.
+    void getBag(BlockTypes& outBlocks) const;
+
+    // Gets the blocks that are left in the bag after the first inDrawCount
+    // results of getNext. The drawn blocks are the first inDrawCount elements
+    // of inDrawnBlocks. If the bag is empty then the full bag is returned,
+    // because it is reshuffled on the next call. The result is sorted.
+    void getRemainingBlocks(const BlockTypes& inDrawnBlocks,
+                            std::size_t inDrawCount,
+                            BlockTypes& outBlocks) const;
+
+    // Returns an independent stream that is derived from this factory's stream,
+    // for example to seed a child game. The results of split() are as reproducible
+    // as the blocks, but don't affect them.
+    Futile::RandomStream split();
+
 private:
     BlockFactory(const BlockFactory &);
     BlockFactory& operator=(const BlockFactory&);
 
     struct Impl;
-    Futile::ThreadSafe<Impl> mThreadSafeImpl;
+    boost::scoped_ptr<Impl> mImpl;
 };
 
 
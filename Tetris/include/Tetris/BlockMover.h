@@ -22,6 +22,10 @@ typedef boost::function<void(BlockMover *)> BlockMoverCallback;
  *
  * A BlockMove object will peridically move the current tetris block
  * one square closer to the next precalculated block (from the AI).
+ *
+ * The inputs that lead to the precalculated block are computed once per
+ * block (see FindPath) and replayed one per tick. They are only recomputed
+ * if the board changes under the block, for example by garbage lines.
  */
 class BlockMover
 {
@@ -47,6 +51,11 @@ public:
 
     MoveDownBehavior moveDownBehavior() const;
 
+    // In instant mode all inputs of a block and its commit are applied on one tick.
+    void setInstantMode(bool inInstantMode);
+
+    bool instantMode() const;
+
 private:
     BlockMover(const BlockMover &);
     BlockMover& operator=(const BlockMover&);
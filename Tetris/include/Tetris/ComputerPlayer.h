@@ -4,6 +4,7 @@
 
 #include "Tetris/BlockMover.h"
 #include "Tetris/Evaluator.h"
+#include "Tetris/NodeCalculator.h"
 #include "Tetris/Player.h"
 #include "Futile/AutoPtrSupport.h"
 #include "Futile/Threading.h"
@@ -63,10 +64,21 @@ public:
 
     void setSearchWidth(int inSearchWidth);
 
+    NodeCalculator::SearchType searchType() const;
+
+    // SearchType_Beam is meant for search depths well beyond the default.
+    void setSearchType(NodeCalculator::SearchType inSearchType);
+
     int moveSpeed() const;
 
     void setMoveSpeed(int inMoveSpeed);
 
+    // In instant mode each block is moved to its place and committed on
+    // one tick, so the move speed becomes the number of blocks per second.
+    bool instantMode() const;
+
+    void setInstantMode(bool inInstantMode);
+
     int workerCount() const;
 
     // Set to 0 to auto-select
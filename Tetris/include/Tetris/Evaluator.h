@@ -8,6 +8,7 @@
 #include "Futile/TypedWrapper.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 
 namespace Tetris {
@@ -34,6 +35,13 @@ class Evaluator
 public:
     virtual int evaluate(const GameState& inGameState) const;
 
+    // Evaluates game states that all have the same board size, for example the
+    // children of one node. The result is the same as calling evaluate() on each
+    // game state, but the scores are computed in a single pass over their
+    // features, several at a time.
+    virtual void evaluateBatch(const std::vector<const GameState*>& inChildren,
+                               std::vector<int>& outScores) const;
+
     // Return by value to prevent race conditions.
     std::string name() const;
 
@@ -86,9 +94,10 @@ private:
 };
 
 
+// An evaluator with factors that are chosen at runtime, see EvaluatorTuner.
 class CustomEvaluator : public Evaluator
 {
-protected:
+public:
     CustomEvaluator(GameHeightFactor inGameHeightFactor,
                     LastBlockHeightFactor inLastBlockHeightFactor,
                     NumHolesFactor inNumHolesFactor,
@@ -103,6 +112,9 @@ protected:
 };
 
 
+// The factors of a ConcreteEvaluator are known at compile time. It evaluates the
+// standard board size with code that is specialized for its factors and the board
+// dimensions, other board sizes use the runtime-sized code of Evaluator.
 template<class SubType>
 class ConcreteEvaluator : public Evaluator
 {
@@ -113,6 +125,11 @@ public:
         return fInstance;
     }
 
+    virtual int evaluate(const GameState& inGameState) const;
+
+    virtual void evaluateBatch(const std::vector<const GameState*>& inChildren,
+                               std::vector<int>& outScores) const;
+
 protected:
     ConcreteEvaluator(const std::string& inName,
                       GameHeightFactor inGameHeightFactor,
@@ -165,9 +182,6 @@ protected:
 
 class MakeTetrises : public ConcreteEvaluator<MakeTetrises>
 {
-public:
-    virtual int evaluate(const GameState& inGameState) const;
-
 protected:
     typedef ConcreteEvaluator<MakeTetrises> Super;
     friend class ConcreteEvaluator<MakeTetrises>;
@@ -196,12 +210,17 @@ protected:
 
     Confused();
     virtual ~Confused() {}
-
-private:
-    int evaluate(const GameState& inGameState) const final;
 };
 
 
+// Defined in Evaluator.cpp.
+extern template class ConcreteEvaluator<Balanced>;
+extern template class ConcreteEvaluator<Survival>;
+extern template class ConcreteEvaluator<MakeTetrises>;
+extern template class ConcreteEvaluator<Multiplayer>;
+extern template class ConcreteEvaluator<Confused>;
+
+
 } // namespace Tetris
 
 
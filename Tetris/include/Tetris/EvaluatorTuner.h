@@ -0,0 +1,114 @@
+#ifndef TETRIS_EVALUATORTUNER_H_INCLUDED
+#define TETRIS_EVALUATORTUNER_H_INCLUDED
+
+
+#include "Tetris/NodeCalculator.h"
+#include <boost/scoped_ptr.hpp>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+namespace Tetris {
+
+
+class CustomEvaluator;
+class Evaluator;
+
+
+/**
+ * EvaluatorTuner searches for good CustomEvaluator factors.
+ *
+ * It runs a separable CMA-ES: each generation samples candidates around a
+ * mean with a step size per factor, and moves the mean and the step sizes
+ * towards the best half. Only the rank-mu update is used, there are no
+ * evolution paths.
+ *
+ * A candidate's fitness is its average score in a few headless games. The
+ * number of lines doesn't work: under a block cap all decent candidates clear
+ * about the same number of lines. The score still rewards the candidates that
+ * clear them as tetrises, and with garbage enabled the candidates that die
+ * early lose the score of the blocks they didn't play. All candidates of a
+ * generation play the same seeds. The games run in parallel on worker threads
+ * that are kept for all generations.
+ */
+class EvaluatorTuner
+{
+public:
+    enum
+    {
+        cFactorCount = 7
+    };
+
+    // The factors in the order of the CustomEvaluator constructor arguments.
+    typedef std::array<int, cFactorCount> Factors;
+
+    // Returns the factors of an existing evaluator.
+    static Factors GetFactors(const Evaluator& inEvaluator);
+
+    // Returns the factor names, for example "NumHolesFactor".
+    static const char* GetFactorName(std::size_t inIndex);
+
+    EvaluatorTuner(const Factors& inStartFactors, std::size_t inThreadCount);
+
+    ~EvaluatorTuner();
+
+    void setBoardSize(std::size_t inRowCount, std::size_t inColumnCount);
+
+    void setSearch(int inSearchDepth, int inSearchWidth, NodeCalculator::SearchType inSearchType);
+
+    // The number of candidates per generation.
+    void setPopulationSize(std::size_t inPopulationSize);
+
+    void setGamesPerCandidate(std::size_t inGameCount);
+
+    // Games end after this many blocks. This limits the time of a generation.
+    // Zero means no limit, which only ends if garbage is enabled.
+    void setMaxBlockCount(std::size_t inMaxBlockCount);
+
+    // Adds garbage to the games, see Simulation::setGarbage.
+    void setGarbage(int inInterval, int inLineCount);
+
+    // The seed of the candidates and of the games.
+    void setSeed(unsigned inSeed);
+
+    // Evaluates one generation and updates the distribution.
+    void runGeneration();
+
+    // Returns the number of generations that were run.
+    std::size_t generation() const;
+
+    // Returns the best candidate found so far.
+    const Factors& bestFactors() const;
+
+    // Returns the fitness of the best candidate.
+    double bestFitness() const;
+
+    // Returns the average fitness of the last generation.
+    double averageFitness() const;
+
+    std::unique_ptr<CustomEvaluator> createBestEvaluator() const;
+
+    // Writes the state of the search, so that it can be resumed later.
+    // The file is replaced atomically.
+    void saveCheckpoint(const std::string& inFileName) const;
+
+    // Restores a state that was written by saveCheckpoint. Throws if the
+    // file can't be read, or if it was written with another seed, population
+    // size or number of games per candidate.
+    void loadCheckpoint(const std::string& inFileName);
+
+private:
+    EvaluatorTuner(const EvaluatorTuner&);
+    EvaluatorTuner& operator=(const EvaluatorTuner&);
+
+    struct Impl;
+    boost::scoped_ptr<Impl> mImpl;
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_EVALUATORTUNER_H_INCLUDED
@@ -0,0 +1,71 @@
+#ifndef TETRIS_EXPECTIMAXNODECALCULATOR_H_INCLUDED
+#define TETRIS_EXPECTIMAXNODECALCULATOR_H_INCLUDED
+
+
+#include "Tetris/NodeCalculatorImpl.h"
+
+
+namespace Tetris {
+
+
+/**
+ * ExpectimaxNodeCalculator searches the known blocks like the tree search.
+ * The leaves are then scored by looking ahead over the unknown blocks that
+ * follow, averaging over the blocks that the bag can still produce. Only the
+ * nodes of the known blocks are stored in the tree.
+ *
+ * Each unknown block multiplies the number of branches by the number of block
+ * types. Only the first unknown block keeps the search width, the blocks after
+ * it only keep their best placement. The nodes of the unknown blocks live in a
+ * small arena per branch that is released when the branch has been scored.
+ *
+ * The search depth is given by inWidths.size(). It must not be smaller than
+ * inBlockTypes.size().
+ */
+class ExpectimaxNodeCalculator : public NodeCalculatorImpl
+{
+public:
+    ExpectimaxNodeCalculator(NodePtr inNode,
+                             const BlockTypes& inBlockTypes,
+                             const std::vector<int>& inWidths,
+                             const Evaluator& inEvaluator,
+                             Futile::WorkerPool& inWorkerPool,
+                             const BlockTypes& inFullBag,
+                             const BlockTypes& inRemainingBlocks);
+
+    virtual ~ExpectimaxNodeCalculator();
+
+private:
+    virtual void populate();
+
+    // Runs on a pool worker.
+    void expandNode(NodePtr inNode, std::size_t inIndex, ChildNodes* outChildNodes);
+
+    // Runs on a pool worker.
+    void evaluateBranch(NodePtr inNode, BlockType inBlockType, BlockTypes inBag, double* outValue);
+
+    // Scores the leaves with the expected value over the blocks that may follow.
+    // The values of the branches are written to outBranchValues by the pool workers.
+    NodePtr findBestLeaf(const std::vector<NodePtr>& inLeaves, std::vector<double>& outBranchValues);
+
+    // Returns the expected quality of inNode over the blocks in inBag.
+    double getExpectedValue(NodePtr inNode, std::size_t inIndex, const BlockTypes& inBag, Futile::Arena& ioArena) const;
+
+    // Returns the best value that can be reached by placing inBlockType on inNode.
+    double getBranchValue(NodePtr inNode, std::size_t inIndex, BlockType inBlockType, const BlockTypes& inBag, Futile::Arena& ioArena) const;
+
+    // Returns the number of placements that are kept for the block at inIndex.
+    int getChanceWidth(std::size_t inIndex) const;
+
+    // Returns the bag after drawing inBlockType.
+    BlockTypes drawFromBag(const BlockTypes& inBag, BlockType inBlockType) const;
+
+    BlockTypes mFullBag;
+    BlockTypes mRemainingBlocks;
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_EXPECTIMAXNODECALCULATOR_H_INCLUDED
@@ -42,6 +42,9 @@ protected:
      */
     GameImpl(std::size_t inNumRows, std::size_t inNumColumns);
 
+    // Takes ownership of the block factory.
+    GameImpl(std::size_t inNumRows, std::size_t inNumColumns, BlockFactory* inBlockFactory);
+
     // Friendship required for destructor.
     friend class ThreadSafe<GameImpl>;
 
@@ -84,6 +87,11 @@ public:
 
     bool isPaused() const;
 
+    // A muted game sends no events. It can be played without a main thread.
+    void setMuted(bool inMuted);
+
+    bool isMuted() const;
+
     bool isGameOver() const;
 
     int rowCount() const;
@@ -118,6 +126,10 @@ public:
 
     void getFutureBlocksWithOffset(std::size_t inOffset, std::size_t inCount, BlockTypes& outBlocks);
 
+    // Gets the state of the block bag right before block inOffset is drawn:
+    // the contents of a full bag and the blocks that can still be drawn.
+    void getBlockBag(std::size_t inOffset, BlockTypes& outFullBag, BlockTypes& outRemainingBlocks);
+
     virtual const GameState& gameState() const = 0;
 
     // For multiplayer crazyness
@@ -150,6 +162,9 @@ protected:
     std::size_t mNumColumns;
     boost::scoped_ptr<Block> mActiveBlock;
     boost::scoped_ptr<BlockFactory> mBlockFactory;
+
+    // Split from the block factory, so that garbage is as reproducible as the blocks.
+    mutable Futile::RandomStream mGarbageRandom;
     BlockTypes mBlocks;
     int mFutureBlocksCount;
     std::size_t mCurrentBlockIndex;
@@ -161,24 +176,26 @@ protected:
     bool mMuteEvents;
 
     /**
-     * Create an instance to make the mMuteEvents false over a certain scope.
+     * Create an instance to make the mMuteEvents true over a certain scope.
      * This is handy when we are running a loop and don't want to trigger for
-     * for each event.
+     * for each event. The previous value is restored afterwards.
      */
     struct ScopedMute : boost::noncopyable
     {
         ScopedMute(bool& value) :
-            mValue(value)
+            mValue(value),
+            mOldValue(value)
         {
             mValue = true;
         }
 
         ~ScopedMute()
         {
-            mValue = false;
+            mValue = mOldValue;
         }
 
         bool& mValue;
+        bool mOldValue;
     };
 
 private:
@@ -188,8 +205,10 @@ private:
 
     static bool Exists(const GameImpl& inGame);
 
+    // Games may be created in any thread.
     typedef std::set<const GameImpl*> Instances;
     static Instances sInstances;
+    static Futile::Mutex sInstancesMutex;
 };
 
 
@@ -230,6 +249,13 @@ public:
         return ThreadSafe<GameImpl>(new ComputerGame(inNumRows, inNumColumns));
     }
 
+    // Creates a game with a seeded block factory. Games with the same
+    // seed get the same blocks.
+    inline static ThreadSafe<GameImpl> Create(std::size_t inNumRows, std::size_t inNumColumns, unsigned inSeed)
+    {
+        return ThreadSafe<GameImpl>(new ComputerGame(inNumRows, inNumColumns, inSeed));
+    }
+
     virtual bool move(MoveDirection inDirection);
 
     void appendPrecalculatedNode(NodePtr inNode);
@@ -254,6 +280,8 @@ protected:
 
     ComputerGame(std::size_t inNumRows, std::size_t inNumCols);
 
+    ComputerGame(std::size_t inNumRows, std::size_t inNumCols, unsigned inSeed);
+
     ComputerGame(const GameImpl& inGame);
 
     GameState& gameState();
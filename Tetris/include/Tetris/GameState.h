@@ -5,8 +5,19 @@
 #include "Tetris/Block.h"
 #include "Tetris/GameOver.h"
 #include "Tetris/Grid.h"
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
+#include <vector>
+
+
+namespace Futile {
+
+
+class Arena;
+
+
+} // namespace Futile
 
 
 namespace Tetris {
@@ -17,8 +28,41 @@ class GameState
 public:
     GameState(std::size_t inNumRows, std::size_t inNumColumns);
 
+    // Copies are always materialized.
+    GameState(const GameState& inGameState);
+
+    // Gamestates in an arena are never destroyed (see commitDelta).
+    ~GameState();
+
+    std::size_t rowCount() const { return mNumRows; }
+
+    std::size_t columnCount() const { return mNumColumns; }
+
+    // The grid contains the block type of each square. Used for rendering.
+    // Requires a materialized gamestate that has a grid (see hasGrid).
     const Grid& grid() const;
 
+    // Gamestates of the search only store the occupancy of the squares.
+    // Gamestates in an arena, and their copies, have no grid.
+    bool hasGrid() const { return mBoard && mBoard->mGrid; }
+
+    // Occupancy bitmask of the given row. Used for collision and line detection.
+    // Also works on gamestates that are not materialized.
+    RowMask rowMask(std::size_t inRowIdx) const
+    { return mBoard ? mBoard->rowMasks()[inRowIdx] : getDeltaRowMask(inRowIdx); }
+
+    // Mask of a completely filled row.
+    RowMask fullRowMask() const { return mFullRowMask; }
+
+    // Number of empty squares that are directly below an occupied square.
+    int numHoles() const { return mNumHoles; }
+
+    int numOccupiedSquares() const { return mNumOccupiedSquares; }
+
+    // Zobrist hash of the occupied squares. Equal boards have equal hashes
+    // regardless of the block types and the order in which they were placed.
+    std::uint64_t hash() const { return mHash; }
+
     // Modifies the grid bypassing Tetris rules.
     // This is required to enable certain multiplayer features.
     void setGrid(const Grid& inGrid);
@@ -33,12 +77,37 @@ public:
 
     // Checks if a Block can be placed at a given location
     // without overlapping with previously placed blocks.
+    // Requires a materialized gamestate.
     bool checkPositionValid(const Block& inBlock, std::size_t inRowIdx, std::size_t inColIdx) const;
 
     // Creates a copy of the current gamestate with the given active block committed.
     // Use inGameOver = true to mark the new gamestate as "game over".
     std::unique_ptr<GameState> commit(const Block& inBlock, GameOver inGameOver) const;
 
+    // Like commit(...) but the new gamestate is placed in inArena, see commitDelta.
+    GameState* commit(const Block& inBlock, GameOver inGameOver, Futile::Arena& inArena) const;
+
+    // Like commit(...) but the new gamestate only stores the block and the lines it
+    // clears. Its statistics and holes are available immediately, its board is
+    // only built by materialize(). Used by the search tree, where most children
+    // are never expanded. This gamestate must outlive the child's materialization.
+    std::unique_ptr<GameState> commitDelta(const Block& inBlock) const;
+
+    // Like commitDelta(...) but the new gamestate is placed in inArena. Its
+    // board will be placed there too. Such gamestates don't own any memory
+    // outside of the arena, so they are released with it without being destroyed.
+    GameState* commitDelta(const Block& inBlock, Futile::Arena& inArena) const;
+
+    // Copies this gamestate into inArena. A gamestate that is not materialized
+    // remains a delta against inParent, which must be a copy of its parent.
+    GameState* copy(Futile::Arena& inArena, const GameState* inParent) const;
+
+    // Returns false for gamestates created by commitDelta that have not been materialized yet.
+    bool isMaterialized() const { return mBoard != 0; }
+
+    // Builds the board by replaying the commit on the parent's board.
+    void materialize();
+
 
     // Statistics
     int numLines() const { return mNumLines; }
@@ -48,15 +117,74 @@ public:
     int numTetrises() const { return mNumTetrises; }
     int score() const;
     int firstOccupiedRow() const { return mFirstOccupiedRow; }
-    int currentHeight() const { return mGrid.rowCount() - mFirstOccupiedRow; }
+    int currentHeight() const { return mNumRows - mFirstOccupiedRow; }
 
     void updateCache();
 
 private:
+    // Creates a gamestate that is not materialized. Used by commitDelta.
+    GameState(const GameState& inParent, const Block& inBlock);
+
+    GameState& operator=(const GameState&);
+
+    // Calculates the statistics of a gamestate created by GameState(*this, inBlock).
+    void initDelta(GameState& ioChild) const;
+
     void solidifyBlock(const Block& inBlock);
     void clearLines();
+    void updateLineStats(std::size_t inNumLines);
+    RowMask getDeltaRowMask(std::size_t inRowIdx) const;
 
-    Grid mGrid;
+    // Hashes the rows [inBeginRow, inEndRow).
+    std::uint64_t hashRows(std::size_t inBeginRow, std::size_t inEndRow) const;
+
+    // Counts the holes in the rows [inBeginRow, inEndRow).
+    int countHoles(std::size_t inBeginRow, std::size_t inEndRow) const;
+
+    // Creates the copy of inGameState in inArena (see copy).
+    GameState(const GameState& inGameState, Futile::Arena* inArena, const GameState* inParent);
+
+    // Applies the commit of inBlock to a copy of this gamestate.
+    void commitCopy(const Block& inBlock, GameOver inGameOver);
+
+    // The squares of a materialized gamestate. The row masks follow the board
+    // in the same allocation. Boards in an arena have no grid.
+    struct Board
+    {
+        // Creates an empty board with a grid.
+        static Board* Create(std::size_t inNumRows, std::size_t inNumColumns);
+
+        // Copies the board to inArena, or to the heap if inArena is null.
+        static Board* Copy(const Board& inBoard, std::size_t inNumRows, Futile::Arena* inArena);
+
+        // Destroys a board on the heap.
+        static void Destroy(Board* inBoard);
+
+        RowMask* rowMasks() { return reinterpret_cast<RowMask*>(this + 1); }
+
+        const RowMask* rowMasks() const { return reinterpret_cast<const RowMask*>(this + 1); }
+
+        Grid* mGrid;
+    };
+
+    Board* mBoard;
+
+    // The arena that holds this gamestate and its board, if any.
+    Futile::Arena* mArena;
+    std::size_t mNumRows;
+    std::size_t mNumColumns;
+    RowMask mFullRowMask;
+
+    // Delta against the parent. Only used while mBoard is null. Not owned: the
+    // parent must outlive this gamestate until it is materialized. In the search
+    // tree the node of the parent owns the node of the child, and clones are
+    // materialized before they leave the tree.
+    const GameState* mParent;
+    unsigned mClearedRows; // bit i is set if row i of mOriginalBlock was cleared
+
+    int mNumHoles;
+    int mNumOccupiedSquares;
+    std::uint64_t mHash;
     Block mOriginalBlock;
     bool mIsGameOver;
     std::size_t mFirstOccupiedRow;
@@ -69,29 +197,6 @@ private:
 };
 
 
-class EvaluatedGameState
-{
-public:
-    // Takes ownership of the GameState object
-    EvaluatedGameState(GameState*  inGameState, int inQuality);
-
-    ~EvaluatedGameState();
-
-    const GameState& gameState() const;
-
-    GameState& gameState();
-
-    int quality() const;
-
-private:
-    EvaluatedGameState(const EvaluatedGameState &);
-    EvaluatedGameState& operator=(const EvaluatedGameState&);
-
-    GameState* mGameState;
-    int mQuality;
-};
-
-
 } // namespace Tetris
 
 
@@ -5,7 +5,7 @@
 #include "Tetris/GameStateComparator.h"
 #include "Tetris/Grid.h"
 #include "Tetris/NodePtr.h"
-#include <boost/scoped_ptr.hpp>
+#include "Futile/Arena.h"
 #include <memory>
 
 
@@ -24,8 +24,21 @@ class GameStateNode
 public:
     static std::unique_ptr<GameStateNode> CreateRootNode(std::size_t inNumRows, std::size_t inNumColumns);
 
+    // Creates a child node that lives entirely in the arena. The gamestate must
+    // have been placed in inArena too (see GameState::commitDelta). The node is
+    // not reference counted and it is never destroyed, so that the arena can
+    // release all its nodes at once. It must not be used after that.
+    static NodePtr Create(Futile::Arena& inArena,
+                          NodePtr inParent,
+                          GameState* inGameState,
+                          int inQuality,
+                          const Evaluator& inEvaluator);
+
     GameStateNode(NodePtr inParent, GameState* inGameState, const Evaluator& inEvaluator);
 
+    // Takes a quality that was already calculated by the evaluator (see Evaluator::evaluateBatch).
+    GameStateNode(NodePtr inParent, GameState* inGameState, int inQuality, const Evaluator& inEvaluator);
+
     GameStateNode(GameState* inGameState, const Evaluator& inEvaluator);
 
     ~GameStateNode();
@@ -33,6 +46,10 @@ public:
     // Creates a deep copy of this node and all child nodes.
     std::unique_ptr<GameStateNode> clone() const;
 
+    // Like clone(), but the copies are placed in inArena (see Create) and the
+    // copy of this node has no parent. The result keeps the arena alive.
+    NodePtr clone(const Futile::ArenaPtr& inArena) const;
+
     // Each node is produced by a unique combination of the current block's column and rotation.
     int identifier() const;
 
@@ -62,11 +79,22 @@ public:
 
     const GameState& gameState() const;
 
+    GameState& gameState();
+
     int quality() const;
 
 private:
+    GameStateNode(const GameStateNode&);
+    GameStateNode& operator=(const GameStateNode&);
+
+    // Used by Create.
+    GameStateNode(Futile::Arena& inArena, NodePtr inParent, GameState* inGameState, int inQuality, const Evaluator& inEvaluator);
+
+    // Copies this node and its descendants to inArena, below inParent.
+    NodePtr copyTo(Futile::Arena& inArena, NodePtr inParent) const;
+
     struct Impl;
-    boost::scoped_ptr<Impl> mImpl;
+    Impl* mImpl;
 };
 
 
@@ -4,6 +4,7 @@
 
 #include "Tetris/BlockType.h"
 #include "Futile/GenericGrid.h"
+#include <cstdint>
 
 
 namespace Tetris {
@@ -12,6 +13,21 @@ namespace Tetris {
 typedef Futile::GenericGrid<BlockType> Grid;
 
 
+// Occupancy of one grid row. Bit N is set if column N is occupied.
+typedef std::uint32_t RowMask;
+
+static const std::size_t cMaxColumnCount = 8 * sizeof(RowMask);
+
+
+// Returns the number of occupied squares in a row.
+inline int CountSquares(RowMask inRowMask)
+{
+    inRowMask = inRowMask - ((inRowMask >> 1) & 0x55555555);
+    inRowMask = (inRowMask & 0x33333333) + ((inRowMask >> 2) & 0x33333333);
+    return static_cast<int>((((inRowMask + (inRowMask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+
 } // namespace Futile
 
 
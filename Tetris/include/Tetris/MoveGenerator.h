@@ -0,0 +1,75 @@
+#ifndef TETRIS_MOVEGENERATOR_H_INCLUDED
+#define TETRIS_MOVEGENERATOR_H_INCLUDED
+
+
+#include "Tetris/Block.h"
+#include "Tetris/BlockType.h"
+#include <cstddef>
+#include <vector>
+
+
+namespace Tetris {
+
+
+class GameState;
+
+
+// The inputs that move the active block. Input_Rotate calls Block::rotate.
+enum Input
+{
+    Input_Left,
+    Input_Right,
+    Input_Down,
+    Input_Rotate
+};
+
+
+typedef std::vector<Input> Inputs;
+
+
+// Returns the block as the game spawns it: rotation 0, centered on the top row.
+// GameImpl spawns its blocks and IsGameOver checks the position with this function.
+Block GetSpawnBlock(BlockType inBlockType, std::size_t inColumnCount);
+
+
+/**
+ * GetReachablePlacements
+ *
+ * Gets every resting position that the block can reach from its spawn
+ * position by moving left, right and down and by rotating. This includes
+ * soft drops and tucks under overhangs, and excludes positions that a
+ * straight drop would hit but that are blocked on the way.
+ *
+ * Each position is listed once, because the rotation counts of
+ * GetBlockRotationCount have no duplicate shapes. The result is sorted by
+ * column, rotation and row. It is empty if the spawn position is blocked.
+ *
+ * The reachable positions of all columns are computed at once with row
+ * masks, so this is fast enough for the search.
+ */
+void GetReachablePlacements(const GameState& inGameState,
+                            BlockType inBlockType,
+                            std::vector<Block>& outPlacements);
+
+
+// Like the function above, but also gets the shortest input sequence that moves
+// the block from its spawn position to each placement. The final Input_Down that
+// commits the block is not included. Slower, it visits the positions one by one.
+void GetReachablePlacements(const GameState& inGameState,
+                            BlockType inBlockType,
+                            std::vector<Block>& outPlacements,
+                            std::vector<Inputs>& outPaths);
+
+
+// Gets the shortest input sequence that moves a spawned block to inTarget.
+// Returns false if inTarget can't be reached.
+bool FindPath(const GameState& inGameState, const Block& inTarget, Inputs& outInputs);
+
+// Like the function above, but starts from inStart, which must have the same block type.
+bool FindPath(const GameState& inGameState, const Block& inStart, const Block& inTarget, Inputs& outInputs);
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_MOVEGENERATOR_H_INCLUDED
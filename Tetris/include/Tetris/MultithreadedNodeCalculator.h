@@ -3,7 +3,11 @@
 
 
 #include "Tetris/NodeCalculatorImpl.h"
+#include "Futile/Threading.h"
 #include "boost/shared_ptr.hpp"
+#include <exception>
+#include <utility>
+#include <vector>
 
 
 namespace Tetris {
@@ -12,7 +16,7 @@ namespace Tetris {
 class MultithreadedNodeCalculator : public NodeCalculatorImpl
 {
 public:
-    MultithreadedNodeCalculator(std::unique_ptr<GameStateNode> inNode,
+    MultithreadedNodeCalculator(NodePtr inNode,
                                 const BlockTypes& inBlockTypes,
                                 const std::vector<int>& inWidths,
                                 const Evaluator& inEvaluator,
@@ -23,17 +27,34 @@ public:
 private:
     virtual void populate();
 
-    void generateChildNodes(NodePtr ioNode,
-                            const Evaluator* inEvaluator,
-                            BlockType inBlockType,
-                            int inDepth,
-                            int inWidth);
-
-    void populateNodes(NodePtr ioNode,
-                       const BlockTypes& inBlockTypes,
-                       const std::vector<int>& inWidths,
-                       std::size_t inIndex,
-                       std::size_t inEndIndex);
+    // Runs on a pool worker. Generates the children of a node in the given
+    // row and hands the node back to populate() to schedule the children.
+    // Errors are passed to populate(), which rethrows them.
+    void expandNode(NodePtr ioNode, std::size_t inRow);
+
+    // Returns the number of children that must be expanded next.
+    std::size_t generateChildren(NodePtr ioNode, std::size_t inRow);
+
+    // Completes the expansion of a node. Must be called once for every scheduled expansion.
+    void finishExpansion(NodePtr ioNode, std::size_t inRow, std::size_t inChildCount);
+
+    void scheduleExpansion(NodePtr inNode, std::size_t inRow);
+
+    typedef std::pair<NodePtr, std::size_t> Expansion;
+    typedef std::vector<Expansion> Expansions;
+
+    // Nodes that were expanded but whose children have not been scheduled yet.
+    Expansions mExpandedNodes;
+
+    // Number of scheduled expansions that have not completed yet, per row.
+    // Row N can only finish after row N - 1 did, and when its count is zero.
+    std::vector<std::size_t> mPendingCounts;
+    std::size_t mFinishedRowCount;
+
+    // The first exception that was thrown by an expansion.
+    std::exception_ptr mExpandError;
+    Futile::Mutex mExpandMutex;
+    Futile::Condition mExpandCondition;
 };
 
 
@@ -21,24 +21,73 @@ class NodeCalculatorImpl;
 class NodeCalculator
 {
 public:
-    NodeCalculator(std::unique_ptr<GameStateNode> inNode,
+    enum SearchType
+    {
+        // Keeps the best inWidths[depth] children of each node.
+        SearchType_Tree,
+
+        // Keeps the best inWidths[depth] nodes of each depth.
+        // Allows much deeper searches than SearchType_Tree.
+        SearchType_Beam,
+
+        // Like SearchType_Tree, but continues beyond the known blocks by
+        // averaging over the blocks that may follow. Requires the bag state,
+        // see the second constructor.
+        SearchType_Expectimax
+    };
+
+    // The start node may have children from a previous search (see resultSubtree).
+    // The tree search continues from them, the other searches start over.
+    NodeCalculator(NodePtr inNode,
+                   const BlockTypes& inBlockTypes,
+                   const std::vector<int>& inWidths,
+                   const Evaluator& inEvaluator,
+                   Futile::WorkerPool& inWorkerPool,
+                   SearchType inSearchType = SearchType_Tree);
+
+    // Creates an expectimax search (SearchType_Expectimax). The search depth
+    // is inWidths.size(). The blocks after inBlockTypes are unknown. They are
+    // drawn from inRemainingBlocks, and then from a new inFullBag each time the
+    // bag is empty.
+    NodeCalculator(NodePtr inNode,
                    const BlockTypes& inBlockTypes,
                    const std::vector<int>& inWidths,
                    const Evaluator& inEvaluator,
-                   Futile::WorkerPool& inWorkerPool);
+                   Futile::WorkerPool& inWorkerPool,
+                   const BlockTypes& inFullBag,
+                   const BlockTypes& inRemainingBlocks);
 
     ~NodeCalculator();
 
     void start();
 
+    // Starts the search and stops it after inTimeLimit milliseconds. The
+    // result is then that of the deepest search depth that was finished.
+    // The search runs past the time limit until the first depth is finished.
+    void start(int inTimeLimit);
+
+    // Runs the search in the calling thread instead of starting it.
+    // Returns when the search is finished (or failed, see status).
+    void run();
+
     void stop();
 
     int getCurrentSearchDepth() const;
 
     int getMaxSearchDepth() const;
 
+    // Returns the number of nodes that the search has generated so far.
+    std::size_t getNodeCount() const;
+
+    // Returns the first move of the best path that was found. The rest of
+    // the path is left to the next search, which knows one more block.
     NodePtr result() const;
 
+    // Returns the search tree node of the result, with the nodes that were
+    // searched below it. It has no parent, so it can be passed as the start
+    // node of the next search. See NodeCalculatorFactory.
+    NodePtr resultSubtree() const;
+
     enum Status
     {
         Status_Nil,
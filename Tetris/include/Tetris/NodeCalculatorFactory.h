@@ -0,0 +1,56 @@
+#ifndef TETRIS_NODECALCULATORFACTORY_H_INCLUDED
+#define TETRIS_NODECALCULATORFACTORY_H_INCLUDED
+
+
+#include "Tetris/NodeCalculator.h"
+#include "Tetris/NodePtr.h"
+#include "Futile/WorkerPool.h"
+#include <memory>
+
+
+namespace Tetris {
+
+
+class ComputerGame;
+class Evaluator;
+
+
+// Creates the searches that play a computer game, one move at a time.
+//
+// A search only plays its first move. The tree search keeps the nodes that it
+// searched below that move, and the next tree search starts from them if the
+// game still matches. Each search then only needs to add one row to the tree.
+// The other searches start over each time.
+class NodeCalculatorFactory
+{
+public:
+    NodeCalculatorFactory();
+
+    // Creates the search for the move after the end node of ioGame. Returns
+    // null if there is nothing to search: the game is over, or the expectimax
+    // search must wait for the next preview block.
+    std::unique_ptr<NodeCalculator> create(ComputerGame& ioGame,
+                                           const Evaluator& inEvaluator,
+                                           Futile::WorkerPool& inWorkerPool,
+                                           NodeCalculator::SearchType inSearchType,
+                                           int inSearchDepth,
+                                           int inSearchWidth);
+
+    // Appends the move of a finished search to ioGame, and keeps the nodes
+    // below it for the next search. Returns false if the search found no move
+    // or if the end node of the game has changed since the search was created.
+    bool appendResult(const NodeCalculator& inNodeCalculator, ComputerGame& ioGame);
+
+private:
+    NodeCalculatorFactory(const NodeCalculatorFactory&);
+    NodeCalculatorFactory& operator=(const NodeCalculatorFactory&);
+
+    NodePtr mResultSubtree;
+    NodeCalculator::SearchType mSearchType;
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_NODECALCULATORFACTORY_H_INCLUDED
@@ -5,11 +5,14 @@
 #include "Tetris/BlockTypes.h"
 #include "Tetris/GameStateNode.h"
 #include "Tetris/Evaluator.h"
+#include "Tetris/TranspositionTable.h"
 #include "Futile/Worker.h"
 #include "Futile/WorkerPool.h"
 #include "Futile/Logging.h"
 #include "Futile/MakeString.h"
 #include "Futile/Assert.h"
+#include <boost/scoped_ptr.hpp>
+#include <atomic>
 #include <vector>
 #include <memory>
 
@@ -23,7 +26,7 @@ namespace Tetris {
 class NodeCalculatorImpl
 {
 public:
-    NodeCalculatorImpl(std::unique_ptr<GameStateNode> inNode,
+    NodeCalculatorImpl(NodePtr inNode,
                        const BlockTypes& inBlockTypes,
                        const std::vector<int>& inWidths,
                        const Evaluator& inEvaluator,
@@ -33,14 +36,24 @@ public:
 
     void start();
 
+    // Stops the search after inTimeLimit milliseconds, but not before the
+    // first search depth is finished.
+    void start(int inTimeLimit);
+
+    void run();
+
     void stop();
 
     int getCurrentSearchDepth() const;
 
     int getMaxSearchDepth() const;
 
+    std::size_t getNodeCount() const;
+
     NodePtr result() const;
 
+    NodePtr resultSubtree() const;
+
     int status() const;
 
     std::string errorMessage() const;
@@ -55,6 +68,10 @@ protected:
 
     void setStatus(int inStatus);
 
+    // Changes the status from inOldStatus to inNewStatus in one step.
+    // Returns false if the status wasn't inOldStatus.
+    bool compareAndSetStatus(int inOldStatus, int inNewStatus);
+
     void populateNodesRecursively(NodePtr ioNode,
                                   const BlockTypes& inBlockTypes,
                                   const std::vector<int>& inWidths,
@@ -63,8 +80,32 @@ protected:
 
     void destroyInferiorChildren();
 
+    // Returns true if another node in the tree already represents the same
+    // board, statistics and depth. Such a node has the same subtree, so this
+    // one does not need to be expanded. Otherwise inNode becomes the
+    // representative of its position.
+    bool isTransposition(const GameStateNode& inNode);
+
+    // Adds generated nodes to the statistics. Called by the workers.
+    void addNodeCount(std::size_t inCount) const;
+
     void calculateResult();
 
+    // Returns true if start(int) was used and the first search depth is finished.
+    // The search must then stop at mDeadline.
+    bool hasDeadline() const;
+
+    // Returns true if the search must stop now because of its time limit.
+    bool deadlinePassed() const;
+
+    // Stops the search because of its time limit, like stop() does. Throws
+    // boost::thread_interrupted. Must be called by the thread that runs populate().
+    void interruptAtDeadline();
+
+    // Waits until the pool has finished its tasks. Calls interruptAtDeadline()
+    // if the time limit passes first.
+    void waitForWorkers();
+
     // Store info per horizontal level of nodes.
     class TreeRowInfo
     {
@@ -112,79 +153,73 @@ protected:
         bool mFinished;
     };
 
+    // Rows are counted from zero: the children of the start node are in row 0.
+    // Rows finish in order, but nodes may be registered in any unfinished row.
     class TreeRowInfos
     {
     public:
         TreeRowInfos(const Evaluator& inEvaluator, std::size_t inMaxDepth) :
-            mInfos(),
-            mMaxDepth(inMaxDepth),
-            mEvaluator(&inEvaluator),
+            mInfos(inMaxDepth, TreeRowInfo(inEvaluator)),
+            mFinishedCount(0),
             mMutex()
         {
-            mInfos.push_back(TreeRowInfo(*mEvaluator));
         }
 
+        // Returns the number of finished rows.
         inline std::size_t depth() const
         {
             Futile::ScopedLock lock(mMutex);
-            if (mInfos.back().finished())
-            {
-                return mInfos.size();
-            }
-            else
-            {
-                Assert(mInfos.size() >= 1);
-                return mInfos.size() - 1;
-            }
+            return mFinishedCount;
         }
 
         inline std::size_t maxDepth() const
         {
             Futile::ScopedLock lock(mMutex);
-            return mMaxDepth;
+            return mInfos.size();
         }
 
-        void registerNode(NodePtr inNode)
+        void registerNode(NodePtr inNode, std::size_t inRow)
         {
             Futile::ScopedLock lock(mMutex);
-            mInfos.back().registerNode(inNode);
+            Assert(inRow >= mFinishedCount && inRow < mInfos.size());
+            mInfos[inRow].registerNode(inNode);
         }
 
+        // Returns the best node of the deepest finished row.
         inline NodePtr bestNode() const
         {
             Futile::ScopedLock lock(mMutex);
-            if (mInfos.back().finished())
-            {
-                return mInfos.back().bestNode();
-            }
-            else
-            {
-                return mInfos[mInfos.size() - 2].bestNode();
-            }
+            return mFinishedCount == 0 ? NodePtr() : mInfos[mFinishedCount - 1].bestNode();
         }
 
         inline bool finished() const
         {
             Futile::ScopedLock lock(mMutex);
-            return static_cast<int>(mInfos.size()) == mMaxDepth && mInfos.back().finished();
+            return mFinishedCount == mInfos.size();
         }
 
+        // Finishes the first unfinished row.
         inline void setFinished()
         {
             Futile::ScopedLock lock(mMutex);
-            mInfos.back().setFinished();
-            mInfos.push_back(TreeRowInfo(*mEvaluator));
+            Assert(mFinishedCount < mInfos.size());
+            mInfos[mFinishedCount].setFinished();
+            mFinishedCount++;
         }
 
     private:
         std::vector<TreeRowInfo> mInfos;
-        int mMaxDepth;
-        const Evaluator* mEvaluator;
+        std::size_t mFinishedCount;
         mutable Futile::Mutex mMutex;
     };
 
+    // The nodes that are generated by this search are placed in the arena.
+    // They are released with the calculator. Only the result and its
+    // subtree are copied out.
+    Futile::ArenaPtr mArena;
     NodePtr mNode;
     NodePtr mResult;
+    NodePtr mResultSubtree;
     mutable Futile::Mutex mNodeMutex;
 
 
@@ -192,6 +227,8 @@ protected:
     mutable Futile::Mutex mQuitFlagMutex;
 
     TreeRowInfos mTreeRowInfos;
+    TranspositionTable mTranspositionTable;
+    mutable std::atomic<std::size_t> mNodeCount;
 
     BlockTypes mBlockTypes;
     std::vector<int> mWidths;
@@ -203,6 +240,10 @@ protected:
 
     Futile::Worker mMainWorker;
     Futile::WorkerPool& mWorkerPool;
+
+    // Only used after start(int). Set before the search is started.
+    bool mHasTimeLimit;
+    boost::system_time mDeadline;
 };
 
 
@@ -2,8 +2,9 @@
 #define TETRIS_NODEPTR_H_INCLUDED
 
 
+#include "Futile/Arena.h"
 #include <boost/shared_ptr.hpp>
-#include <set>
+#include <vector>
 
 
 namespace Tetris {
@@ -11,11 +12,51 @@ namespace Tetris {
 
 class GameState;
 class GameStateNode;
-class GameStateComparator;
 
 
 typedef boost::shared_ptr<GameStateNode> NodePtr;
-typedef std::multiset<NodePtr, GameStateComparator> ChildNodes;
+
+
+/**
+ * ChildNodes holds the children of a search tree node ordered by descending
+ * quality. Nodes of equal quality keep the order in which they were inserted.
+ *
+ * The nodes are stored contiguously. Nodes that are inserted in order, like
+ * the output of GenerateOffspring, are simply appended. The children of a
+ * node in an arena are stored in the same arena.
+ */
+class ChildNodes
+{
+public:
+    typedef std::vector<NodePtr, Futile::ArenaAllocator<NodePtr> > Nodes;
+    typedef Nodes::iterator iterator;
+    typedef Nodes::const_iterator const_iterator;
+    typedef Nodes::size_type size_type;
+
+    explicit ChildNodes(Futile::Arena* inArena = 0) : mNodes(Futile::ArenaAllocator<NodePtr>(inArena)) { }
+
+    iterator begin() { return mNodes.begin(); }
+
+    iterator end() { return mNodes.end(); }
+
+    const_iterator begin() const { return mNodes.begin(); }
+
+    const_iterator end() const { return mNodes.end(); }
+
+    bool empty() const { return mNodes.empty(); }
+
+    size_type size() const { return mNodes.size(); }
+
+    void clear() { mNodes.clear(); }
+
+    void reserve(size_type inCount) { mNodes.reserve(inCount); }
+
+    // Inserts the node after the nodes of higher or equal quality.
+    void insert(const NodePtr& inNode);
+
+private:
+    Nodes mNodes;
+};
 
 
 
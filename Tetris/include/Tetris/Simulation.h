@@ -0,0 +1,87 @@
+#ifndef TETRIS_SIMULATION_H_INCLUDED
+#define TETRIS_SIMULATION_H_INCLUDED
+
+
+#include "Tetris/GameStateStats.h"
+#include "Tetris/NodeCalculator.h"
+#include "Futile/Threading.h"
+#include "Futile/WorkerPool.h"
+#include <boost/scoped_ptr.hpp>
+#include <cstddef>
+
+
+namespace Tetris {
+
+
+class Evaluator;
+class GameImpl;
+
+
+/**
+ * Simulation
+ *
+ * Plays a computer game without timers or a main thread. Each block is
+ * searched for and committed right away, as fast as the CPU allows.
+ *
+ * Gravity and garbage are applied in virtual time. The computer drops a
+ * block as soon as it appears, so every block takes one gravity interval
+ * of the current level.
+ */
+class Simulation
+{
+public:
+    // Simulations with the same seed get the same blocks.
+    Simulation(std::size_t inRowCount,
+               std::size_t inColumnCount,
+               unsigned inSeed,
+               const Evaluator& inEvaluator,
+               Futile::WorkerPool& inWorkerPool);
+
+    ~Simulation();
+
+    int searchDepth() const;
+
+    void setSearchDepth(int inSearchDepth);
+
+    int searchWidth() const;
+
+    void setSearchWidth(int inSearchWidth);
+
+    NodeCalculator::SearchType searchType() const;
+
+    void setSearchType(NodeCalculator::SearchType inSearchType);
+
+    // The game ends after this many blocks. Zero means no limit.
+    void setMaxBlockCount(std::size_t inMaxBlockCount);
+
+    // Adds garbage every inInterval milliseconds of virtual time, as if an
+    // opponent cleared inLineCount lines. An interval of zero disables it.
+    void setGarbage(int inInterval, int inLineCount);
+
+    // Plays until the game is over or the maximum block count is reached.
+    GameStateStats run();
+
+    // Returns the number of blocks that were committed.
+    std::size_t blockCount() const;
+
+    // Returns the number of nodes that were generated by the searches.
+    std::size_t nodeCount() const;
+
+    // Returns the virtual time in milliseconds.
+    int virtualTime() const;
+
+    const Futile::ThreadSafe<GameImpl>& gameImpl() const;
+
+private:
+    Simulation(const Simulation&);
+    Simulation& operator=(const Simulation&);
+
+    struct Impl;
+    boost::scoped_ptr<Impl> mImpl;
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_SIMULATION_H_INCLUDED
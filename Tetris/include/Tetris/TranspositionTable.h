@@ -0,0 +1,52 @@
+#ifndef TETRIS_TRANSPOSITIONTABLE_H_INCLUDED
+#define TETRIS_TRANSPOSITIONTABLE_H_INCLUDED
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace Tetris {
+
+
+/**
+ * TranspositionTable remembers which node represents a position during a search.
+ *
+ * The table has a fixed number of slots. Colliding keys overwrite each other,
+ * which only causes some duplicates to go unnoticed. Probes and stores don't
+ * lock: each slot stores its key xor'ed with the owner, so that a slot that
+ * was torn by concurrent writers fails to match and is treated as empty.
+ */
+class TranspositionTable
+{
+public:
+    // The slot count is rounded up to a power of two.
+    explicit TranspositionTable(std::size_t inSlotCount);
+
+    // Returns true if inOwner represents the key. If the key is unknown
+    // then inOwner becomes its representative. Thread-safe.
+    bool claim(std::uint64_t inKey, const void* inOwner);
+
+    std::size_t slotCount() const { return mSlots.size(); }
+
+private:
+    TranspositionTable(const TranspositionTable&);
+    TranspositionTable& operator=(const TranspositionTable&);
+
+    struct Slot
+    {
+        std::atomic<std::uint64_t> mCheck;
+        std::atomic<std::uint64_t> mOwner;
+    };
+
+    std::vector<Slot> mSlots;
+    std::uint64_t mMask;
+};
+
+
+} // namespace Tetris
+
+
+#endif // TETRIS_TRANSPOSITIONTABLE_H_INCLUDED
@@ -6,8 +6,12 @@
 #include "Tetris/GameState.h"
 #include "Tetris/Block.h"
 #include "Tetris/Grid.h"
+#include "Tetris/MoveGenerator.h"
 #include "Tetris/Utilities.h"
 #include "Futile/Assert.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 
 namespace Tetris {
@@ -37,22 +41,10 @@ void CarveBestPath(NodePtr startNode, NodePtr dst)
 }
 
 
-bool IsGameOver(const GameState& inGameState, BlockType inBlockType, int inRotation)
+bool IsGameOver(const GameState& inGameState, BlockType inBlockType)
 {
-    const Grid& blockGrid = GetGrid(GetBlockIdentifier(inBlockType, inRotation));
-    const Grid& gameGrid = inGameState.grid();
-    std::size_t initialColumn = DivideByTwo(inGameState.grid().columnCount() - blockGrid.columnCount());
-    for (std::size_t row = 0; row < blockGrid.rowCount(); ++row)
-    {
-        for (std::size_t col = 0; col < blockGrid.columnCount(); ++col)
-        {
-            if (blockGrid.get(row, col) != BlockType_Nil && gameGrid.get(row, initialColumn + col) != BlockType_Nil)
-            {
-                return true;
-            }
-        }
-    }
-    return false;
+    Block block = GetSpawnBlock(inBlockType, inGameState.columnCount());
+    return !inGameState.checkPositionValid(block, block.row(), block.column());
 }
 
 
@@ -85,50 +77,110 @@ void GenerateOffspring(NodePtr ioGameStateNode,
 }
 
 
+// Orders the children by descending score, and ties by the order in which they were generated.
+struct RankingComparator
+{
+    RankingComparator(const std::vector<int>& inScores) :
+        mScores(inScores)
+    {
+    }
+
+    bool operator()(std::size_t lhs, std::size_t rhs) const
+    {
+        return mScores[lhs] != mScores[rhs] ? mScores[lhs] > mScores[rhs] : lhs < rhs;
+    }
+
+    const std::vector<int>& mScores;
+};
+
+
 void GenerateOffspring(NodePtr inNode,
                        BlockType inBlockType,
                        const Evaluator& inEvaluator,
-                       ChildNodes& outChildNodes)
+                       ChildNodes& outChildNodes,
+                       Futile::Arena* inArena)
+{
+    GenerateOffspring(inNode, inBlockType, inEvaluator, std::size_t(-1), outChildNodes, inArena);
+}
+
+
+void GenerateOffspring(NodePtr inNode,
+                       BlockType inBlockType,
+                       const Evaluator& inEvaluator,
+                       std::size_t inMaxCount,
+                       ChildNodes& outChildNodes,
+                       Futile::Arena* inArena)
 {
     Assert(outChildNodes.empty());
+    Assert(inMaxCount >= 1);
+
+    // Children only store their delta, so the board is built when the node is expanded.
+    inNode->gameState().materialize();
     const GameState& gameState = inNode->gameState();
-    const Grid& gameGrid = gameState.grid();
 
     // Is this a "game over" situation?
     // If yes then append the final "broken" game state as only child.
-    if (IsGameOver(gameState, inBlockType, 0))
+    if (IsGameOver(gameState, inBlockType))
     {
-        std::size_t initialColumn = DivideByTwo(gameGrid.columnCount() - GetGrid(GetBlockIdentifier(inBlockType, 0)).columnCount());
-        std::unique_ptr<GameState> nextGameState = gameState.commit(Block(inBlockType, Rotation(0), Row(0), Column(initialColumn)), GameOver(true));
-        NodePtr childState(new GameStateNode(inNode, nextGameState.release(), inEvaluator));
+        Block block = GetSpawnBlock(inBlockType, gameState.columnCount());
+        NodePtr childState;
+        if (inArena)
+        {
+            GameState* nextGameState = gameState.commit(block, GameOver(true), *inArena);
+            childState = GameStateNode::Create(*inArena, inNode, nextGameState, inEvaluator.evaluate(*nextGameState), inEvaluator);
+        }
+        else
+        {
+            childState.reset(new GameStateNode(inNode, gameState.commit(block, GameOver(true)).release(), inEvaluator));
+        }
         Assert(childState->depth() == (inNode->depth() + 1));
         outChildNodes.insert(childState);
         return;
     }
 
-    // Generate game state for each column/rotation combination.
-    for (std::size_t col = 0; col != gameGrid.columnCount(); ++col)
+    // Generate a game state for each position that the block can reach, including tucks.
+    // The gamestates are owned by the child nodes that are created below.
+    std::vector<Block> placements;
+    placements.reserve(2 * GetBlockPositionCount(inBlockType, gameState.columnCount()));
+    GetReachablePlacements(gameState, inBlockType, placements);
+
+    std::vector<GameState*> nextGameStates;
+    nextGameStates.reserve(placements.size());
+    for (std::size_t idx = 0; idx != placements.size(); ++idx)
     {
-        Block block(inBlockType, Rotation(0), Row(0), Column(col));
-        for (std::size_t rt = 0; rt != block.numRotations(); ++rt)
-        {
-            block.setRotation(rt);
-            std::size_t row = 0;
-            while (gameState.checkPositionValid(block, row, col))
-            {
-                row++;
-            }
-            if (row > 0)
-            {
-                block.setRow(row - 1);
-                std::unique_ptr<GameState> nextGameState(gameState.commit(block, GameOver(false)));
-                NodePtr childState(new GameStateNode(inNode,
-                                                     nextGameState.release(),
-                                                     inEvaluator));
-                Assert(childState->depth() == inNode->depth() + 1);
-                outChildNodes.insert(childState);
-            }
-        }
+        nextGameStates.push_back(inArena ? gameState.commitDelta(placements[idx], *inArena)
+                                         : gameState.commitDelta(placements[idx]).release());
+    }
+
+    // Score all children in one go.
+    std::vector<const GameState*> children(nextGameStates.begin(), nextGameStates.end());
+    std::vector<int> scores;
+    inEvaluator.evaluateBatch(children, scores);
+
+    // Only the best children become nodes. The scores are sorted instead of
+    // the nodes, so that the comparisons don't need to visit the gamestates.
+    std::vector<std::size_t> ranking(nextGameStates.size());
+    for (std::size_t idx = 0; idx != ranking.size(); ++idx)
+    {
+        ranking[idx] = idx;
+    }
+    std::size_t count = std::min(inMaxCount, ranking.size());
+    std::partial_sort(ranking.begin(), ranking.begin() + count, ranking.end(), RankingComparator(scores));
+
+    outChildNodes.reserve(count);
+    for (std::size_t rank = 0; rank != count; ++rank)
+    {
+        std::size_t idx = ranking[rank];
+        NodePtr childState(inArena ? GameStateNode::Create(*inArena, inNode, nextGameStates[idx], scores[idx], inEvaluator)
+                                   : NodePtr(new GameStateNode(inNode, nextGameStates[idx], scores[idx], inEvaluator)));
+        Assert(childState->depth() == inNode->depth() + 1);
+        outChildNodes.insert(childState);
+    }
+
+    // The discarded gamestates in the arena are released with it.
+    for (std::size_t rank = count; rank != ranking.size() && !inArena; ++rank)
+    {
+        delete nextGameStates[ranking[rank]];
     }
 }
 
@@ -0,0 +1,128 @@
+#include "Tetris/Config.h"
+#include "Tetris/BeamSearchNodeCalculator.h"
+#include "Tetris/AISupport.h"
+#include "Tetris/GameStateComparator.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameStateNode.h"
+#include "Tetris/GameState.h"
+#include "Tetris/BlockTypes.h"
+#include "Futile/WorkerPool.h"
+#include "Futile/Assert.h"
+#include "Futile/Threading.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+
+namespace Tetris {
+
+
+using Futile::ScopedLock;
+using Futile::Worker;
+using Futile::WorkerPool;
+
+
+BeamSearchNodeCalculator::BeamSearchNodeCalculator(NodePtr inNode,
+                                                   const BlockTypes& inBlockTypes,
+                                                   const std::vector<int>& inWidths,
+                                                   const Evaluator& inEvaluator,
+                                                   WorkerPool& inWorkerPool) :
+    NodeCalculatorImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool)
+{
+}
+
+
+BeamSearchNodeCalculator::~BeamSearchNodeCalculator()
+{
+    setQuitFlag();
+    mMainWorker.interruptAndClearQueue();
+    mWorkerPool.interruptAndClearQueue();
+}
+
+
+void BeamSearchNodeCalculator::generateCandidates(NodePtr inNode, BlockType inBlockType, ChildNodes* outCandidates)
+{
+    GenerateOffspring(inNode, inBlockType, mEvaluator, *outCandidates, mArena.get());
+    addNodeCount(outCandidates->size());
+}
+
+
+void BeamSearchNodeCalculator::populate()
+{
+    // Each node of the beam writes its children to its own set, so the workers don't share any data.
+    // The sets must outlive the tasks, including the ones that are still running after an interrupt.
+    std::vector<ChildNodes> candidates;
+    try
+    {
+        {
+            // The beam is ranked over all children, so partial results of a previous search can't be used.
+            ScopedLock lock(mNodeMutex);
+            mNode->clearChildren();
+        }
+
+        std::vector<NodePtr> beam(1, mNode);
+        for (std::size_t row = 0; row != mBlockTypes.size(); ++row)
+        {
+            candidates.clear();
+            candidates.resize(beam.size());
+            for (std::size_t idx = 0; idx != beam.size(); ++idx)
+            {
+                if (!beam[idx]->gameState().isGameOver())
+                {
+                    Worker::Task task = boost::bind(&BeamSearchNodeCalculator::generateCandidates,
+                                                    this,
+                                                    beam[idx],
+                                                    mBlockTypes[row],
+                                                    &candidates[idx]);
+                    mWorkerPool.schedule(task);
+                }
+            }
+            waitForWorkers();
+            boost::this_thread::interruption_point();
+
+            // Rank the children of all nodes together. The stable sort keeps ties in
+            // the order of the beam, so that the search remains deterministic.
+            std::vector<NodePtr> ranking;
+            for (std::size_t idx = 0; idx != candidates.size(); ++idx)
+            {
+                ranking.insert(ranking.end(), candidates[idx].begin(), candidates[idx].end());
+            }
+            if (ranking.empty())
+            {
+                // All nodes are game over.
+                break;
+            }
+            std::stable_sort(ranking.begin(), ranking.end(), GameStateComparator());
+
+            // Different parents often lead to the same position. Only its best node is kept.
+            ScopedLock lock(mNodeMutex);
+            beam.clear();
+            std::size_t width = mWidths[row];
+            for (std::size_t idx = 0; idx != ranking.size() && beam.size() < width; ++idx)
+            {
+                NodePtr node = ranking[idx];
+                if (!isTransposition(*node))
+                {
+                    node->parent()->addChild(node);
+                    beam.push_back(node);
+                }
+            }
+
+            mTreeRowInfos.registerNode(beam.front(), row);
+            mTreeRowInfos.setFinished();
+        }
+    }
+    catch (const boost::thread_interrupted &)
+    {
+        // Task was interrupted. Ok.
+    }
+    //
+    // catch: allow other exceptions pass to the parent handler
+    //
+
+    mWorkerPool.interruptAndClearQueue();
+    mWorkerPool.wait();
+}
+
+
+} // namespace Tetris
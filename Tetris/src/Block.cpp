@@ -1,253 +1,78 @@
 #include "Tetris/Config.h"
 #include "Tetris/Block.h"
 #include "Tetris/BlockType.h"
-#include "Futile/AutoPtrSupport.h"
 #include "Futile/Assert.h"
 #include <stdexcept>
-
-
-using Futile::Create;
-using Futile::CreatePoly;
+#include <type_traits>
+#include <vector>
 
 
 namespace Tetris {
 
 
-class BlockImpl
-{
-public:
-    BlockImpl(BlockType inType, Rotation inRotation, Row inRow, Column inColumn);
-
-    std::unique_ptr<BlockImpl> clone() const;
-
-    BlockType type() const;
-
-    std::size_t rotation() const;
-
-    std::size_t numRotations() const;
-
-    const Grid& grid() const;
-
-    std::size_t row() const;
-
-    std::size_t column() const;
-
-    std::size_t rowCount() const;
-
-    std::size_t columnCount() const;
-
-    void rotate();
-
-    void setRow(std::size_t inRow);
-
-    void setColumn(std::size_t inColumn);
-
-    void setRotation(std::size_t inRotation);
-
-private:
-    BlockType mType;
-    std::size_t mRotation;
-    std::size_t mRow;
-    std::size_t mColumn;
-    const Grid* mGrid;
-};
-
-
-BlockImpl::BlockImpl(BlockType inType, Rotation inRotation, Row inRow, Column inColumn) :
-    mType(inType),
-    mRotation(inRotation.get()),
-    mRow(inRow.get()),
-    mColumn(inColumn.get()),
-    mGrid(&GetGrid(GetBlockIdentifier(inType, inRotation.get())))
-{
-    Assert(mRotation <= 3);
-}
-
-
-std::unique_ptr<BlockImpl> BlockImpl::clone() const
-{
-    return Create<BlockImpl>(*this);
-}
-
-
-BlockType BlockImpl::type() const
-{
-    return mType;
-}
-
-
-std::size_t BlockImpl::rotation() const
-{
-    return mRotation;
-}
-
-
-std::size_t BlockImpl::numRotations() const
-{
-    return GetBlockRotationCount(mType);
-}
-
-
-const Grid& BlockImpl::grid() const
-{
-    return *mGrid;
-}
-
-
-std::size_t BlockImpl::row() const
-{
-    return mRow;
-}
-
-
-std::size_t BlockImpl::column() const
-{
-    return mColumn;
-}
-
-
-std::size_t BlockImpl::rowCount() const
-{
-    return mGrid->rowCount();
-}
-
-
-std::size_t BlockImpl::columnCount() const
-{
-    return mGrid->columnCount();
-}
-
-
-void BlockImpl::setRow(std::size_t inRow)
-{
-    mRow = inRow;
-}
-
-
-void BlockImpl::setColumn(std::size_t inColumn)
-{
-    mColumn = inColumn;
-}
-
-
-void BlockImpl::setRotation(std::size_t inRotation)
-{
-    mRotation = inRotation % GetBlockRotationCount(mType);
-    mGrid = &GetGrid(GetBlockIdentifier(mType, mRotation));
-}
-
-
-void BlockImpl::rotate()
-{
-    setRotation((mRotation + 1) % GetBlockRotationCount(mType));
-}
+static_assert(std::is_trivially_copyable<Block>::value && sizeof(Block) <= 8,
+              "Blocks are copied by value in the search.");
 
 
 Block::Block(BlockType inType, Rotation inRotation, Row inRow, Column inColumn) :
-    mImpl(Create<BlockImpl>(inType, inRotation, inRow, inColumn).release())
-{
-}
-
-
-Block::Block(const Block& rhs) :
-    mImpl(rhs.mImpl->clone().release())
-{
-}
-
-
-Block& Block::operator=(const Block& rhs)
-{
-    if (&rhs != this)
-    {
-        delete mImpl;
-        mImpl = Create<BlockImpl>(*rhs.mImpl).release();
-    }
-    return *this;
-}
-
-
-Block::~Block()
-{
-    delete mImpl;
-    mImpl = 0;
-}
-
-
-int Block::identification() const
-{
-    return GetBlockIdentifier(type(), rotation());
-}
-
-
-BlockType Block::type() const
-{
-    return mImpl->type();
-}
-
-
-std::size_t Block::rotation() const
-{
-    return mImpl->rotation();
-}
-
-
-std::size_t Block::numRotations() const
+    mRow(static_cast<std::uint16_t>(inRow.get())),
+    mType(inType),
+    mRotation(static_cast<std::uint8_t>(inRotation.get())),
+    mColumn(static_cast<std::uint8_t>(inColumn.get()))
 {
-    return mImpl->numRotations();
+    Assert(inType >= BlockType_Begin && inType < BlockType_End);
+    Assert(inRotation.get() <= 3);
+    Assert(mRow == inRow.get() && mColumn == inColumn.get());
 }
 
 
 const Grid& Block::grid() const
 {
-    return mImpl->grid();
-}
-
-
-std::size_t Block::row() const
-{
-    return mImpl->row();
+    return GetGrid(identification());
 }
 
 
-std::size_t Block::column() const
+std::size_t Block::rowCount() const
 {
-    return mImpl->column();
+    return grid().rowCount();
 }
 
 
-std::size_t Block::rowCount() const
+std::size_t Block::columnCount() const
 {
-    return mImpl->rowCount();
+    return grid().columnCount();
 }
 
 
-std::size_t Block::columnCount() const
+std::size_t Block::numRotations() const
 {
-    return mImpl->columnCount();
+    return GetBlockRotationCount(mType);
 }
 
 
 void Block::setRow(std::size_t inRow)
 {
-    mImpl->setRow(inRow);
+    mRow = static_cast<std::uint16_t>(inRow);
+    Assert(mRow == inRow);
 }
 
 
 void Block::setColumn(std::size_t inColumn)
 {
-    mImpl->setColumn(inColumn);
+    mColumn = static_cast<std::uint8_t>(inColumn);
+    Assert(mColumn == inColumn);
 }
 
 
 void Block::setRotation(std::size_t inRotation)
 {
-    mImpl->setRotation(inRotation);
+    mRotation = static_cast<std::uint8_t>(inRotation % GetBlockRotationCount(mType));
 }
 
 
 void Block::rotate()
 {
-    mImpl->rotate();
+    setRotation(mRotation + 1);
 }
 
 
@@ -289,258 +114,98 @@ std::size_t GetBlockPositionCount(BlockType inType, std::size_t inNumColumns)
 }
 
 
-Grid GetIGrid(int rotation);
-Grid GetJGrid(int rotation);
-Grid GetLGrid(int rotation);
-Grid GetOGrid(int rotation);
-Grid GetSGrid(int rotation);
-Grid GetTGrid(int rotation);
-Grid GetZGrid(int rotation);
+// The shape of each block identifier. Bit c of a row mask is column c.
+// GetGrid and GetRowMasks are both derived from this table.
+struct Shape
+{
+    std::size_t mRowCount;
+    std::size_t mColumnCount;
+    RowMask mRows[4];
+};
 
 
-const Grid& GetGrid(int inId)
+static constexpr Shape cShapes[28] =
 {
-    if (inId < 0 || inId >= 28)
-    {
-        throw std::logic_error("Invalid block identifier.");
-    }
+    { 1, 4, { 0xF } },              // I
+    { 4, 1, { 0x1, 0x1, 0x1, 0x1 } },
+    { 1, 4, { 0xF } },
+    { 4, 1, { 0x1, 0x1, 0x1, 0x1 } },
 
-    static Grid fBlocks[] =
-    {
-        Grid(GetIGrid(0)),
-        Grid(GetIGrid(1)),
-        Grid(GetIGrid(2)),
-        Grid(GetIGrid(3)),
-
-        Grid(GetJGrid(0)),
-        Grid(GetJGrid(1)),
-        Grid(GetJGrid(2)),
-        Grid(GetJGrid(3)),
-
-        Grid(GetLGrid(0)),
-        Grid(GetLGrid(1)),
-        Grid(GetLGrid(2)),
-        Grid(GetLGrid(3)),
-
-        Grid(GetOGrid(0)),
-        Grid(GetOGrid(1)),
-        Grid(GetOGrid(2)),
-        Grid(GetOGrid(3)),
-
-        Grid(GetSGrid(0)),
-        Grid(GetSGrid(1)),
-        Grid(GetSGrid(2)),
-        Grid(GetSGrid(3)),
-
-        Grid(GetTGrid(0)),
-        Grid(GetTGrid(1)),
-        Grid(GetTGrid(2)),
-        Grid(GetTGrid(3)),
-
-        Grid(GetZGrid(0)),
-        Grid(GetZGrid(1)),
-        Grid(GetZGrid(2)),
-        Grid(GetZGrid(3))
-    };
-    return fBlocks[inId];
-}
+    { 2, 3, { 0x1, 0x7 } },         // J
+    { 3, 2, { 0x3, 0x1, 0x1 } },
+    { 2, 3, { 0x7, 0x4 } },
+    { 3, 2, { 0x2, 0x2, 0x3 } },
 
+    { 2, 3, { 0x4, 0x7 } },         // L
+    { 3, 2, { 0x1, 0x1, 0x3 } },
+    { 2, 3, { 0x7, 0x1 } },
+    { 3, 2, { 0x3, 0x2, 0x2 } },
 
-Grid GetIGrid(int rotation)
-{
-    if (rotation%2 == 0)
-    {
-        Grid grid(1, 4, BlockType_Nil);
-        grid.set(0, 0, BlockType_I);
-        grid.set(0, 1, BlockType_I);
-        grid.set(0, 2, BlockType_I);
-        grid.set(0, 3, BlockType_I);
-        return grid;
-    }
-    else
-    {
-        Grid grid(4, 1, BlockType_Nil);
-        grid.set(0, 0, BlockType_I);
-        grid.set(1, 0, BlockType_I);
-        grid.set(2, 0, BlockType_I);
-        grid.set(3, 0, BlockType_I);
-        return grid;
-    }
-}
+    { 2, 2, { 0x3, 0x3 } },         // O
+    { 2, 2, { 0x3, 0x3 } },
+    { 2, 2, { 0x3, 0x3 } },
+    { 2, 2, { 0x3, 0x3 } },
 
+    { 2, 3, { 0x6, 0x3 } },         // S
+    { 3, 2, { 0x1, 0x3, 0x2 } },
+    { 2, 3, { 0x6, 0x3 } },
+    { 3, 2, { 0x1, 0x3, 0x2 } },
 
-Grid GetJGrid(int rotation)
-{
-    if (rotation%4 == 0)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 0, BlockType_J);
-        grid.set(1, 0, BlockType_J);
-        grid.set(1, 1, BlockType_J);
-        grid.set(1, 2, BlockType_J);
-        return grid;
-    }
-    else if (rotation%4 == 1)
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 0, BlockType_J);
-        grid.set(0, 1, BlockType_J);
-        grid.set(1, 0, BlockType_J);
-        grid.set(2, 0, BlockType_J);
-        return grid;
-    }
-    else if (rotation%4 == 2)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 0, BlockType_J);
-        grid.set(0, 1, BlockType_J);
-        grid.set(0, 2, BlockType_J);
-        grid.set(1, 2, BlockType_J);
-        return grid;
-    }
-    else
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 1, BlockType_J);
-        grid.set(1, 1, BlockType_J);
-        grid.set(2, 0, BlockType_J);
-        grid.set(2, 1, BlockType_J);
-        return grid;
-    }
-}
+    { 2, 3, { 0x2, 0x7 } },         // T
+    { 3, 2, { 0x1, 0x3, 0x1 } },
+    { 2, 3, { 0x7, 0x2 } },
+    { 3, 2, { 0x2, 0x3, 0x2 } },
 
-Grid GetLGrid(int rotation)
-{
-    if (rotation%4 == 0)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 2, BlockType_L);
-        grid.set(1, 0, BlockType_L);
-        grid.set(1, 1, BlockType_L);
-        grid.set(1, 2, BlockType_L);
-        return grid;
-    }
-    else if (rotation%4 == 1)
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 0, BlockType_L);
-        grid.set(1, 0, BlockType_L);
-        grid.set(2, 0, BlockType_L);
-        grid.set(2, 1, BlockType_L);
-        return grid;
-    }
-    else if (rotation%4 == 2)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 0, BlockType_L);
-        grid.set(0, 1, BlockType_L);
-        grid.set(0, 2, BlockType_L);
-        grid.set(1, 0, BlockType_L);
-        return grid;
-    }
-    else
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 0, BlockType_L);
-        grid.set(0, 1, BlockType_L);
-        grid.set(1, 1, BlockType_L);
-        grid.set(2, 1, BlockType_L);
-        return grid;
-    }
-}
+    { 2, 3, { 0x3, 0x6 } },         // Z
+    { 3, 2, { 0x2, 0x3, 0x1 } },
+    { 2, 3, { 0x3, 0x6 } },
+    { 3, 2, { 0x2, 0x3, 0x1 } }
+};
 
-Grid GetOGrid(int) // rotation is not relevant
-{
-    Grid grid(2, 2, BlockType_Nil);
-    grid.set(0, 0, BlockType_O);
-    grid.set(0, 1, BlockType_O);
-    grid.set(1, 0, BlockType_O);
-    grid.set(1, 1, BlockType_O);
-    return grid;
-}
 
-Grid GetSGrid(int rotation)
+static std::vector<Grid> CreateGrids()
 {
-    if (rotation%2 == 0)
+    std::vector<Grid> result;
+    for (int id = 0; id != 28; ++id)
     {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 1, BlockType_S);
-        grid.set(0, 2, BlockType_S);
-        grid.set(1, 0, BlockType_S);
-        grid.set(1, 1, BlockType_S);
-        return grid;
-    }
-    else
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 0, BlockType_S);
-        grid.set(1, 0, BlockType_S);
-        grid.set(1, 1, BlockType_S);
-        grid.set(2, 1, BlockType_S);
-        return grid;
+        const Shape& shape = cShapes[id];
+        BlockType type = static_cast<BlockType>(BlockType_Begin + id / 4);
+        Grid grid(shape.mRowCount, shape.mColumnCount, BlockType_Nil);
+        for (std::size_t r = 0; r != shape.mRowCount; ++r)
+        {
+            for (std::size_t c = 0; c != shape.mColumnCount; ++c)
+            {
+                if ((shape.mRows[r] >> c) & 1)
+                {
+                    grid.set(r, c, type);
+                }
+            }
+        }
+        result.push_back(grid);
     }
+    return result;
 }
 
-Grid GetTGrid(int rotation)
+
+const Grid& GetGrid(int inId)
 {
-    if (rotation%4 == 0)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 1, BlockType_T);
-        grid.set(1, 0, BlockType_T);
-        grid.set(1, 1, BlockType_T);
-        grid.set(1, 2, BlockType_T);
-        return grid;
-    }
-    else if (rotation%4 == 1)
-    {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 0, BlockType_T);
-        grid.set(1, 0, BlockType_T);
-        grid.set(1, 1, BlockType_T);
-        grid.set(2, 0, BlockType_T);
-        return grid;
-    }
-    else if (rotation%4 == 2)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 0, BlockType_T);
-        grid.set(0, 1, BlockType_T);
-        grid.set(0, 2, BlockType_T);
-        grid.set(1, 1, BlockType_T);
-        return grid;
-    }
-    else
+    if (inId < 0 || inId >= 28)
     {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 1, BlockType_T);
-        grid.set(1, 0, BlockType_T);
-        grid.set(1, 1, BlockType_T);
-        grid.set(2, 1, BlockType_T);
-        return grid;
+        throw std::logic_error("Invalid block identifier.");
     }
+
+    static const std::vector<Grid> fGrids = CreateGrids();
+    return fGrids[inId];
 }
 
-Grid GetZGrid(int rotation)
+
+const RowMask* GetRowMasks(int inId)
 {
-    if (rotation%2 == 0)
-    {
-        Grid grid(2, 3, BlockType_Nil);
-        grid.set(0, 0, BlockType_Z);
-        grid.set(0, 1, BlockType_Z);
-        grid.set(1, 1, BlockType_Z);
-        grid.set(1, 2, BlockType_Z);
-        return grid;
-    }
-    else
+    if (inId < 0 || inId >= 28)
     {
-        Grid grid(3, 2, BlockType_Nil);
-        grid.set(0, 1, BlockType_Z);
-        grid.set(1, 0, BlockType_Z);
-        grid.set(1, 1, BlockType_Z);
-        grid.set(2, 0, BlockType_Z);
-        return grid;
+        throw std::logic_error("Invalid block identifier.");
     }
+    return cShapes[inId].mRows;
 }
 
 
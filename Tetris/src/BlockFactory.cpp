@@ -2,15 +2,13 @@
 #include "Tetris/BlockFactory.h"
 #include "Tetris/BlockType.h"
 #include "Tetris/BlockTypes.h"
+#include "Futile/Assert.h"
 #include "Poco/Timestamp.h"
 #include <boost/noncopyable.hpp>
 #include <algorithm>
-#include <ctime>
 
 
-using Futile::Mutex;
-using Futile::ScopedLock;
-using Futile::Locker;
+using Futile::RandomStream;
 
 
 namespace Tetris {
@@ -26,44 +24,73 @@ AbstractBlockFactory::~AbstractBlockFactory()
 }
 
 
+// Number of bags that are shuffled at once.
+static const std::size_t cBatchBagCount = 8;
+
+
 struct BlockFactory::Impl : boost::noncopyable
 {
-    typedef unsigned seed_t;
-
-    Impl(int inBagSize) :
-        mBagSize(inBagSize),
+    Impl(int inBagSize, RandomStream inRandom) :
+        mBag(),
+        mBatch(),
         mCurrentIndex(0),
-        mSeed(static_cast<seed_t>(Poco::Timestamp().epochMicroseconds()))
+        mSplitRandom(inRandom.split()),
+        mRandom(inRandom)
     {
+        std::size_t totalSize = inBagSize * cBlockTypeCount;
+        mBag.reserve(totalSize);
+        for (std::size_t idx = 0; idx != totalSize; ++idx)
+        {
+            mBag.push_back(static_cast<BlockType>(1 + (idx % cBlockTypeCount)));
+        }
+        std::sort(mBag.begin(), mBag.end());
+
+        mBatch.reserve(cBatchBagCount * totalSize);
+        for (std::size_t idx = 0; idx != cBatchBagCount; ++idx)
+        {
+            mBatch.insert(mBatch.end(), mBag.begin(), mBag.end());
+        }
+        shuffleBatch();
     }
 
-    ~Impl()
+    // Each bag of the batch is shuffled separately, so every
+    // round of mBag.size() blocks still contains a full bag.
+    void shuffleBatch()
     {
+        for (std::size_t begin = 0; begin != mBatch.size(); begin += mBag.size())
+        {
+            mRandom.shuffle(mBatch.begin() + begin, mBatch.begin() + begin + mBag.size());
+        }
+        mCurrentIndex = 0;
     }
 
-    BlockTypes::size_type mBagSize;
-    std::size_t mCurrentIndex;
+    // Sorted by block type.
     BlockTypes mBag;
-    seed_t mSeed;
+    BlockTypes mBatch;
+    std::size_t mCurrentIndex;
+    RandomStream mSplitRandom;
+    RandomStream mRandom;
 };
 
 
 BlockFactory::BlockFactory(int inBagSize) :
     AbstractBlockFactory(),
-    mThreadSafeImpl(new Impl(inBagSize))
+    mImpl(new Impl(inBagSize, RandomStream(Poco::Timestamp().epochMicroseconds())))
 {
-    Locker<Impl> rwImpl(mThreadSafeImpl);
-    Impl* mImpl(rwImpl.get());
-    srand(mImpl->mSeed);
+}
 
-    std::size_t totalSize = mImpl->mBagSize * cBlockTypeCount;
-    mImpl->mBag.reserve(totalSize);
-    for (std::size_t idx = 0; idx != totalSize; ++idx)
-    {
-        BlockType blockType = static_cast<BlockType>(1 + (idx % cBlockTypeCount));
-        mImpl->mBag.push_back(blockType);
-    }
-    std::random_shuffle(mImpl->mBag.begin(), mImpl->mBag.end());
+
+BlockFactory::BlockFactory(int inBagSize, unsigned inSeed) :
+    AbstractBlockFactory(),
+    mImpl(new Impl(inBagSize, RandomStream(inSeed)))
+{
+}
+
+
+BlockFactory::BlockFactory(int inBagSize, const RandomStream& inRandom) :
+    AbstractBlockFactory(),
+    mImpl(new Impl(inBagSize, inRandom))
+{
 }
 
 
@@ -74,15 +101,44 @@ BlockFactory::~BlockFactory()
 
 BlockType BlockFactory::getNext() const
 {
-    Locker<Impl> rwImpl(mThreadSafeImpl);
-    Impl* mImpl(rwImpl.get());
-    if (mImpl->mCurrentIndex >= mImpl->mBag.size())
+    if (mImpl->mCurrentIndex == mImpl->mBatch.size())
+    {
+        mImpl->shuffleBatch();
+    }
+    return mImpl->mBatch[mImpl->mCurrentIndex++];
+}
+
+
+void BlockFactory::getBag(BlockTypes& outBlocks) const
+{
+    outBlocks = mImpl->mBag;
+}
+
+
+RandomStream BlockFactory::split()
+{
+    return mImpl->mSplitRandom.split();
+}
+
+
+void BlockFactory::getRemainingBlocks(const BlockTypes& inDrawnBlocks,
+                                      std::size_t inDrawCount,
+                                      BlockTypes& outBlocks) const
+{
+    Assert(inDrawCount <= inDrawnBlocks.size());
+    getBag(outBlocks);
+
+    // The bag is reshuffled after each full round, so only the current round matters.
+    std::size_t roundBegin = inDrawCount - inDrawCount % outBlocks.size();
+    for (std::size_t idx = roundBegin; idx != inDrawCount; ++idx)
     {
-        // Reshuffle the bag.
-        std::random_shuffle(mImpl->mBag.begin(), mImpl->mBag.end());
-        mImpl->mCurrentIndex = 0;
+        BlockTypes::iterator it = std::lower_bound(outBlocks.begin(), outBlocks.end(), inDrawnBlocks[idx]);
+        Assert(it != outBlocks.end() && *it == inDrawnBlocks[idx]);
+        if (it != outBlocks.end() && *it == inDrawnBlocks[idx])
+        {
+            outBlocks.erase(it);
+        }
     }
-    return mImpl->mBag[mImpl->mCurrentIndex++];
 }
 
 
@@ -6,6 +6,7 @@
 #include "Tetris/GameStateComparator.h"
 #include "Tetris/GameState.h"
 #include "Tetris/Block.h"
+#include "Tetris/MoveGenerator.h"
 #include "Futile/Logging.h"
 #include "Futile/MakeString.h"
 #include "Futile/Threading.h"
@@ -13,6 +14,9 @@
 #include "Poco/AtomicCounter.h"
 #include "Poco/Stopwatch.h"
 #include "Poco/Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <boost/bind/bind.hpp>
 
@@ -34,8 +38,19 @@ struct BlockMover::Impl
         mNumMovesPerSecond(1),
         mMoveCount(0),
         mActualSpeed(0),
-        mMoveDownBehavior(MoveDownBehavior_Move)
+        mMoveDownBehavior(MoveDownBehavior_Move),
+        mInstantMode(false),
+        mInputs(),
+        mNextInput(0),
+        mBlockIndex(std::size_t(-1)),
+        mTarget(BlockType_I, Rotation(0), Row(0), Column(0)),
+        mExpected(BlockType_I, Rotation(0), Row(0), Column(0))
     {
+        Locker<GameImpl> wGame(mGame);
+        if (!dynamic_cast<ComputerGame*>(wGame.get()))
+        {
+            throw std::invalid_argument("BlockMover requires a ComputerGame.");
+        }
     }
 
     ~Impl()
@@ -65,6 +80,15 @@ struct BlockMover::Impl
 
     void move();
 
+    // Computes the inputs for inTarget unless the current ones still apply.
+    // Returns false if inTarget can't be reached.
+    bool updateInputs(const ComputerGame& inGame, const Block& inTarget);
+
+    // Returns false if the input could not be applied.
+    bool applyInput(ComputerGame& ioGame, Input inInput);
+
+    void commit(ComputerGame& ioGame);
+
     ThreadSafe<GameImpl> mGame;
     boost::scoped_ptr<Poco::Timer> mTimer;
     Poco::Stopwatch mStopwatch;
@@ -72,9 +96,26 @@ struct BlockMover::Impl
     Poco::AtomicCounter mMoveCount;
     int mActualSpeed;
     MoveDownBehavior mMoveDownBehavior;
+    std::atomic<bool> mInstantMode;
+
+    // The inputs that move the active block to mTarget. They are only
+    // used in the timer thread, while the game is locked.
+    Inputs mInputs;
+    std::size_t mNextInput;
+    std::size_t mBlockIndex;
+    Block mTarget;
+
+    // Where the inputs so far should have moved the active block.
+    Block mExpected;
 };
 
 
+bool HasSamePosition(const Block& lhs, const Block& rhs)
+{
+    return lhs.row() == rhs.row() && lhs.column() == rhs.column() && lhs.identification() == rhs.identification();
+}
+
+
 BlockMover::BlockMover(ThreadSafe<GameImpl> inGame) :
     mImpl(new Impl(inGame))
 {
@@ -139,6 +180,18 @@ BlockMover::MoveDownBehavior BlockMover::moveDownBehavior() const
 }
 
 
+void BlockMover::setInstantMode(bool inInstantMode)
+{
+    mImpl->mInstantMode = inInstantMode;
+}
+
+
+bool BlockMover::instantMode() const
+{
+    return mImpl->mInstantMode;
+}
+
+
 void BlockMover::Impl::onTimer(Poco::Timer &)
 {
     try
@@ -163,8 +216,8 @@ void BlockMover::Impl::onTimer(Poco::Timer &)
 void BlockMover::Impl::move()
 {
     Locker<GameImpl> wGame(mGame);
-    ComputerGame& game = dynamic_cast<ComputerGame&>(*wGame.get());
-    if (game.isPaused())
+    ComputerGame& game = static_cast<ComputerGame&>(*wGame.get());
+    if (game.isPaused() || game.isGameOver())
     {
         return;
     }
@@ -175,67 +228,138 @@ void BlockMover::Impl::move()
         return;
     }
 
-    GameStateNode& firstChild = **children.begin();
+    const Block& targetBlock = (*children.begin())->gameState().originalBlock();
+    Assert(game.activeBlock().type() == targetBlock.type());
 
-    const Block& block = game.activeBlock();
-    const Block& targetBlock = firstChild.gameState().originalBlock();
-
-    Assert(block.type() == targetBlock.type());
+    if (!updateInputs(game, targetBlock))
+    {
+        // The board has changed and the target can't be reached anymore.
+        game.dropAndCommit();
+        return;
+    }
 
-    // Try rotation first, if it fails then skip rotation and try horizontal move
-    if (block.rotation() != targetBlock.rotation())
+    if (mInstantMode)
     {
-        if (game.rotate())
+        while (mNextInput != mInputs.size())
         {
-            return;
+            if (applyInput(game, mInputs[mNextInput]))
+            {
+                ++mNextInput;
+                continue;
+            }
+
+            // Find a new path from where the block is now. If the first input
+            // of a new path fails then the game doesn't agree with FindPath,
+            // and trying again would fail in the same way.
+            if (mNextInput == 0 || !updateInputs(game, targetBlock))
+            {
+                break;
+            }
         }
-        // else: try left or right move below
+        game.dropAndCommit();
+        return;
     }
 
-    if (block.column() < targetBlock.column())
+    if (mNextInput == mInputs.size())
     {
-        if (!game.move(MoveDirection_Right))
-        {
-            // Damn we can't move this block anymore.
-            // Give up on this block.
-            game.dropAndCommit();
-        }
+        commit(game);
         return;
     }
 
-    if (block.column() > targetBlock.column())
+    // Only the moves after the last horizontal move or rotation can be dropped.
+    if (mMoveDownBehavior == BlockMover::MoveDownBehavior_Drop &&
+        std::find_if(mInputs.begin() + mNextInput, mInputs.end(),
+                     boost::bind(std::not_equal_to<int>(), boost::placeholders::_1, Input_Down)) == mInputs.end())
     {
-        if (!game.move(MoveDirection_Left))
-        {
-            // Damn we can't move this block anymore.
-            // Give up on this block.
-            game.dropAndCommit();
-        }
+        game.dropAndCommit();
         return;
     }
 
-    // Horizontal position is OK.
-    // Retry rotation again. If it fails here then drop the block.
-    if (block.rotation() != targetBlock.rotation())
+    if (applyInput(game, mInputs[mNextInput]))
     {
-        if (!game.rotate())
+        ++mNextInput;
+    }
+}
+
+
+bool BlockMover::Impl::updateInputs(const ComputerGame& inGame, const Block& inTarget)
+{
+    const Block& block = inGame.activeBlock();
+    if (mBlockIndex == inGame.currentBlockIndex() &&
+        HasSamePosition(mTarget, inTarget) &&
+        HasSamePosition(mExpected, block))
+    {
+        return true;
+    }
+
+    // A new block, a new target, or the block was moved by something else, like gravity.
+    mBlockIndex = inGame.currentBlockIndex();
+    mTarget = inTarget;
+    mExpected = block;
+    mNextInput = 0;
+    if (!FindPath(inGame.gameState(), block, inTarget, mInputs))
+    {
+        mBlockIndex = std::size_t(-1);
+        return false;
+    }
+    return true;
+}
+
+
+bool BlockMover::Impl::applyInput(ComputerGame& ioGame, Input inInput)
+{
+    bool result = false;
+    switch (inInput)
+    {
+        case Input_Left:
         {
-            game.dropAndCommit();
+            result = ioGame.move(MoveDirection_Left);
+            break;
         }
-        return;
+        case Input_Right:
+        {
+            result = ioGame.move(MoveDirection_Right);
+            break;
+        }
+        case Input_Down:
+        {
+            result = ioGame.move(MoveDirection_Down);
+            break;
+        }
+        case Input_Rotate:
+        {
+            result = ioGame.rotate();
+            break;
+        }
+        default:
+        {
+            throw std::logic_error(MakeString() << "Input: invalid enum value: " << inInput);
+        }
+    }
+
+    if (result)
+    {
+        mExpected = ioGame.activeBlock();
+    }
+    else
+    {
+        // The inputs are recomputed on the next tick.
+        mBlockIndex = std::size_t(-1);
     }
+    return result;
+}
+
 
-    //
-    // If we get arrive here then horizontal position and rotation are OK.
-    // Start lowering the block.
-    //
+void BlockMover::Impl::commit(ComputerGame& ioGame)
+{
+    // The block is at its target, which is a resting position.
     if (mMoveDownBehavior == BlockMover::MoveDownBehavior_Move)
     {
-        game.move(MoveDirection_Down);
+        ioGame.move(MoveDirection_Down);
     }
     else if (mMoveDownBehavior == BlockMover::MoveDownBehavior_Drop)
     {
-        game.dropAndCommit();
+        ioGame.dropAndCommit();
     }
     else
     {
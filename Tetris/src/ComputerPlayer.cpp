@@ -2,6 +2,7 @@
 #include "Tetris/Config.h"
 #include "Tetris/ComputerPlayer.h"
 #include "Tetris/NodeCalculator.h"
+#include "Tetris/NodeCalculatorFactory.h"
 #include "Tetris/AISupport.h"
 #include "Tetris/Gravity.h"
 #include "Tetris/GameImpl.h"
@@ -20,6 +21,7 @@
 #include "Poco/Timer.h"
 #include <boost/bind/bind.hpp>
 #include <boost/noncopyable.hpp>
+#include <algorithm>
 #include <set>
 
 
@@ -34,6 +36,9 @@ using Futile::WorkerPool;
 namespace Tetris {
 
 
+extern const int cMaxLevel;
+
+
 struct ComputerPlayer::Impl : boost::noncopyable
 {
 public:
@@ -47,6 +52,7 @@ public:
         mBlockMover(),
         mSearchDepth(6),
         mSearchWidth(4),
+        mSearchType(NodeCalculator::SearchType_Tree),
         mWorkerCount(2), //Poco::Environment::processorCount()),
         mGameDepth(0),
         mStop(false),
@@ -82,10 +88,13 @@ public:
 
     WorkerPool mWorkerPool;
     boost::scoped_ptr<NodeCalculator> mNodeCalculator;
+
+    NodeCalculatorFactory mNodeCalculatorFactory;
     const Evaluator* mEvaluator;
     boost::scoped_ptr<BlockMover> mBlockMover;
     int mSearchDepth;
     int mSearchWidth;
+    NodeCalculator::SearchType mSearchType;
     int mWorkerCount;
     int mGameDepth;
     bool mStop;
@@ -173,6 +182,20 @@ void ComputerPlayer::setSearchWidth(int inSearchWidth)
 }
 
 
+NodeCalculator::SearchType ComputerPlayer::searchType() const
+{
+    ScopedLock lock(mImpl->mMutex);
+    return mImpl->mSearchType;
+}
+
+
+void ComputerPlayer::setSearchType(NodeCalculator::SearchType inSearchType)
+{
+    ScopedLock lock(mImpl->mMutex);
+    mImpl->mSearchType = inSearchType;
+}
+
+
 int ComputerPlayer::depth() const
 {
     ScopedLock lock(mImpl->mMutex);
@@ -198,6 +221,20 @@ void ComputerPlayer::setMoveSpeed(int inMoveSpeed)
 }
 
 
+bool ComputerPlayer::instantMode() const
+{
+    ScopedLock lock(mImpl->mMutex);
+    return mImpl->mBlockMover->instantMode();
+}
+
+
+void ComputerPlayer::setInstantMode(bool inInstantMode)
+{
+    ScopedLock lock(mImpl->mMutex);
+    mImpl->mBlockMover->setInstantMode(inInstantMode);
+}
+
+
 int ComputerPlayer::workerCount() const
 {
     ScopedLock lock(mImpl->mMutex);
@@ -333,15 +370,20 @@ void ComputerPlayer::Impl::timerEvent()
 
 void ComputerPlayer::Impl::startNodeCalculator()
 {
+    Assert(mWorkerPool.getActiveWorkerCount() == 0);
+    if (mWorkerCount == 0)
+    {
+        mWorkerCount = 2; // Poco::Environment::processorCount();
+    }
+    mWorkerPool.resize(mWorkerCount);
 
-    BlockTypes futureBlocks;
-    std::unique_ptr<GameStateNode> endNode;
+    int timeLimit = 0;
 
     // Critical section
     {
         Locker<GameImpl> rgame(mComputerPlayer->simpleGame()->gameImpl());
-        const ComputerGame& constComputerGame(dynamic_cast<const ComputerGame&>(*rgame.get()));
-
+        ComputerGame& computerGame(dynamic_cast<ComputerGame&>(*rgame.get()));
+        const ComputerGame& constComputerGame(computerGame);
 
         if (constComputerGame.numPrecalculatedMoves() > 8)
         {
@@ -349,53 +391,26 @@ void ComputerPlayer::Impl::startNodeCalculator()
             return;
         }
 
-        // Clone the starting node
-        // The end node becomes the new start node. It's like... a vantage point!
-        endNode = constComputerGame.endNode()->clone();
-        if (endNode->gameState().isGameOver())
+        Assert(constComputerGame.endNode()->depth() >= constComputerGame.currentNode()->depth());
+        mNodeCalculator.reset(mNodeCalculatorFactory.create(computerGame,
+                                                            *mEvaluator,
+                                                            mWorkerPool,
+                                                            mSearchType,
+                                                            mSearchDepth,
+                                                            mSearchWidth).release());
+        if (!mNodeCalculator)
         {
             return;
         }
 
-        mGameDepth = endNode->depth();
-        Assert(endNode->children().empty());
-        Assert(endNode->depth() >= constComputerGame.currentNode()->depth());
-
-
-        //
-        // Create the list of future blocks
-        //
-        ComputerGame& computerGame(dynamic_cast<ComputerGame&>(*rgame.get()));
-        computerGame.getFutureBlocksWithOffset(endNode->depth(), mSearchDepth, futureBlocks);
-    }
-
-
-    //
-    // Fill list of search widths (using the same width for each level).
-    //
-    std::vector<int> widths;
-    for (std::size_t idx = 0; idx != futureBlocks.size(); ++idx)
-    {
-        widths.push_back(mSearchWidth);
-    }
-
+        mGameDepth = constComputerGame.endNode()->depth();
 
-    //
-    // Create and start the NodeCalculator object.
-    //
-    Assert(mWorkerPool.getActiveWorkerCount() == 0);
-    if (mWorkerCount == 0)
-    {
-        mWorkerCount = 2; // Poco::Environment::processorCount();
+        // The move must be known before the block has fallen down half of the field.
+        int level = std::min(constComputerGame.level(), cMaxLevel);
+        timeLimit = static_cast<int>(500.0 * constComputerGame.gameState().rowCount() / Gravity::CalculateSpeed(level));
     }
-    mWorkerPool.resize(mWorkerCount);
-    mNodeCalculator.reset(new NodeCalculator(std::move(endNode),
-                                             futureBlocks,
-                                             widths,
-                                             *mEvaluator,
-                                             mWorkerPool));
 
-    mNodeCalculator->start();
+    mNodeCalculator->start(timeLimit);
 }
 
 
@@ -448,14 +463,8 @@ void ComputerPlayer::Impl::onFinished()
     Locker<GameImpl> wgame(mComputerPlayer->simpleGame()->gameImpl());
     ComputerGame& game(dynamic_cast<ComputerGame&>(*wgame.get()));
 
-    // Check for sync problems.
-    if (resultNode->depth() != game.endNode()->depth() + 1)
-    {
-        return;
-    }
-
-    // Ok, store the results.
-    game.appendPrecalculatedNode(resultNode);
+    // Store the results, unless there are sync problems.
+    mNodeCalculatorFactory.appendResult(*mNodeCalculator, game);
 }
 
 
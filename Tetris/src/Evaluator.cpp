@@ -4,7 +4,9 @@
 #include "Tetris/Block.h"
 #include "Tetris/BlockType.h"
 #include "Tetris/Grid.h"
+#include "Futile/Assert.h"
 #include "Futile/Threading.h"
+#include <algorithm>
 
 
 using Futile::ScopedLock;
@@ -13,6 +15,321 @@ using Futile::ScopedLock;
 namespace Tetris {
 
 
+namespace { // anonymous
+
+
+// Number of children that evaluateBatch scores at once.
+// The inner loops have a fixed trip count so that the compiler can map them onto vector registers.
+enum { cBatchLanes = 8 };
+
+enum Feature
+{
+    Feature_GameHeight,
+    Feature_LastBlockHeight,
+    Feature_NumHoles,
+    Feature_NumSingles,
+    Feature_NumDoubles,
+    Feature_NumTriples,
+    Feature_NumTetrises,
+    Feature_Count
+};
+
+
+bool OccupiesReservedColumn(const GameState& inGameState)
+{
+    std::size_t rowCount = inGameState.rowCount();
+    RowMask lastColumn = RowMask(1) << (inGameState.columnCount() - 1);
+    if (rowCount >= 4)
+    {
+        std::size_t r = rowCount - 4;
+        for (; r != rowCount; ++r)
+        {
+            if (inGameState.rowMask(r) & lastColumn)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+int GetHeightPenalty(const GameState& inGameState)
+{
+    int currentHeight = inGameState.currentHeight();
+    return currentHeight > 4 ? currentHeight * currentHeight : 0;
+}
+
+
+//
+// Compile-time evaluation
+//
+// A ConcreteEvaluator on the standard board size is evaluated by a kernel
+// that has the factors and the board dimensions as template arguments. The
+// factors become immediates and the row and column lookups become constants.
+// Other board sizes use the runtime-sized code of Evaluator.
+//
+
+// The board size that the kernels are compiled for.
+enum
+{
+    cStandardRowCount = 20,
+    cStandardColumnCount = 10
+};
+
+
+bool HasStandardSize(const GameState& inGameState)
+{
+    return inGameState.rowCount() == cStandardRowCount &&
+           inGameState.columnCount() == cStandardColumnCount;
+}
+
+
+template<int GameHeight,
+         int LastBlockHeight,
+         int NumHoles,
+         int NumSingles,
+         int NumDoubles,
+         int NumTriples,
+         int NumTetrises>
+struct StaticFactors
+{
+    enum
+    {
+        cGameHeight = GameHeight,
+        cLastBlockHeight = LastBlockHeight,
+        cNumHoles = NumHoles,
+        cNumSingles = NumSingles,
+        cNumDoubles = NumDoubles,
+        cNumTriples = NumTriples,
+        cNumTetrises = NumTetrises
+    };
+};
+
+
+typedef StaticFactors<-2, -1, -4,  1,  2,  4,  8> BalancedFactors;
+typedef StaticFactors<-2, -1, -3,  1,  2,  4,  8> SurvivalFactors;
+typedef StaticFactors<-2, -1, -4, -4, -8, -8, 16> MakeTetrisesFactors;
+typedef StaticFactors<-2, -1, -4, -4, -4,  8, 16> MultiplayerFactors;
+
+// Height is not OK. But holes are desirable!
+typedef StaticFactors<-2, -2,  1,  1,  2,  4, 64> ConfusedFactors;
+
+
+// Adjustments are added to the weighted sum of the features. Each one has a
+// runtime-sized version and a version for a fixed board size.
+struct NoAdjustment
+{
+    static int Get(const GameState&)
+    {
+        return 0;
+    }
+
+    template<std::size_t RowCount, std::size_t ColumnCount>
+    static int Get(const GameState&)
+    {
+        return 0;
+    }
+};
+
+
+// Penalty for occupying the last column, which is reserved for making tetrises.
+struct ReservedColumnPenalty
+{
+    static int Get(const GameState& inGameState)
+    {
+        return OccupiesReservedColumn(inGameState) ? -4 : 0;
+    }
+
+    template<std::size_t RowCount, std::size_t ColumnCount>
+    static int Get(const GameState& inGameState)
+    {
+        static_assert(RowCount >= 4 && ColumnCount <= cMaxColumnCount, "Unsupported board size.");
+        static const RowMask cLastColumn = RowMask(1) << (ColumnCount - 1);
+        RowMask bottomRows = inGameState.rowMask(RowCount - 4) |
+                             inGameState.rowMask(RowCount - 3) |
+                             inGameState.rowMask(RowCount - 2) |
+                             inGameState.rowMask(RowCount - 1);
+        return -4 * int((bottomRows & cLastColumn) != 0);
+    }
+};
+
+
+struct HeightPenalty
+{
+    static int Get(const GameState& inGameState)
+    {
+        return -GetHeightPenalty(inGameState);
+    }
+
+    template<std::size_t RowCount, std::size_t ColumnCount>
+    static int Get(const GameState& inGameState)
+    {
+        int height = RowCount - inGameState.firstOccupiedRow();
+        return -int(height > 4) * height * height;
+    }
+};
+
+
+template<class SubType>
+struct EvaluatorTraits;
+
+
+template<>
+struct EvaluatorTraits<Balanced>
+{
+    typedef BalancedFactors Factors;
+    typedef NoAdjustment Adjustment;
+};
+
+
+template<>
+struct EvaluatorTraits<Survival>
+{
+    typedef SurvivalFactors Factors;
+    typedef NoAdjustment Adjustment;
+};
+
+
+template<>
+struct EvaluatorTraits<MakeTetrises>
+{
+    typedef MakeTetrisesFactors Factors;
+    typedef ReservedColumnPenalty Adjustment;
+};
+
+
+template<>
+struct EvaluatorTraits<Multiplayer>
+{
+    typedef MultiplayerFactors Factors;
+    typedef NoAdjustment Adjustment;
+};
+
+
+template<>
+struct EvaluatorTraits<Confused>
+{
+    typedef ConfusedFactors Factors;
+    typedef HeightPenalty Adjustment;
+};
+
+
+// Same result as Evaluator::evaluate plus the adjustment.
+template<class Traits, std::size_t RowCount, std::size_t ColumnCount>
+inline int EvaluateFixedSize(const GameState& inGameState)
+{
+    typedef typename Traits::Factors Factors;
+    int gameHeight = RowCount - inGameState.firstOccupiedRow();
+    int lastBlockHeight = RowCount - inGameState.originalBlock().row();
+
+    return gameHeight * Factors::cGameHeight +
+           lastBlockHeight * Factors::cLastBlockHeight +
+           inGameState.numHoles() * Factors::cNumHoles +
+           inGameState.numSingles() * Factors::cNumSingles +
+           inGameState.numDoubles() * Factors::cNumDoubles +
+           inGameState.numTriples() * Factors::cNumTriples +
+           inGameState.numTetrises() * Factors::cNumTetrises +
+           Traits::Adjustment::template Get<RowCount, ColumnCount>(inGameState);
+}
+
+
+// The board height of a batch, either read from the gamestates or fixed at compile time.
+struct RuntimeRowCount
+{
+    static int Get(const GameState& inGameState)
+    {
+        return inGameState.rowCount();
+    }
+};
+
+
+template<std::size_t RowCount>
+struct FixedRowCount
+{
+    static int Get(const GameState&)
+    {
+        return RowCount;
+    }
+};
+
+
+// Scores the gamestates cBatchLanes at a time. Feature vectors are stored
+// per feature so that each step of the weighted sum processes all lanes with
+// one instruction. When the weights are compile-time constants and the row
+// count is fixed, the compiler folds them into the loops.
+template<class RowCountType>
+void EvaluateBatchImpl(const int (&inWeights)[Feature_Count],
+                       const std::vector<const GameState*>& inGameStates,
+                       std::vector<int>& outScores)
+{
+    const std::size_t count = inGameStates.size();
+    outScores.resize(count);
+
+    int features[Feature_Count][cBatchLanes];
+    int scores[cBatchLanes];
+
+    for (std::size_t begin = 0; begin < count; begin += cBatchLanes)
+    {
+        std::size_t laneCount = std::min<std::size_t>(count - begin, cBatchLanes);
+        for (std::size_t lane = 0; lane != cBatchLanes; ++lane)
+        {
+            if (lane >= laneCount)
+            {
+                for (std::size_t f = 0; f != Feature_Count; ++f)
+                {
+                    features[f][lane] = 0;
+                }
+                continue;
+            }
+
+            const GameState& gameState = *inGameStates[begin + lane];
+            Assert(gameState.rowCount() == inGameStates.front()->rowCount());
+            int rowCount = RowCountType::Get(gameState);
+            features[Feature_GameHeight][lane] = rowCount - gameState.firstOccupiedRow();
+            features[Feature_LastBlockHeight][lane] = rowCount - gameState.originalBlock().row();
+            features[Feature_NumHoles][lane] = gameState.numHoles();
+            features[Feature_NumSingles][lane] = gameState.numSingles();
+            features[Feature_NumDoubles][lane] = gameState.numDoubles();
+            features[Feature_NumTriples][lane] = gameState.numTriples();
+            features[Feature_NumTetrises][lane] = gameState.numTetrises();
+        }
+
+        std::fill(scores, scores + cBatchLanes, 0);
+        for (std::size_t f = 0; f != Feature_Count; ++f)
+        {
+            for (std::size_t lane = 0; lane != cBatchLanes; ++lane)
+            {
+                scores[lane] += inWeights[f] * features[f][lane];
+            }
+        }
+
+        std::copy(scores, scores + laneCount, outScores.begin() + begin);
+    }
+}
+
+
+// The weights of the batch kernel for factors that are known at compile time.
+template<class Factors>
+const int (&GetStaticWeights())[Feature_Count]
+{
+    static const int cWeights[Feature_Count] =
+    {
+        Factors::cGameHeight,
+        Factors::cLastBlockHeight,
+        Factors::cNumHoles,
+        Factors::cNumSingles,
+        Factors::cNumDoubles,
+        Factors::cNumTriples,
+        Factors::cNumTetrises
+    };
+    return cWeights;
+}
+
+
+} // anonymous namespace
+
+
 Evaluator::Evaluator(const std::string& inName,
                      GameHeightFactor inGameHeightFactor,
                      LastBlockHeightFactor inLastBlockHeightFactor,
@@ -99,50 +416,13 @@ int Evaluator::recommendedSearchWidth() const
 
 int Evaluator::evaluate(const GameState& inGameState) const
 {
-    const Grid& grid = inGameState.grid();
-    std::size_t top = grid.rowCount();
-    bool foundTop = false;
-    int numHoles = 0;
-    int numOccupiedUnderTop = 0;
-
-    for (std::size_t rowIdx = 0; rowIdx != grid.rowCount(); ++rowIdx)
-    {
-        for (std::size_t colIdx = 0; colIdx != grid.columnCount(); ++colIdx)
-        {
-            const int& value = grid.get(rowIdx, colIdx);
-            if (value != BlockType_Nil)
-            {
-                if (!foundTop)
-                {
-                    top = rowIdx;
-                    foundTop = true;
-                }
-
-                if (foundTop)
-                {
-                    numOccupiedUnderTop++;
-                }
-            }
-            else
-            {
-                // check for holes
-                if (foundTop && rowIdx > 0)
-                {
-                    if (grid.get(rowIdx - 1, colIdx) != BlockType_Nil)
-                    {
-                        numHoles++;
-                    }
-                }
-            }
-        }
-    }
-    int gameHeight = grid.rowCount() - top;
-    int lastBlockHeight = grid.rowCount() - inGameState.originalBlock().row();
-
+    // The features are maintained by GameState::commit.
+    int gameHeight = inGameState.currentHeight();
+    int lastBlockHeight = inGameState.rowCount() - inGameState.originalBlock().row();
 
     return gameHeight * mGameHeightFactor +
            lastBlockHeight * mLastBlockHeightFactor +
-           numHoles * mNumHolesFactor +
+           inGameState.numHoles() * mNumHolesFactor +
            inGameState.numSingles() * mNumSinglesFactor +
            inGameState.numDoubles() * mNumDoublesFactor +
            inGameState.numTriples() * mNumTriplesFactor +
@@ -150,6 +430,23 @@ int Evaluator::evaluate(const GameState& inGameState) const
 }
 
 
+void Evaluator::evaluateBatch(const std::vector<const GameState*>& inChildren,
+                              std::vector<int>& outScores) const
+{
+    const int weights[Feature_Count] =
+    {
+        mGameHeightFactor,
+        mLastBlockHeightFactor,
+        mNumHolesFactor,
+        mNumSinglesFactor,
+        mNumDoublesFactor,
+        mNumTriplesFactor,
+        mNumTetrisesFactor
+    };
+    EvaluateBatchImpl<RuntimeRowCount>(weights, inChildren, outScores);
+}
+
+
 CustomEvaluator::CustomEvaluator(GameHeightFactor inGameHeightFactor,
                                  LastBlockHeightFactor inLastBlockHeightFactor,
                                  NumHolesFactor inNumHolesFactor,
@@ -173,15 +470,58 @@ CustomEvaluator::CustomEvaluator(GameHeightFactor inGameHeightFactor,
 }
 
 
+template<class SubType>
+int ConcreteEvaluator<SubType>::evaluate(const GameState& inGameState) const
+{
+    typedef EvaluatorTraits<SubType> Traits;
+    if (HasStandardSize(inGameState))
+    {
+        return EvaluateFixedSize<Traits, cStandardRowCount, cStandardColumnCount>(inGameState);
+    }
+    return Evaluator::evaluate(inGameState) + Traits::Adjustment::Get(inGameState);
+}
+
+
+template<class SubType>
+void ConcreteEvaluator<SubType>::evaluateBatch(const std::vector<const GameState*>& inChildren,
+                                               std::vector<int>& outScores) const
+{
+    typedef EvaluatorTraits<SubType> Traits;
+    const std::size_t count = inChildren.size();
+    if (count != 0 && HasStandardSize(*inChildren.front()))
+    {
+        EvaluateBatchImpl<FixedRowCount<cStandardRowCount> >(GetStaticWeights<typename Traits::Factors>(), inChildren, outScores);
+        for (std::size_t idx = 0; idx != count; ++idx)
+        {
+            outScores[idx] += Traits::Adjustment::template Get<cStandardRowCount, cStandardColumnCount>(*inChildren[idx]);
+        }
+        return;
+    }
+
+    Evaluator::evaluateBatch(inChildren, outScores);
+    for (std::size_t idx = 0; idx != count; ++idx)
+    {
+        outScores[idx] += Traits::Adjustment::Get(*inChildren[idx]);
+    }
+}
+
+
+template class ConcreteEvaluator<Balanced>;
+template class ConcreteEvaluator<Survival>;
+template class ConcreteEvaluator<MakeTetrises>;
+template class ConcreteEvaluator<Multiplayer>;
+template class ConcreteEvaluator<Confused>;
+
+
 Balanced::Balanced() :
     Super("Balanced",
-          GameHeightFactor(-2),
-          LastBlockHeightFactor(-1),
-          NumHolesFactor(-4),
-          NumSinglesFactor(1),
-          NumDoublesFactor(2),
-          NumTriplesFactor(4),
-          NumTetrisesFactor(8),
+          GameHeightFactor(BalancedFactors::cGameHeight),
+          LastBlockHeightFactor(BalancedFactors::cLastBlockHeight),
+          NumHolesFactor(BalancedFactors::cNumHoles),
+          NumSinglesFactor(BalancedFactors::cNumSingles),
+          NumDoublesFactor(BalancedFactors::cNumDoubles),
+          NumTriplesFactor(BalancedFactors::cNumTriples),
+          NumTetrisesFactor(BalancedFactors::cNumTetrises),
           SearchDepth(6),
           SearchWidth(6))
 {
@@ -190,13 +530,13 @@ Balanced::Balanced() :
 
 Survival::Survival() :
     Super("Survival",
-          GameHeightFactor(-2),
-          LastBlockHeightFactor(-1),
-          NumHolesFactor(-3),
-          NumSinglesFactor(1),
-          NumDoublesFactor(2),
-          NumTriplesFactor(4),
-          NumTetrisesFactor(8),
+          GameHeightFactor(SurvivalFactors::cGameHeight),
+          LastBlockHeightFactor(SurvivalFactors::cLastBlockHeight),
+          NumHolesFactor(SurvivalFactors::cNumHoles),
+          NumSinglesFactor(SurvivalFactors::cNumSingles),
+          NumDoublesFactor(SurvivalFactors::cNumDoubles),
+          NumTriplesFactor(SurvivalFactors::cNumTriples),
+          NumTetrisesFactor(SurvivalFactors::cNumTetrises),
           SearchDepth(6),
           SearchWidth(4))
 {
@@ -205,83 +545,46 @@ Survival::Survival() :
 
 MakeTetrises::MakeTetrises() :
     Super("Make Tetrises",
-              GameHeightFactor(-2),
-              LastBlockHeightFactor(-1),
-              NumHolesFactor(-4),
-              NumSinglesFactor(-4),
-              NumDoublesFactor(-8),
-              NumTriplesFactor(-8),
-              NumTetrisesFactor(16),
-              SearchDepth(8),
-              SearchWidth(5))
+          GameHeightFactor(MakeTetrisesFactors::cGameHeight),
+          LastBlockHeightFactor(MakeTetrisesFactors::cLastBlockHeight),
+          NumHolesFactor(MakeTetrisesFactors::cNumHoles),
+          NumSinglesFactor(MakeTetrisesFactors::cNumSingles),
+          NumDoublesFactor(MakeTetrisesFactors::cNumDoubles),
+          NumTriplesFactor(MakeTetrisesFactors::cNumTriples),
+          NumTetrisesFactor(MakeTetrisesFactors::cNumTetrises),
+          SearchDepth(8),
+          SearchWidth(5))
 {
 }
 
 
-int MakeTetrises::evaluate(const GameState& inGameState) const
-{
-    const Grid& grid = inGameState.grid();
-
-    std::size_t c = grid.columnCount() - 1;
-    if (grid.rowCount() >= 4)
-    {
-        std::size_t r = grid.rowCount() - 4;
-        for (; r != grid.rowCount(); ++r)
-        {
-            if (grid.get(r, c))
-            {
-                // Penalty for occupying the last column,
-                // which is reserved for making tetrises.
-                return Evaluator::evaluate(inGameState) - 4;
-            }
-        }
-    }
-    return Evaluator::evaluate(inGameState);
-}
-
-
 Multiplayer::Multiplayer() :
     Super("Multiplayer",
-              GameHeightFactor(-2),
-              LastBlockHeightFactor(-1),
-              NumHolesFactor(-4),
-              NumSinglesFactor(-4),
-              NumDoublesFactor(-4),
-              NumTriplesFactor(8),
-              NumTetrisesFactor(16),
-              SearchDepth(8),
-              SearchWidth(4))
+          GameHeightFactor(MultiplayerFactors::cGameHeight),
+          LastBlockHeightFactor(MultiplayerFactors::cLastBlockHeight),
+          NumHolesFactor(MultiplayerFactors::cNumHoles),
+          NumSinglesFactor(MultiplayerFactors::cNumSingles),
+          NumDoublesFactor(MultiplayerFactors::cNumDoubles),
+          NumTriplesFactor(MultiplayerFactors::cNumTriples),
+          NumTetrisesFactor(MultiplayerFactors::cNumTetrises),
+          SearchDepth(8),
+          SearchWidth(4))
 {
 }
 
 
 Confused::Confused() :
     Super("Depressed",
-    GameHeightFactor(-2),
-    LastBlockHeightFactor(-2),  // Height is not OK.
-    NumHolesFactor(1),          // But holes are desirable!
-    NumSinglesFactor(1),
-    NumDoublesFactor(2),
-    NumTriplesFactor(4),
-    NumTetrisesFactor(64),
-    SearchDepth(20),
-    SearchWidth(4))
-{
-}
-
-
-int Confused::evaluate(const GameState& inGameState) const
+          GameHeightFactor(ConfusedFactors::cGameHeight),
+          LastBlockHeightFactor(ConfusedFactors::cLastBlockHeight),
+          NumHolesFactor(ConfusedFactors::cNumHoles),
+          NumSinglesFactor(ConfusedFactors::cNumSingles),
+          NumDoublesFactor(ConfusedFactors::cNumDoubles),
+          NumTriplesFactor(ConfusedFactors::cNumTriples),
+          NumTetrisesFactor(ConfusedFactors::cNumTetrises),
+          SearchDepth(20),
+          SearchWidth(4))
 {
-    int result = 0;
-
-    auto current_height = inGameState.currentHeight();
-
-    if (current_height > 4)
-    {
-        result -= current_height * current_height;
-    }
-
-    return Evaluator::evaluate(inGameState) + result;
 }
 
 
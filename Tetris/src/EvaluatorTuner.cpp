@@ -0,0 +1,558 @@
+#include "Tetris/Config.h"
+#include "Tetris/EvaluatorTuner.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameStateStats.h"
+#include "Tetris/Simulation.h"
+#include "Futile/Assert.h"
+#include "Futile/MakeString.h"
+#include "Futile/RandomStream.h"
+#include "Futile/WorkerPool.h"
+#include <boost/bind/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <vector>
+
+
+using Futile::MakeString;
+using Futile::RandomStream;
+using Futile::WorkerPool;
+
+
+namespace Tetris {
+
+
+// Step sizes don't shrink below this value, so that the rounded factors keep changing.
+static const double cMinStepSize = 0.5;
+
+// Weight of the selected steps in the step size update. The textbook value is lower,
+// but generations are expensive, so the step sizes are allowed to adapt faster.
+static const double cLearningRate = 0.2;
+
+
+static const char* cFactorNames[EvaluatorTuner::cFactorCount] =
+{
+    "GameHeightFactor",
+    "LastBlockHeightFactor",
+    "NumHolesFactor",
+    "NumSinglesFactor",
+    "NumDoublesFactor",
+    "NumTriplesFactor",
+    "NumTetrisesFactor"
+};
+
+
+static std::unique_ptr<CustomEvaluator> CreateEvaluator(const EvaluatorTuner::Factors& inFactors,
+                                                        int inSearchDepth,
+                                                        int inSearchWidth)
+{
+    return std::unique_ptr<CustomEvaluator>(new CustomEvaluator(GameHeightFactor(inFactors[0]),
+                                                                LastBlockHeightFactor(inFactors[1]),
+                                                                NumHolesFactor(inFactors[2]),
+                                                                NumSinglesFactor(inFactors[3]),
+                                                                NumDoublesFactor(inFactors[4]),
+                                                                NumTriplesFactor(inFactors[5]),
+                                                                NumTetrisesFactor(inFactors[6]),
+                                                                SearchDepth(inSearchDepth),
+                                                                SearchWidth(inSearchWidth)));
+}
+
+
+// Returns a standard normal sample (Box-Muller). std::normal_distribution is not
+// used, because its results differ between standard libraries.
+static double NextGaussian(RandomStream& ioRandom)
+{
+    static const double cPi = 3.14159265358979323846;
+
+    // 53 random bits, u1 in (0, 1] so that the log is finite.
+    double u1 = ((ioRandom.next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double u2 = (ioRandom.next() >> 11) * (1.0 / 9007199254740992.0);
+    return std::sqrt(-2 * std::log(u1)) * std::cos(2 * cPi * u2);
+}
+
+
+// Orders candidate indices by descending fitness.
+struct FitterThan
+{
+    FitterThan(const std::vector<double>& inFitness) : mFitness(inFitness) {}
+
+    bool operator()(std::size_t lhs, std::size_t rhs) const
+    {
+        return mFitness[lhs] > mFitness[rhs];
+    }
+
+    const std::vector<double>& mFitness;
+};
+
+
+struct EvaluatorTuner::Impl : boost::noncopyable
+{
+    struct GameResult
+    {
+        GameResult() : mScore(0), mError() {}
+
+        int mScore;
+        std::string mError;
+    };
+
+    Impl(const Factors& inStartFactors, std::size_t inThreadCount) :
+        mRowCount(20),
+        mColumnCount(10),
+        mSearchDepth(3),
+        mSearchWidth(3),
+        mSearchType(NodeCalculator::SearchType_Tree),
+        mPopulationSize(12),
+        mGamesPerCandidate(4),
+        mMaxBlockCount(500),
+        mGarbageInterval(0),
+        mGarbageLineCount(0),
+        mSeed(1),
+        mGeneration(0),
+        mBestFactors(inStartFactors),
+        mBestFitness(-1),
+        mAverageFitness(0),
+        mSearchPools(),
+        mGamePool("EvaluatorTuner", std::max<std::size_t>(inThreadCount, 1))
+    {
+        for (std::size_t idx = 0; idx != cFactorCount; ++idx)
+        {
+            mMean[idx] = inStartFactors[idx];
+            mStepSizes[idx] = std::max(cMinStepSize, std::abs(inStartFactors[idx]) / 2.0);
+        }
+    }
+
+    // Runs in a worker of the game pool.
+    void playGame(const Evaluator* inEvaluator, unsigned inSeed, GameResult* outResult);
+
+    std::size_t mRowCount;
+    std::size_t mColumnCount;
+    int mSearchDepth;
+    int mSearchWidth;
+    NodeCalculator::SearchType mSearchType;
+    std::size_t mPopulationSize;
+    std::size_t mGamesPerCandidate;
+    std::size_t mMaxBlockCount;
+    int mGarbageInterval;
+    int mGarbageLineCount;
+    unsigned mSeed;
+
+    // The distribution that the candidates are sampled from.
+    double mMean[cFactorCount];
+    double mStepSizes[cFactorCount];
+
+    std::size_t mGeneration;
+    Factors mBestFactors;
+    double mBestFitness;
+    double mAverageFitness;
+
+    // Each game thread searches with its own single-threaded pool. The pools can't be
+    // shared, because a search waits until its pool is idle. Declared before the game
+    // pool, so that the threads have cleaned up their search pools when it is destroyed.
+    boost::thread_specific_ptr<WorkerPool> mSearchPools;
+    WorkerPool mGamePool;
+};
+
+
+void EvaluatorTuner::Impl::playGame(const Evaluator* inEvaluator, unsigned inSeed, GameResult* outResult)
+{
+    // Exceptions must not reach the worker.
+    try
+    {
+        if (!mSearchPools.get())
+        {
+            mSearchPools.reset(new WorkerPool("EvaluatorTuner Search", 1));
+        }
+
+        Simulation simulation(mRowCount, mColumnCount, inSeed, *inEvaluator, *mSearchPools);
+        simulation.setSearchDepth(mSearchDepth);
+        simulation.setSearchWidth(mSearchWidth);
+        simulation.setSearchType(mSearchType);
+        simulation.setMaxBlockCount(mMaxBlockCount);
+        simulation.setGarbage(mGarbageInterval, mGarbageLineCount);
+        outResult->mScore = simulation.run().score();
+    }
+    catch (const std::exception& inException)
+    {
+        outResult->mError = inException.what();
+    }
+}
+
+
+EvaluatorTuner::Factors EvaluatorTuner::GetFactors(const Evaluator& inEvaluator)
+{
+    Factors result =
+    {{
+        inEvaluator.gameHeightFactor(),
+        inEvaluator.lastBlockHeightFactor(),
+        inEvaluator.numHolesFactor(),
+        inEvaluator.numSinglesFactor(),
+        inEvaluator.numDoublesFactor(),
+        inEvaluator.numTriplesFactor(),
+        inEvaluator.numTetrisesFactor()
+    }};
+    return result;
+}
+
+
+const char* EvaluatorTuner::GetFactorName(std::size_t inIndex)
+{
+    if (inIndex >= cFactorCount)
+    {
+        throw std::out_of_range("EvaluatorTuner::GetFactorName: invalid index.");
+    }
+    return cFactorNames[inIndex];
+}
+
+
+EvaluatorTuner::EvaluatorTuner(const Factors& inStartFactors, std::size_t inThreadCount) :
+    mImpl(new Impl(inStartFactors, inThreadCount))
+{
+}
+
+
+EvaluatorTuner::~EvaluatorTuner()
+{
+    mImpl.reset();
+}
+
+
+void EvaluatorTuner::setBoardSize(std::size_t inRowCount, std::size_t inColumnCount)
+{
+    mImpl->mRowCount = inRowCount;
+    mImpl->mColumnCount = inColumnCount;
+}
+
+
+void EvaluatorTuner::setSearch(int inSearchDepth, int inSearchWidth, NodeCalculator::SearchType inSearchType)
+{
+    mImpl->mSearchDepth = inSearchDepth;
+    mImpl->mSearchWidth = inSearchWidth;
+    mImpl->mSearchType = inSearchType;
+}
+
+
+void EvaluatorTuner::setPopulationSize(std::size_t inPopulationSize)
+{
+    if (inPopulationSize < 2)
+    {
+        throw std::invalid_argument("EvaluatorTuner: the population needs at least two candidates.");
+    }
+    mImpl->mPopulationSize = inPopulationSize;
+}
+
+
+void EvaluatorTuner::setGamesPerCandidate(std::size_t inGameCount)
+{
+    if (inGameCount == 0)
+    {
+        throw std::invalid_argument("EvaluatorTuner: each candidate must play at least one game.");
+    }
+    mImpl->mGamesPerCandidate = inGameCount;
+}
+
+
+void EvaluatorTuner::setMaxBlockCount(std::size_t inMaxBlockCount)
+{
+    mImpl->mMaxBlockCount = inMaxBlockCount;
+}
+
+
+void EvaluatorTuner::setGarbage(int inInterval, int inLineCount)
+{
+    mImpl->mGarbageInterval = inInterval;
+    mImpl->mGarbageLineCount = inLineCount;
+}
+
+
+void EvaluatorTuner::setSeed(unsigned inSeed)
+{
+    mImpl->mSeed = inSeed;
+}
+
+
+void EvaluatorTuner::runGeneration()
+{
+    Impl& impl = *mImpl;
+    const std::size_t candidateCount = impl.mPopulationSize;
+    const std::size_t gameCount = impl.mGamesPerCandidate;
+
+    //
+    // Sample the candidates.
+    //
+    // Each generation has its own stream, so a checkpoint only needs the seed.
+    RandomStream random((static_cast<std::uint64_t>(impl.mSeed) << 32) | impl.mGeneration);
+    std::vector<std::array<double, cFactorCount> > steps(candidateCount);
+    std::vector<Factors> candidates(candidateCount);
+    std::vector<boost::shared_ptr<CustomEvaluator> > evaluators(candidateCount);
+    for (std::size_t idx = 0; idx != candidateCount; ++idx)
+    {
+        for (std::size_t f = 0; f != cFactorCount; ++f)
+        {
+            steps[idx][f] = NextGaussian(random);
+            candidates[idx][f] = static_cast<int>(std::floor(0.5 + impl.mMean[f] + impl.mStepSizes[f] * steps[idx][f]));
+        }
+        evaluators[idx].reset(CreateEvaluator(candidates[idx], impl.mSearchDepth, impl.mSearchWidth).release());
+    }
+
+
+    //
+    // Play the games. All candidates get the same seeds.
+    //
+    std::vector<Impl::GameResult> results(candidateCount * gameCount);
+    for (std::size_t idx = 0; idx != candidateCount; ++idx)
+    {
+        for (std::size_t game = 0; game != gameCount; ++game)
+        {
+            unsigned seed = impl.mSeed + static_cast<unsigned>(impl.mGeneration * gameCount + game);
+            impl.mGamePool.schedule(boost::bind(&Impl::playGame,
+                                                &impl,
+                                                evaluators[idx].get(),
+                                                seed,
+                                                &results[idx * gameCount + game]));
+        }
+    }
+    impl.mGamePool.wait();
+
+    std::vector<double> fitness(candidateCount, 0);
+    for (std::size_t idx = 0; idx != results.size(); ++idx)
+    {
+        if (!results[idx].mError.empty())
+        {
+            throw std::runtime_error("EvaluatorTuner: " + results[idx].mError);
+        }
+        fitness[idx / gameCount] += results[idx].mScore / static_cast<double>(gameCount);
+    }
+
+
+    //
+    // Rank the candidates, ties in sampling order.
+    //
+    std::vector<std::size_t> ranking(candidateCount);
+    for (std::size_t idx = 0; idx != candidateCount; ++idx)
+    {
+        ranking[idx] = idx;
+    }
+    std::stable_sort(ranking.begin(), ranking.end(), FitterThan(fitness));
+
+
+    //
+    // Move the distribution towards the best half.
+    //
+    const std::size_t selectedCount = candidateCount / 2;
+    std::vector<double> weights(selectedCount);
+    double weightSum = 0;
+    for (std::size_t idx = 0; idx != selectedCount; ++idx)
+    {
+        weights[idx] = std::log(selectedCount + 0.5) - std::log(idx + 1.0);
+        weightSum += weights[idx];
+    }
+
+    for (std::size_t f = 0; f != cFactorCount; ++f)
+    {
+        double meanStep = 0;
+        double variance = 0;
+        for (std::size_t idx = 0; idx != selectedCount; ++idx)
+        {
+            double step = steps[ranking[idx]][f];
+            meanStep += weights[idx] / weightSum * step;
+            variance += weights[idx] / weightSum * step * step;
+        }
+        impl.mMean[f] += impl.mStepSizes[f] * meanStep;
+
+        // A variance above one means that the good candidates were far from the mean.
+        impl.mStepSizes[f] *= std::sqrt(1 - cLearningRate + cLearningRate * variance);
+        impl.mStepSizes[f] = std::max(impl.mStepSizes[f], cMinStepSize);
+    }
+
+
+    impl.mAverageFitness = 0;
+    for (std::size_t idx = 0; idx != candidateCount; ++idx)
+    {
+        impl.mAverageFitness += fitness[idx] / candidateCount;
+    }
+
+    const std::size_t best = ranking.front();
+    if (fitness[best] > impl.mBestFitness)
+    {
+        impl.mBestFitness = fitness[best];
+        impl.mBestFactors = candidates[best];
+    }
+    impl.mGeneration++;
+}
+
+
+std::size_t EvaluatorTuner::generation() const
+{
+    return mImpl->mGeneration;
+}
+
+
+const EvaluatorTuner::Factors& EvaluatorTuner::bestFactors() const
+{
+    return mImpl->mBestFactors;
+}
+
+
+double EvaluatorTuner::bestFitness() const
+{
+    return mImpl->mBestFitness;
+}
+
+
+double EvaluatorTuner::averageFitness() const
+{
+    return mImpl->mAverageFitness;
+}
+
+
+std::unique_ptr<CustomEvaluator> EvaluatorTuner::createBestEvaluator() const
+{
+    return CreateEvaluator(mImpl->mBestFactors, mImpl->mSearchDepth, mImpl->mSearchWidth);
+}
+
+
+void EvaluatorTuner::saveCheckpoint(const std::string& inFileName) const
+{
+    const Impl& impl = *mImpl;
+    std::string tempFileName = inFileName + ".tmp";
+    {
+        std::ofstream out(tempFileName.c_str());
+        out << std::setprecision(17);
+        out << "seed " << impl.mSeed << "\n";
+        out << "populationSize " << impl.mPopulationSize << "\n";
+        out << "gamesPerCandidate " << impl.mGamesPerCandidate << "\n";
+        out << "generation " << impl.mGeneration << "\n";
+        out << "mean";
+        for (std::size_t f = 0; f != cFactorCount; ++f)
+        {
+            out << " " << impl.mMean[f];
+        }
+        out << "\nstepSizes";
+        for (std::size_t f = 0; f != cFactorCount; ++f)
+        {
+            out << " " << impl.mStepSizes[f];
+        }
+        out << "\nbest";
+        for (std::size_t f = 0; f != cFactorCount; ++f)
+        {
+            out << " " << impl.mBestFactors[f];
+        }
+        out << "\nbestFitness " << impl.mBestFitness << "\n";
+        out << "averageFitness " << impl.mAverageFitness << "\n";
+        if (!out)
+        {
+            throw std::runtime_error("EvaluatorTuner: failed to write " + tempFileName);
+        }
+    }
+
+    if (std::rename(tempFileName.c_str(), inFileName.c_str()) != 0)
+    {
+        throw std::runtime_error("EvaluatorTuner: failed to replace " + inFileName);
+    }
+}
+
+
+void EvaluatorTuner::loadCheckpoint(const std::string& inFileName)
+{
+    std::ifstream in(inFileName.c_str());
+    if (!in)
+    {
+        throw std::runtime_error("EvaluatorTuner: failed to open " + inFileName);
+    }
+
+    // Read everything first, so that a broken file leaves the tuner unchanged.
+    unsigned seed = 0;
+    std::size_t populationSize = 0;
+    std::size_t gamesPerCandidate = 0;
+    std::size_t generation = 0;
+    double mean[cFactorCount];
+    double stepSizes[cFactorCount];
+    Factors bestFactors = mImpl->mBestFactors;
+    double bestFitness = 0;
+    double averageFitness = 0;
+    std::size_t found = 0;
+    std::string key;
+    while (in >> key)
+    {
+        if (key == "seed")
+        {
+            in >> seed;
+        }
+        else if (key == "populationSize")
+        {
+            in >> populationSize;
+        }
+        else if (key == "gamesPerCandidate")
+        {
+            in >> gamesPerCandidate;
+        }
+        else if (key == "generation")
+        {
+            in >> generation;
+        }
+        else if (key == "mean" || key == "stepSizes")
+        {
+            double* values = key == "mean" ? mean : stepSizes;
+            for (std::size_t f = 0; f != cFactorCount; ++f)
+            {
+                in >> values[f];
+            }
+        }
+        else if (key == "best")
+        {
+            for (std::size_t f = 0; f != cFactorCount; ++f)
+            {
+                in >> bestFactors[f];
+            }
+        }
+        else if (key == "bestFitness")
+        {
+            in >> bestFitness;
+        }
+        else if (key == "averageFitness")
+        {
+            in >> averageFitness;
+        }
+        else
+        {
+            throw std::runtime_error(MakeString() << "EvaluatorTuner: unknown key in " << inFileName << ": " << key);
+        }
+        if (!in)
+        {
+            throw std::runtime_error(MakeString() << "EvaluatorTuner: invalid value for " << key << " in " << inFileName);
+        }
+        found++;
+    }
+    if (found != 9)
+    {
+        throw std::runtime_error("EvaluatorTuner: incomplete checkpoint " + inFileName);
+    }
+
+    // The samples and the games of a generation depend on these settings, a search
+    // that continues with other values would not be the one that was saved.
+    Impl& impl = *mImpl;
+    if (seed != impl.mSeed || populationSize != impl.mPopulationSize || gamesPerCandidate != impl.mGamesPerCandidate)
+    {
+        throw std::runtime_error(MakeString() << "EvaluatorTuner: " << inFileName
+                                              << " was written with seed " << seed
+                                              << ", population size " << populationSize
+                                              << " and " << gamesPerCandidate << " games per candidate.");
+    }
+
+    impl.mGeneration = generation;
+    std::copy(mean, mean + cFactorCount, impl.mMean);
+    std::copy(stepSizes, stepSizes + cFactorCount, impl.mStepSizes);
+    impl.mBestFactors = bestFactors;
+    impl.mBestFitness = bestFitness;
+    impl.mAverageFitness = averageFitness;
+}
+
+
+} // namespace Tetris
@@ -0,0 +1,304 @@
+#include "Tetris/Config.h"
+#include "Tetris/ExpectimaxNodeCalculator.h"
+#include "Tetris/AISupport.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameStateNode.h"
+#include "Tetris/GameState.h"
+#include "Tetris/BlockTypes.h"
+#include "Futile/WorkerPool.h"
+#include "Futile/Assert.h"
+#include "Futile/Threading.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+
+namespace Tetris {
+
+
+using Futile::Arena;
+using Futile::ScopedLock;
+using Futile::Worker;
+using Futile::WorkerPool;
+
+
+ExpectimaxNodeCalculator::ExpectimaxNodeCalculator(NodePtr inNode,
+                                                   const BlockTypes& inBlockTypes,
+                                                   const std::vector<int>& inWidths,
+                                                   const Evaluator& inEvaluator,
+                                                   WorkerPool& inWorkerPool,
+                                                   const BlockTypes& inFullBag,
+                                                   const BlockTypes& inRemainingBlocks) :
+    NodeCalculatorImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool),
+    mFullBag(inFullBag),
+    mRemainingBlocks(inRemainingBlocks.empty() ? inFullBag : inRemainingBlocks)
+{
+    Assert(!mBlockTypes.empty());
+    Assert(mWidths.size() >= mBlockTypes.size());
+    Assert(!mFullBag.empty());
+    std::sort(mFullBag.begin(), mFullBag.end());
+    std::sort(mRemainingBlocks.begin(), mRemainingBlocks.end());
+}
+
+
+ExpectimaxNodeCalculator::~ExpectimaxNodeCalculator()
+{
+    setQuitFlag();
+    mMainWorker.interruptAndClearQueue();
+    mWorkerPool.interruptAndClearQueue();
+}
+
+
+void ExpectimaxNodeCalculator::expandNode(NodePtr inNode, std::size_t inIndex, ChildNodes* outChildNodes)
+{
+    GenerateOffspring(inNode, mBlockTypes[inIndex], mEvaluator, mWidths[inIndex], *outChildNodes, mArena.get());
+    addNodeCount(outChildNodes->size());
+}
+
+
+// The nodes of one branch are small and are all discarded together.
+static const std::size_t cBranchArenaChunkSize = 64 * 1024;
+
+
+void ExpectimaxNodeCalculator::evaluateBranch(NodePtr inNode, BlockType inBlockType, BlockTypes inBag, double* outValue)
+{
+    Arena arena(cBranchArenaChunkSize);
+    *outValue = getBranchValue(inNode, mBlockTypes.size(), inBlockType, inBag, arena);
+}
+
+
+int ExpectimaxNodeCalculator::getChanceWidth(std::size_t inIndex) const
+{
+    // The deeper unknown blocks only refine the estimate, so they don't branch.
+    bool isFirstUnknown = inIndex == mBlockTypes.size();
+    bool isLastRow = inIndex + 1 == mWidths.size();
+    return isFirstUnknown && !isLastRow ? mWidths[inIndex] : 1;
+}
+
+
+double ExpectimaxNodeCalculator::getExpectedValue(NodePtr inNode, std::size_t inIndex, const BlockTypes& inBag, Arena& ioArena) const
+{
+    if (inIndex == mWidths.size() || inNode->gameState().isGameOver())
+    {
+        return inNode->quality();
+    }
+
+    // Each block type is weighed by the number of times it occurs in the bag.
+    double sum = 0;
+    BlockTypes::const_iterator it = inBag.begin(), end = inBag.end();
+    while (it != end)
+    {
+        BlockTypes::const_iterator next = std::upper_bound(it, end, *it);
+        sum += (next - it) * getBranchValue(inNode, inIndex, *it, drawFromBag(inBag, *it), ioArena);
+        it = next;
+    }
+    return sum / inBag.size();
+}
+
+
+double ExpectimaxNodeCalculator::getBranchValue(NodePtr inNode, std::size_t inIndex, BlockType inBlockType, const BlockTypes& inBag, Arena& ioArena) const
+{
+    boost::this_thread::interruption_point();
+
+    int width = getChanceWidth(inIndex);
+    ChildNodes childNodes(&ioArena);
+    GenerateOffspring(inNode, inBlockType, mEvaluator, width, childNodes, &ioArena);
+    addNodeCount(childNodes.size());
+    if (childNodes.empty())
+    {
+        return inNode->quality();
+    }
+
+    // The children are sorted by quality.
+    if (inIndex + 1 == mWidths.size())
+    {
+        return (*childNodes.begin())->quality();
+    }
+
+    double result = 0;
+    int count = 0;
+    for (ChildNodes::iterator it = childNodes.begin(); it != childNodes.end() && count < width; ++it, ++count)
+    {
+        double value = getExpectedValue(*it, inIndex + 1, inBag, ioArena);
+        if (count == 0 || value > result)
+        {
+            result = value;
+        }
+    }
+    return result;
+}
+
+
+BlockTypes ExpectimaxNodeCalculator::drawFromBag(const BlockTypes& inBag, BlockType inBlockType) const
+{
+    BlockTypes result(inBag);
+    result.erase(std::lower_bound(result.begin(), result.end(), inBlockType));
+    return result.empty() ? mFullBag : result;
+}
+
+
+NodePtr ExpectimaxNodeCalculator::findBestLeaf(const std::vector<NodePtr>& inLeaves, std::vector<double>& outBranchValues)
+{
+    // Each combination of leaf and block type is a separate task.
+    BlockTypes blockTypes(mRemainingBlocks);
+    blockTypes.erase(std::unique(blockTypes.begin(), blockTypes.end()), blockTypes.end());
+
+    std::vector<bool> evaluated(inLeaves.size(), false);
+    outBranchValues.assign(inLeaves.size() * blockTypes.size(), 0);
+    for (std::size_t idx = 0; idx != inLeaves.size(); ++idx)
+    {
+        NodePtr leaf = inLeaves[idx];
+        if (leaf->gameState().isGameOver() || isTransposition(*leaf))
+        {
+            continue;
+        }
+
+        // The tasks of a leaf share its board, so it must be built beforehand.
+        leaf->gameState().materialize();
+        evaluated[idx] = true;
+        for (std::size_t typeIdx = 0; typeIdx != blockTypes.size(); ++typeIdx)
+        {
+            Worker::Task task = boost::bind(&ExpectimaxNodeCalculator::evaluateBranch,
+                                            this,
+                                            leaf,
+                                            blockTypes[typeIdx],
+                                            drawFromBag(mRemainingBlocks, blockTypes[typeIdx]),
+                                            &outBranchValues[idx * blockTypes.size() + typeIdx]);
+            mWorkerPool.schedule(task);
+        }
+    }
+    waitForWorkers();
+    boost::this_thread::interruption_point();
+
+    NodePtr bestLeaf;
+    double bestValue = 0;
+    for (std::size_t idx = 0; idx != inLeaves.size(); ++idx)
+    {
+        NodePtr leaf = inLeaves[idx];
+        double value = 0;
+        if (evaluated[idx])
+        {
+            for (std::size_t typeIdx = 0; typeIdx != blockTypes.size(); ++typeIdx)
+            {
+                std::size_t count = std::upper_bound(mRemainingBlocks.begin(), mRemainingBlocks.end(), blockTypes[typeIdx])
+                                  - std::lower_bound(mRemainingBlocks.begin(), mRemainingBlocks.end(), blockTypes[typeIdx]);
+                value += count * outBranchValues[idx * blockTypes.size() + typeIdx];
+            }
+            value /= mRemainingBlocks.size();
+        }
+        else if (leaf->gameState().isGameOver())
+        {
+            value = leaf->quality();
+        }
+        else
+        {
+            // Same position as an evaluated leaf.
+            continue;
+        }
+
+        if (!bestLeaf || value > bestValue)
+        {
+            bestLeaf = leaf;
+            bestValue = value;
+        }
+    }
+
+    return bestLeaf;
+}
+
+
+void ExpectimaxNodeCalculator::populate()
+{
+    // The tasks write to these, so they must outlive the tasks, including the
+    // ones that are still running after an interrupt.
+    std::vector<ChildNodes> childNodes;
+    std::vector<double> branchValues;
+    try
+    {
+        {
+            // The leaves are scored differently, so the results of a previous search can't be used.
+            ScopedLock lock(mNodeMutex);
+            mNode->clearChildren();
+        }
+
+        //
+        // Search the known blocks breadth-first, keeping the best children of each node.
+        //
+        std::vector<NodePtr> frontier(1, mNode);
+        for (std::size_t index = 0; index != mBlockTypes.size(); ++index)
+        {
+            childNodes.clear();
+            childNodes.resize(frontier.size());
+            for (std::size_t idx = 0; idx != frontier.size(); ++idx)
+            {
+                if (!frontier[idx]->gameState().isGameOver() && !isTransposition(*frontier[idx]))
+                {
+                    Worker::Task task = boost::bind(&ExpectimaxNodeCalculator::expandNode,
+                                                    this,
+                                                    frontier[idx],
+                                                    index,
+                                                    &childNodes[idx]);
+                    mWorkerPool.schedule(task);
+                }
+            }
+            waitForWorkers();
+            boost::this_thread::interruption_point();
+
+            // The nodes of the last known row are scored by the expectimax search below.
+            bool isLeafRow = index + 1 == mBlockTypes.size();
+            bool registerNodes = !isLeafRow || mWidths.size() == mBlockTypes.size();
+
+            ScopedLock lock(mNodeMutex);
+            frontier.clear();
+            for (std::size_t idx = 0; idx != childNodes.size(); ++idx)
+            {
+                int count = 0;
+                ChildNodes::iterator it = childNodes[idx].begin(), end = childNodes[idx].end();
+                for (; it != end && count < mWidths[index]; ++it, ++count)
+                {
+                    NodePtr child = *it;
+                    child->parent()->addChild(child);
+                    frontier.push_back(child);
+                }
+                if (registerNodes && !childNodes[idx].empty())
+                {
+                    mTreeRowInfos.registerNode(*childNodes[idx].begin(), index);
+                }
+            }
+
+            if (frontier.empty())
+            {
+                // All nodes are game over.
+                break;
+            }
+
+            if (registerNodes)
+            {
+                mTreeRowInfos.setFinished();
+            }
+        }
+
+        if (!frontier.empty() && mWidths.size() > mBlockTypes.size())
+        {
+            NodePtr bestLeaf = findBestLeaf(frontier, branchValues);
+            if (bestLeaf)
+            {
+                mTreeRowInfos.registerNode(bestLeaf, mBlockTypes.size() - 1);
+                mTreeRowInfos.setFinished();
+            }
+        }
+    }
+    catch (const boost::thread_interrupted &)
+    {
+        // Task was interrupted. Ok.
+    }
+    //
+    // catch: allow other exceptions pass to the parent handler
+    //
+
+    mWorkerPool.interruptAndClearQueue();
+    mWorkerPool.wait();
+}
+
+
+} // namespace Tetris
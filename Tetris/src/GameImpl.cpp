@@ -5,13 +5,13 @@
 #include "Tetris/GameState.h"
 #include "Tetris/Evaluator.h"
 #include "Tetris/Block.h"
+#include "Tetris/MoveGenerator.h"
 #include "Tetris/Utilities.h"
 #include "Futile/Assert.h"
 #include "Futile/Logging.h"
 #include "Futile/MainThread.h"
 #include "Futile/Threading.h"
 #include "Poco/Exception.h"
-#include "Poco/Random.h"
 #include <algorithm>
 #include <ctime>
 #include <set>
@@ -26,6 +26,7 @@ using Futile::LogError;
 using Futile::LogWarning;
 using Futile::MakeString;
 using Futile::Mutex;
+using Futile::ScopedLock;
 using Futile::Locker;
 using Futile::ThreadSafe;
 
@@ -55,13 +56,21 @@ bool GameImpl::EventHandler::Exists(GameImpl::EventHandler* inEventHandler)
 
 
 GameImpl::Instances GameImpl::sInstances;
+Mutex GameImpl::sInstancesMutex;
 
 
 GameImpl::GameImpl(std::size_t inNumRows, std::size_t inNumColumns) :
+    GameImpl(inNumRows, inNumColumns, new BlockFactory)
+{
+}
+
+
+GameImpl::GameImpl(std::size_t inNumRows, std::size_t inNumColumns, BlockFactory* inBlockFactory) :
     mNumRows(inNumRows),
     mNumColumns(inNumColumns),
     mActiveBlock(),
-    mBlockFactory(new BlockFactory),
+    mBlockFactory(inBlockFactory),
+    mGarbageRandom(mBlockFactory->split()),
     mBlocks(),
     mFutureBlocksCount(3),
     mCurrentBlockIndex(0),
@@ -76,18 +85,21 @@ GameImpl::GameImpl(std::size_t inNumRows, std::size_t inNumColumns) :
     }
     mActiveBlock.reset(CreateDefaultBlock(mBlocks.front(), inNumColumns).release());
 
+    ScopedLock lock(sInstancesMutex);
     sInstances.insert(this);
 }
 
 
 GameImpl::~GameImpl()
 {
+    ScopedLock lock(sInstancesMutex);
     sInstances.erase(this);
 }
 
 
 bool GameImpl::Exists(const GameImpl& inGame)
 {
+    ScopedLock lock(sInstancesMutex);
     return sInstances.find(&inGame) != sInstances.end();
 }
 
@@ -128,6 +140,7 @@ void GameImpl::onChanged()
 
 bool GameImpl::Exists(GameImpl* inGame)
 {
+    ScopedLock lock(sInstancesMutex);
     return sInstances.find(inGame) != sInstances.end();
 }
 
@@ -194,11 +207,7 @@ std::vector<BlockType> GameImpl::getGarbageRow() const
 {
     BlockTypes result(mNumColumns, BlockType_Nil);
 
-    static Poco::UInt32 fSeed = static_cast<Poco::UInt32>(time(0) % Poco::UInt32(-1));
-    fSeed = (fSeed + 1) % Poco::UInt32(-1);
-    Poco::Random rand;
-    rand.seed(fSeed);
-    BlockFactory blockFactory(1);
+    BlockFactory blockFactory(1, mGarbageRandom.split());
 
     static const int cMinCount = 4;
     static const int cMaxCount = 8;
@@ -207,7 +216,7 @@ std::vector<BlockType> GameImpl::getGarbageRow() const
     {
         for (std::size_t idx = 0; idx < mNumColumns; ++idx)
         {
-            if (result[idx] == BlockType_Nil && rand.nextBool())
+            if (result[idx] == BlockType_Nil && mGarbageRandom.nextBool())
             {
                 result[idx] = blockFactory.getNext();
                 if (++count >= cMaxCount)
@@ -282,11 +291,7 @@ void GameImpl::applyLinePenalty(int inLineCount)
 
 std::unique_ptr<Block> GameImpl::CreateDefaultBlock(BlockType inBlockType, std::size_t inNumColumns)
 {
-    return std::unique_ptr<Block>(
-        new Block(inBlockType,
-                    Rotation(0),
-                    Row(0),
-                    Column(DivideByTwo(inNumColumns - GetGrid(GetBlockIdentifier(inBlockType, 0)).columnCount()))));
+    return std::unique_ptr<Block>(new Block(GetSpawnBlock(inBlockType, inNumColumns)));
 }
 
 
@@ -312,6 +317,18 @@ bool GameImpl::isPaused() const
 }
 
 
+void GameImpl::setMuted(bool inMuted)
+{
+    mMuteEvents = inMuted;
+}
+
+
+bool GameImpl::isMuted() const
+{
+    return mMuteEvents;
+}
+
+
 bool GameImpl::isGameOver() const
 {
     return gameState().isGameOver();
@@ -436,6 +453,14 @@ void GameImpl::getFutureBlocksWithOffset(std::size_t inOffset, std::size_t inCou
 }
 
 
+void GameImpl::getBlockBag(std::size_t inOffset, BlockTypes& outFullBag, BlockTypes& outRemainingBlocks)
+{
+    reserveBlocks(inOffset);
+    mBlockFactory->getBag(outFullBag);
+    mBlockFactory->getRemainingBlocks(mBlocks, inOffset, outRemainingBlocks);
+}
+
+
 std::size_t GameImpl::currentBlockIndex() const
 {
     return mCurrentBlockIndex;
@@ -615,6 +640,13 @@ ComputerGame::ComputerGame(std::size_t inNumRows, std::size_t inNumCols) :
 }
 
 
+ComputerGame::ComputerGame(std::size_t inNumRows, std::size_t inNumCols, unsigned inSeed) :
+    GameImpl(inNumRows, inNumCols, new BlockFactory(1, inSeed)),
+    mCurrentNode(GameStateNode::CreateRootNode(inNumRows, inNumCols).release())
+{
+}
+
+
 ComputerGame::ComputerGame(const GameImpl& inGame) :
     GameImpl(inGame.rowCount(), inGame.columnCount()),
     mCurrentNode(new GameStateNode(new GameState(inGame.gameState()), Balanced::Instance()))
@@ -755,7 +787,9 @@ bool ComputerGame::move(MoveDirection inDirection)
         if (!currentNode()->gameState().tainted())
         {
             // The game is untainted. Good, now check if the blocks line up correctly.
-            if (block.column() == nextBlock.column() && nextBlock.identification() == block.identification())
+            if (block.column() == nextBlock.column() &&
+                block.row() == nextBlock.row() &&
+                nextBlock.identification() == block.identification())
             {
                 // Swap the current gamestate with the next precalculated one.
                 if (navigateNodeDown())
@@ -4,18 +4,94 @@
 #include "Tetris/Block.h"
 #include "Tetris/BlockType.h"
 #include "Tetris/Grid.h"
+#include "Futile/Arena.h"
 #include "Futile/Logging.h"
 #include "Futile/MakeString.h"
 #include "Futile/Assert.h"
 #include <algorithm>
+#include <cstring>
 #include <vector>
 
 
 namespace Tetris {
 
 
+static RowMask GetFullRowMask(std::size_t inNumColumns)
+{
+    if (inNumColumns > cMaxColumnCount)
+    {
+        throw std::invalid_argument(Futile::MakeString() << "Column count exceeds the maximum of " << cMaxColumnCount << ": " << inNumColumns);
+    }
+    return inNumColumns == cMaxColumnCount ? RowMask(-1) : (RowMask(1) << inNumColumns) - 1;
+}
+
+
+// Zobrist key of a square. The keys are derived from the position with the
+// SplitMix64 finalizer, so that grids of any size can be hashed without a table.
+static std::uint64_t GetZobristKey(std::size_t inRowIdx, std::size_t inColIdx)
+{
+    std::uint64_t x = (static_cast<std::uint64_t>(inRowIdx) * cMaxColumnCount + inColIdx + 1) * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+
+static std::uint64_t GetRowHash(std::size_t inRowIdx, RowMask inRowMask)
+{
+    std::uint64_t result = 0;
+    for (std::size_t colIdx = 0; inRowMask != 0; ++colIdx, inRowMask >>= 1)
+    {
+        if (inRowMask & 1)
+        {
+            result ^= GetZobristKey(inRowIdx, colIdx);
+        }
+    }
+    return result;
+}
+
+
+GameState::Board* GameState::Board::Create(std::size_t inNumRows, std::size_t inNumColumns)
+{
+    std::unique_ptr<Grid> grid(new Grid(inNumRows, inNumColumns, BlockType_Nil));
+    Board* result = new (::operator new(sizeof(Board) + inNumRows * sizeof(RowMask))) Board;
+    result->mGrid = grid.release();
+    std::fill(result->rowMasks(), result->rowMasks() + inNumRows, 0);
+    return result;
+}
+
+
+GameState::Board* GameState::Board::Copy(const Board& inBoard, std::size_t inNumRows, Futile::Arena* inArena)
+{
+    // The search doesn't need the grid, so it isn't copied into the arena.
+    std::unique_ptr<Grid> grid(inBoard.mGrid && !inArena ? new Grid(*inBoard.mGrid) : 0);
+    std::size_t size = sizeof(Board) + inNumRows * sizeof(RowMask);
+    Board* result = new (inArena ? inArena->allocate(size) : ::operator new(size)) Board;
+    result->mGrid = grid.release();
+    std::copy(inBoard.rowMasks(), inBoard.rowMasks() + inNumRows, result->rowMasks());
+    return result;
+}
+
+
+void GameState::Board::Destroy(Board* inBoard)
+{
+    delete inBoard->mGrid;
+    inBoard->~Board();
+    ::operator delete(inBoard);
+}
+
+
 GameState::GameState(std::size_t inNumRows, std::size_t inNumColumns) :
-    mGrid(inNumRows, inNumColumns, BlockType_Nil),
+    mBoard(Board::Create(inNumRows, inNumColumns)),
+    mArena(0),
+    mNumRows(inNumRows),
+    mNumColumns(inNumColumns),
+    mFullRowMask(GetFullRowMask(inNumColumns)),
+    mParent(0),
+    mClearedRows(0),
+    mNumHoles(0),
+    mNumOccupiedSquares(0),
+    mHash(0),
     mOriginalBlock(BlockType_L, Rotation(0), Row(0), Column(0)),
     mIsGameOver(false),
     mFirstOccupiedRow(inNumRows),
@@ -29,40 +105,117 @@ GameState::GameState(std::size_t inNumRows, std::size_t inNumColumns) :
 }
 
 
+GameState::GameState(const GameState& inGameState) :
+    mBoard(inGameState.mBoard ? Board::Copy(*inGameState.mBoard, inGameState.mNumRows, 0) : 0),
+    mArena(0),
+    mNumRows(inGameState.mNumRows),
+    mNumColumns(inGameState.mNumColumns),
+    mFullRowMask(inGameState.mFullRowMask),
+    mParent(inGameState.mParent),
+    mClearedRows(inGameState.mClearedRows),
+    mNumHoles(inGameState.mNumHoles),
+    mNumOccupiedSquares(inGameState.mNumOccupiedSquares),
+    mHash(inGameState.mHash),
+    mOriginalBlock(inGameState.mOriginalBlock),
+    mIsGameOver(inGameState.mIsGameOver),
+    mFirstOccupiedRow(inGameState.mFirstOccupiedRow),
+    mNumLines(inGameState.mNumLines),
+    mNumSingles(inGameState.mNumSingles),
+    mNumDoubles(inGameState.mNumDoubles),
+    mNumTriples(inGameState.mNumTriples),
+    mNumTetrises(inGameState.mNumTetrises),
+    mTainted(inGameState.mTainted)
+{
+    materialize();
+}
+
+
+GameState::GameState(const GameState& inGameState, Futile::Arena* inArena, const GameState* inParent) :
+    mBoard(inGameState.mBoard ? Board::Copy(*inGameState.mBoard, inGameState.mNumRows, inArena) : 0),
+    mArena(inArena),
+    mNumRows(inGameState.mNumRows),
+    mNumColumns(inGameState.mNumColumns),
+    mFullRowMask(inGameState.mFullRowMask),
+    mParent(inGameState.mBoard ? 0 : inParent),
+    mClearedRows(inGameState.mClearedRows),
+    mNumHoles(inGameState.mNumHoles),
+    mNumOccupiedSquares(inGameState.mNumOccupiedSquares),
+    mHash(inGameState.mHash),
+    mOriginalBlock(inGameState.mOriginalBlock),
+    mIsGameOver(inGameState.mIsGameOver),
+    mFirstOccupiedRow(inGameState.mFirstOccupiedRow),
+    mNumLines(inGameState.mNumLines),
+    mNumSingles(inGameState.mNumSingles),
+    mNumDoubles(inGameState.mNumDoubles),
+    mNumTriples(inGameState.mNumTriples),
+    mNumTetrises(inGameState.mNumTetrises),
+    mTainted(inGameState.mTainted)
+{
+}
+
+
+GameState::~GameState()
+{
+    // The board of a gamestate in an arena is released with the arena.
+    if (mBoard && !mArena)
+    {
+        Board::Destroy(mBoard);
+    }
+}
+
+
+GameState::GameState(const GameState& inParent, const Block& inBlock) :
+    mBoard(0),
+    mArena(0),
+    mNumRows(inParent.mNumRows),
+    mNumColumns(inParent.mNumColumns),
+    mFullRowMask(inParent.mFullRowMask),
+    mParent(&inParent),
+    mClearedRows(0),
+    mNumHoles(inParent.mNumHoles),
+    mNumOccupiedSquares(inParent.mNumOccupiedSquares),
+    mHash(inParent.mHash),
+    mOriginalBlock(inBlock),
+    mIsGameOver(false),
+    mFirstOccupiedRow(inParent.mFirstOccupiedRow),
+    mNumLines(inParent.mNumLines),
+    mNumSingles(inParent.mNumSingles),
+    mNumDoubles(inParent.mNumDoubles),
+    mNumTriples(inParent.mNumTriples),
+    mNumTetrises(inParent.mNumTetrises),
+    mTainted(false)
+{
+}
+
+
 bool GameState::checkPositionValid(const Block& inBlock, std::size_t inRowIdx, std::size_t inColIdx) const
 {
-    const Grid& blockGrid(inBlock.grid());
+    Assert(mBoard);
 
-    if (inColIdx < blockGrid.columnCount() && (inRowIdx + blockGrid.rowCount()) < mFirstOccupiedRow)
+    // Also catches negative values that have wrapped around.
+    if (inRowIdx >= mNumRows || inColIdx >= mNumColumns)
     {
-        return true;
+        return false;
     }
 
-    if (inRowIdx >= mGrid.rowCount())
+    std::size_t blockRowCount = inBlock.rowCount();
+    if (inRowIdx + blockRowCount > mNumRows || inColIdx + inBlock.columnCount() > mNumColumns)
     {
         return false;
     }
 
-    for (std::size_t r = 0; r != blockGrid.rowCount(); ++r)
+    // The rows above mFirstOccupiedRow are empty.
+    if (inRowIdx + blockRowCount <= mFirstOccupiedRow)
     {
-        std::size_t rowIdx = inRowIdx + r;
-        if (rowIdx >= mGrid.rowCount())
-        {
-            return false;
-        }
+        return true;
+    }
 
-        for (std::size_t c = 0; c != blockGrid.columnCount(); ++c)
+    const RowMask* blockMasks = GetRowMasks(inBlock.identification());
+    for (std::size_t r = 0; r != blockRowCount; ++r)
+    {
+        if (mBoard->rowMasks()[inRowIdx + r] & (blockMasks[r] << inColIdx))
         {
-            std::size_t colIdx = inColIdx + c;
-            if (colIdx >= mGrid.columnCount())
-            {
-                return false;
-            }
-
-            if (blockGrid.get(r, c) && mGrid.get(rowIdx, colIdx))
-            {
-                return false;
-            }
+            return false;
         }
     }
     return true;
@@ -71,68 +224,98 @@ bool GameState::checkPositionValid(const Block& inBlock, std::size_t inRowIdx, s
 
 void GameState::solidifyBlock(const Block& inBlock)
 {
+    Grid* gameGrid = mBoard->mGrid;
+    RowMask* rowMasks = mBoard->rowMasks();
     const Grid& grid = inBlock.grid();
+    const RowMask* blockMasks = GetRowMasks(inBlock.identification());
+
+    // Only the block's rows and the row below it can gain or lose holes.
+    std::size_t holesBegin = inBlock.row();
+    std::size_t holesEnd = std::min<std::size_t>(inBlock.row() + grid.rowCount() + 1, mNumRows);
+    mNumHoles -= countHoles(holesBegin, holesEnd);
+
     for (std::size_t r = 0; r != grid.rowCount(); ++r)
     {
+        std::size_t gridRow = inBlock.row() + r;
+        rowMasks[gridRow] |= blockMasks[r] << inBlock.column();
         for (std::size_t c = 0; c != grid.columnCount(); ++c)
         {
             if (grid.get(r, c) != BlockType_Nil)
             {
-                std::size_t gridRow = inBlock.row() + r;
                 std::size_t gridCol = inBlock.column() + c;
-                mGrid.set(gridRow, gridCol, inBlock.type());
-                if (gridRow < mFirstOccupiedRow)
+                if (gameGrid)
                 {
-                    mFirstOccupiedRow = gridRow;
+                    gameGrid->set(gridRow, gridCol, inBlock.type());
                 }
+                mHash ^= GetZobristKey(gridRow, gridCol);
+                mNumOccupiedSquares++;
             }
         }
     }
+    mNumHoles += countHoles(holesBegin, holesEnd);
+
+    // The top row of a block is never empty.
+    if (inBlock.row() < mFirstOccupiedRow)
+    {
+        mFirstOccupiedRow = inBlock.row();
+    }
 }
 
 
 void GameState::clearLines()
 {
+    RowMask* rowMasks = mBoard->rowMasks();
     std::size_t numLines = 0;
+    std::size_t columnCount = mNumColumns;
+    BlockType* gridBegin = mBoard->mGrid ? const_cast<BlockType*>(&(mBoard->mGrid->get(0, 0))) : 0;
     int rowIndex = mOriginalBlock.row() + mOriginalBlock.rowCount() - 1;
     for (; rowIndex >= static_cast<int>(mFirstOccupiedRow); --rowIndex)
     {
-        std::size_t colIndex = 0;
-        bool line = true;
-        for (; colIndex < mGrid.columnCount(); ++colIndex)
+        if (rowMasks[rowIndex] == mFullRowMask)
         {
-            BlockType value = mGrid.get(rowIndex, colIndex);
-            if (numLines > 0)
-            {
-                mGrid.set(rowIndex + numLines, colIndex, value);
-            }
-
-            if (!value)
+            numLines++;
+        }
+        else if (numLines > 0)
+        {
+            // Move the row down.
+            rowMasks[rowIndex + numLines] = rowMasks[rowIndex];
+            if (gridBegin)
             {
-                line = false;
-                if (numLines == 0)
-                {
-                    break;
-                }
+                memcpy(&gridBegin[(rowIndex + numLines) * columnCount],
+                       &gridBegin[rowIndex * columnCount],
+                       columnCount * sizeof(BlockType));
             }
         }
-        if (line)
+    }
+
+    if (numLines > 0)
+    {
+        std::fill(rowMasks + mFirstOccupiedRow, rowMasks + mFirstOccupiedRow + numLines, 0);
+        if (gridBegin)
         {
-            numLines++;
+            memset(&gridBegin[mFirstOccupiedRow * columnCount], 0, numLines * columnCount * sizeof(BlockType));
         }
     }
 
+    Assert(static_cast<int>(mFirstOccupiedRow + numLines) <= static_cast<int>(mNumRows));
+    mFirstOccupiedRow += numLines;
+
     if (numLines > 0)
     {
-        BlockType* gridBegin = const_cast<BlockType*>(&(mGrid.get(mFirstOccupiedRow, 0)));
-        memset(&gridBegin[0], 0, numLines * mGrid.columnCount());
+        // Rows have shifted.
+        mNumHoles = countHoles(mFirstOccupiedRow, mNumRows);
+        mNumOccupiedSquares -= numLines * columnCount;
+        mHash = hashRows(mFirstOccupiedRow, mNumRows);
     }
 
-    Assert(static_cast<int>(mFirstOccupiedRow + numLines) <= static_cast<int>(mGrid.rowCount()));
-    mFirstOccupiedRow += numLines;
-    mNumLines += numLines;
+    updateLineStats(numLines);
+}
 
-    switch (numLines)
+
+void GameState::updateLineStats(std::size_t inNumLines)
+{
+    mNumLines += inNumLines;
+    switch (inNumLines)
     {
         case 0:
         {
@@ -175,14 +358,24 @@ bool GameState::isGameOver() const
 
 const Grid& GameState::grid() const
 {
-    return mGrid;
+    Assert(hasGrid());
+    return *mBoard->mGrid;
 }
 
 
 void GameState::setGrid(const Grid& inGrid)
 {
-    Assert(mGrid.rowCount() == inGrid.rowCount() && mGrid.columnCount() == inGrid.columnCount());
-    mGrid = inGrid;
+    Assert(mNumRows == inGrid.rowCount() && mNumColumns == inGrid.columnCount());
+    Assert(!mArena);
+    materialize();
+    if (mBoard->mGrid)
+    {
+        *mBoard->mGrid = inGrid;
+    }
+    else
+    {
+        mBoard->mGrid = new Grid(inGrid);
+    }
     mTainted = true;
     updateCache();
 }
@@ -196,18 +389,52 @@ bool GameState::tainted() const
 
 void GameState::updateCache()
 {
-    mFirstOccupiedRow = 0;
-    while (mFirstOccupiedRow < mGrid.rowCount())
+    Assert(hasGrid());
+    const Grid& grid = *mBoard->mGrid;
+    mFirstOccupiedRow = mNumRows;
+    mNumOccupiedSquares = 0;
+    for (std::size_t rowIndex = mNumRows; rowIndex-- != 0; )
     {
-        for (std::size_t colIndex = 0; colIndex != mGrid.columnCount(); ++colIndex)
+        RowMask mask = 0;
+        for (std::size_t colIndex = 0; colIndex != mNumColumns; ++colIndex)
         {
-            if (mGrid.get(mFirstOccupiedRow, colIndex) != BlockType_Nil)
+            if (grid.get(rowIndex, colIndex) != BlockType_Nil)
             {
-                return;
+                mask |= RowMask(1) << colIndex;
             }
         }
-        mFirstOccupiedRow++;
+        mBoard->rowMasks()[rowIndex] = mask;
+        mNumOccupiedSquares += CountSquares(mask);
+        if (mask != 0)
+        {
+            mFirstOccupiedRow = rowIndex;
+        }
+    }
+    mNumHoles = countHoles(mFirstOccupiedRow, mNumRows);
+    mHash = hashRows(mFirstOccupiedRow, mNumRows);
+}
+
+
+int GameState::countHoles(std::size_t inBeginRow, std::size_t inEndRow) const
+{
+    const RowMask* rowMasks = mBoard->rowMasks();
+    int result = 0;
+    for (std::size_t rowIndex = std::max<std::size_t>(inBeginRow, 1); rowIndex < inEndRow; ++rowIndex)
+    {
+        result += CountSquares(rowMasks[rowIndex - 1] & ~rowMasks[rowIndex]);
     }
+    return result;
+}
+
+
+std::uint64_t GameState::hashRows(std::size_t inBeginRow, std::size_t inEndRow) const
+{
+    std::uint64_t result = 0;
+    for (std::size_t rowIndex = inBeginRow; rowIndex < inEndRow; ++rowIndex)
+    {
+        result ^= GetRowHash(rowIndex, rowMask(rowIndex));
+    }
+    return result;
 }
 
 
@@ -228,47 +455,169 @@ const Block& GameState::originalBlock() const
 
 std::unique_ptr<GameState> GameState::commit(const Block& inBlock, GameOver inGameOver) const
 {
+    Assert(mBoard);
     std::unique_ptr<GameState> result(new GameState(*this));
-    result->mIsGameOver = inGameOver.get();
-    result->mTainted = false; // a new generation, a new start
+    result->commitCopy(inBlock, inGameOver);
+    return result;
+}
+
+
+GameState* GameState::commit(const Block& inBlock, GameOver inGameOver, Futile::Arena& inArena) const
+{
+    Assert(mBoard);
+    GameState* result = new (inArena.allocate(sizeof(GameState))) GameState(*this, &inArena, 0);
+    result->commitCopy(inBlock, inGameOver);
+    return result;
+}
+
+
+void GameState::commitCopy(const Block& inBlock, GameOver inGameOver)
+{
+    mIsGameOver = inGameOver.get();
+    mTainted = false; // a new generation, a new start
     if (!inGameOver.get())
     {
-        result->solidifyBlock(inBlock);
+        solidifyBlock(inBlock);
     }
-    result->mOriginalBlock = inBlock;
-    result->clearLines();
+    mOriginalBlock = inBlock;
+    clearLines();
+}
+
+
+std::unique_ptr<GameState> GameState::commitDelta(const Block& inBlock) const
+{
+    std::unique_ptr<GameState> result(new GameState(*this, inBlock));
+    initDelta(*result);
     return result;
 }
 
 
-EvaluatedGameState::EvaluatedGameState(GameState* inGameState, int inQuality) :
-    mGameState(inGameState),
-    mQuality(inQuality)
+GameState* GameState::commitDelta(const Block& inBlock, Futile::Arena& inArena) const
 {
+    GameState* result = new (inArena.allocate(sizeof(GameState))) GameState(*this, inBlock);
+    result->mArena = &inArena;
+    initDelta(*result);
+    return result;
 }
 
 
-EvaluatedGameState::~EvaluatedGameState()
+GameState* GameState::copy(Futile::Arena& inArena, const GameState* inParent) const
 {
-    delete mGameState;
+    Assert(mBoard || inParent);
+    return new (inArena.allocate(sizeof(GameState))) GameState(*this, &inArena, inParent);
 }
 
 
-const GameState& EvaluatedGameState::gameState() const
+void GameState::initDelta(GameState& ioChild) const
 {
-    return *mGameState;
+    Assert(mBoard && ioChild.mParent == this);
+    const Block& block = ioChild.mOriginalBlock;
+    const RowMask* rowMasks = mBoard->rowMasks();
+    const RowMask* blockMasks = GetRowMasks(block.identification());
+    std::size_t blockRow = block.row();
+    std::size_t blockEnd = blockRow + block.rowCount();
+
+    // Walk the block's rows from top to bottom and count the holes between
+    // the rows that remain after clearing lines. Only the pairs of rows from
+    // the row above the block to the row below it are affected.
+    int numHoles = mNumHoles - countHoles(blockRow, std::min(blockEnd + 1, mNumRows));
+    int numSquares = 0;
+    std::uint64_t blockHash = 0;
+    unsigned clearedRows = 0;
+    std::size_t numLines = 0;
+    bool hasAbove = blockRow > 0;
+    RowMask above = hasAbove ? rowMasks[blockRow - 1] : 0;
+    for (std::size_t r = blockRow; r != blockEnd; ++r)
+    {
+        RowMask blockMask = blockMasks[r - blockRow] << block.column();
+        numSquares += CountSquares(blockMask);
+        blockHash ^= GetRowHash(r, blockMask);
+        RowMask mask = rowMasks[r] | blockMask;
+        if (mask == mFullRowMask)
+        {
+            clearedRows |= 1u << (r - blockRow);
+            numLines++;
+            continue;
+        }
+        if (hasAbove)
+        {
+            numHoles += CountSquares(above & ~mask);
+        }
+        above = mask;
+        hasAbove = true;
+    }
+    if (blockEnd < mNumRows && hasAbove)
+    {
+        numHoles += CountSquares(above & ~rowMasks[blockEnd]);
+    }
+
+    ioChild.mClearedRows = clearedRows;
+    ioChild.mNumHoles = numHoles;
+    ioChild.mNumOccupiedSquares = mNumOccupiedSquares + numSquares - numLines * mNumColumns;
+    ioChild.mFirstOccupiedRow = std::min(mFirstOccupiedRow, blockRow) + numLines;
+    ioChild.updateLineStats(numLines);
+
+    // Cleared lines move the rows above them, which changes their keys.
+    ioChild.mHash = numLines == 0 ? mHash ^ blockHash
+                                  : mHash ^ hashRows(mFirstOccupiedRow, blockEnd) ^ ioChild.hashRows(ioChild.mFirstOccupiedRow, blockEnd);
 }
 
 
-GameState& EvaluatedGameState::gameState()
+void GameState::materialize()
 {
-    return *mGameState;
+    if (mBoard)
+    {
+        return;
+    }
+
+    // Replay the commit on a copy of the parent. The delta already knows
+    // the statistics, so the replay must arrive at the same ones and only
+    // its board is taken over. This gamestate isn't touched until then.
+    Assert(mParent && mParent->mBoard);
+    GameState replay(*mParent, mArena, 0);
+    replay.commitCopy(mOriginalBlock, GameOver(false));
+    Assert(replay.mHash == mHash);
+    Assert(replay.mNumHoles == mNumHoles);
+    Assert(replay.mNumOccupiedSquares == mNumOccupiedSquares);
+    Assert(replay.mFirstOccupiedRow == mFirstOccupiedRow);
+    Assert(replay.mNumLines == mNumLines);
+
+    // The board is in the same arena as this gamestate, if any.
+    mBoard = replay.mBoard;
+    replay.mBoard = 0;
+    mParent = 0;
+    mClearedRows = 0;
 }
 
 
-int EvaluatedGameState::quality() const
+RowMask GameState::getDeltaRowMask(std::size_t inRowIdx) const
 {
-    return mQuality;
+    Assert(mParent);
+    std::size_t blockRow = mOriginalBlock.row();
+    std::size_t blockEnd = blockRow + mOriginalBlock.rowCount();
+    if (inRowIdx >= blockEnd)
+    {
+        return mParent->rowMask(inRowIdx);
+    }
+
+    // The rows of the block that were not cleared keep their order.
+    const RowMask* blockMasks = GetRowMasks(mOriginalBlock.identification());
+    std::size_t childRow = blockEnd;
+    for (std::size_t r = blockEnd; r-- != blockRow; )
+    {
+        if (mClearedRows & (1u << (r - blockRow)))
+        {
+            continue;
+        }
+        if (--childRow == inRowIdx)
+        {
+            return mParent->rowMask(r) | (blockMasks[r - blockRow] << mOriginalBlock.column());
+        }
+    }
+
+    // The rows above the block moved down by the number of cleared lines.
+    std::size_t numLines = childRow - blockRow;
+    return inRowIdx < numLines ? 0 : mParent->rowMask(inRowIdx - numLines);
 }
 
 
@@ -6,8 +6,6 @@
 #include "Tetris/Block.h"
 #include "Tetris/Utilities.h"
 #include "Futile/Assert.h"
-#include <set>
-#include <boost/scoped_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 
 
@@ -21,34 +19,52 @@ static int GetIdentifier(const GameState& inGameState)
 }
 
 
-struct GameStateNode::Impl
+void ChildNodes::insert(const NodePtr& inNode)
 {
-    Impl(NodePtr inParent, GameState*  inGameState, const Evaluator& inEvaluator) :
-        mParent(inParent),
-        mIdentifier(GetIdentifier(*inGameState)),
-        mDepth(inParent->depth() + 1),
-        mEvaluatedGameState(),
-        mEvaluator(inEvaluator),
-        mChildren()
+    // Search from the back, because most nodes are inserted in order.
+    int quality = inNode->quality();
+    Nodes::iterator it = mNodes.end();
+    while (it != mNodes.begin() && (*(it - 1))->quality() < quality)
     {
-        mEvaluatedGameState.reset(new EvaluatedGameState(inGameState, inEvaluator.evaluate(*inGameState)));
+        --it;
     }
+    mNodes.insert(it, inNode);
+}
+
 
-    Impl(GameState* inGameState, const Evaluator& inEvaluator) :
+struct GameStateNode::Impl
+{
+    Impl(NodePtr inParent, GameState*  inGameState, int inQuality, const Evaluator& inEvaluator, Futile::Arena* inArena) :
         mParent(),
+        mRawParent(inParent && (inArena || inParent.use_count() == 0) ? inParent.get() : 0),
         mIdentifier(GetIdentifier(*inGameState)),
-        mDepth(0),
-        mEvaluatedGameState(),
+        mDepth(inParent ? inParent->depth() + 1 : 0),
+        mGameState(inGameState),
+        mQuality(inQuality),
         mEvaluator(inEvaluator),
-        mChildren()
+        mChildren(inArena)
+    {
+        if (!mRawParent)
+        {
+            mParent = inParent;
+        }
+    }
+
+    // Only called for nodes on the heap. Nodes in an arena are never destroyed.
+    ~Impl()
     {
-        mEvaluatedGameState.reset(new EvaluatedGameState(inGameState, inEvaluator.evaluate(*inGameState)));
+        delete mGameState;
     }
 
+    // Heap nodes hold a reference counted parent by a weak pointer. Nodes in
+    // an arena are never destroyed, so they would keep its count alive. They
+    // point to their parent directly, like the children of arena nodes do.
     boost::weak_ptr<GameStateNode> mParent;
+    GameStateNode* mRawParent;
     int mIdentifier;
     int mDepth;
-    boost::scoped_ptr<EvaluatedGameState> mEvaluatedGameState;
+    GameState* mGameState;
+    int mQuality;
     const Evaluator& mEvaluator;            // }
     ChildNodes mChildren;                    // } => Order matters!
 };
@@ -62,29 +78,53 @@ std::unique_ptr<GameStateNode> GameStateNode::CreateRootNode(std::size_t inNumRo
 }
 
 
+NodePtr GameStateNode::Create(Futile::Arena& inArena,
+                              NodePtr inParent,
+                              GameState* inGameState,
+                              int inQuality,
+                              const Evaluator& inEvaluator)
+{
+    // The pointer doesn't own the node, so copying it doesn't touch a reference count.
+    GameStateNode* node = new (inArena.allocate(sizeof(GameStateNode))) GameStateNode(inArena, inParent, inGameState, inQuality, inEvaluator);
+    return NodePtr(NodePtr(), node);
+}
+
+
 GameStateNode::GameStateNode(GameState*  inGameState, const Evaluator&  inEvaluator) :
-    mImpl(new Impl(inGameState, inEvaluator))
+    mImpl(new Impl(NodePtr(), inGameState, inEvaluator.evaluate(*inGameState), inEvaluator, 0))
 {
 }
 
 
 GameStateNode::GameStateNode(NodePtr inParent, GameState*  inGameState, const Evaluator&  inEvaluator) :
-    mImpl(new Impl(inParent, inGameState, inEvaluator))
+    mImpl(new Impl(inParent, inGameState, inEvaluator.evaluate(*inGameState), inEvaluator, 0))
+{
+}
+
+
+GameStateNode::GameStateNode(NodePtr inParent, GameState*  inGameState, int inQuality, const Evaluator&  inEvaluator) :
+    mImpl(new Impl(inParent, inGameState, inQuality, inEvaluator, 0))
+{
+}
+
+
+GameStateNode::GameStateNode(Futile::Arena& inArena, NodePtr inParent, GameState*  inGameState, int inQuality, const Evaluator&  inEvaluator) :
+    mImpl(new (inArena.allocate(sizeof(Impl))) Impl(inParent, inGameState, inQuality, inEvaluator, &inArena))
 {
 }
 
 
 GameStateNode::~GameStateNode()
 {
-    mImpl.reset();
+    delete mImpl;
 }
 
 
 std::unique_ptr<GameStateNode> GameStateNode::clone() const
 {
-    NodePtr parent = mImpl->mParent.lock();
-    std::unique_ptr<GameStateNode> result(parent ? new GameStateNode(parent, new GameState(mImpl->mEvaluatedGameState->gameState()), mImpl->mEvaluator)
-                                               : new GameStateNode(new GameState(mImpl->mEvaluatedGameState->gameState()), mImpl->mEvaluator));
+    NodePtr parent = this->parent();
+    std::unique_ptr<GameStateNode> result(parent ? new GameStateNode(parent, new GameState(*mImpl->mGameState), mImpl->mEvaluator)
+                                               : new GameStateNode(new GameState(*mImpl->mGameState), mImpl->mEvaluator));
     result->mImpl->mDepth = mImpl->mDepth;
 
     ChildNodes::const_iterator it = mImpl->mChildren.begin(), end = mImpl->mChildren.end();
@@ -99,6 +139,31 @@ std::unique_ptr<GameStateNode> GameStateNode::clone() const
 }
 
 
+NodePtr GameStateNode::clone(const Futile::ArenaPtr& inArena) const
+{
+    // The copy has no parent, so its gamestate can't be a delta.
+    mImpl->mGameState->materialize();
+    NodePtr copy = copyTo(*inArena, NodePtr());
+    return NodePtr(inArena, copy.get());
+}
+
+
+NodePtr GameStateNode::copyTo(Futile::Arena& inArena, NodePtr inParent) const
+{
+    const GameState* parentState = inParent ? &inParent->gameState() : 0;
+    NodePtr result = Create(inArena, inParent, mImpl->mGameState->copy(inArena, parentState), mImpl->mQuality, mImpl->mEvaluator);
+    result->mImpl->mDepth = mImpl->mDepth;
+
+    const ChildNodes& children = mImpl->mChildren;
+    result->mImpl->mChildren.reserve(children.size());
+    for (ChildNodes::const_iterator it = children.begin(); it != children.end(); ++it)
+    {
+        result->mImpl->mChildren.insert((*it)->copyTo(inArena, result));
+    }
+    return result;
+}
+
+
 int GameStateNode::identifier() const
 {
     return mImpl->mIdentifier;
@@ -113,13 +178,19 @@ const Evaluator& GameStateNode::evaluator() const
 
 const GameState& GameStateNode::gameState() const
 {
-    return mImpl->mEvaluatedGameState->gameState();
+    return *mImpl->mGameState;
+}
+
+
+GameState& GameStateNode::gameState()
+{
+    return *mImpl->mGameState;
 }
 
 
 int GameStateNode::quality() const
 {
-    return mImpl->mEvaluatedGameState->quality();
+    return mImpl->mQuality;
 }
 
 
@@ -150,13 +221,13 @@ void GameStateNode::addChild(NodePtr inChildNode)
 
 NodePtr GameStateNode::parent()
 {
-    return mImpl->mParent.lock();
+    return mImpl->mRawParent ? NodePtr(NodePtr(), mImpl->mRawParent) : mImpl->mParent.lock();
 }
 
 
 const NodePtr GameStateNode::parent() const
 {
-    return mImpl->mParent.lock();
+    return mImpl->mRawParent ? NodePtr(NodePtr(), mImpl->mRawParent) : mImpl->mParent.lock();
 }
 
 
@@ -168,7 +239,10 @@ int GameStateNode::depth() const
 
 void GameStateNode::makeRoot()
 {
+    // The gamestate may still depend on the parent's board.
+    mImpl->mGameState->materialize();
     mImpl->mParent.reset();
+    mImpl->mRawParent = 0;
 }
 
 
@@ -0,0 +1,331 @@
+#include "Tetris/Config.h"
+#include "Tetris/MoveGenerator.h"
+#include "Tetris/GameState.h"
+#include "Tetris/Grid.h"
+#include "Tetris/Utilities.h"
+#include "Futile/Assert.h"
+#include <algorithm>
+
+
+namespace Tetris {
+
+
+namespace { // anonymous
+
+
+// Gets the columns in which each rotation of the block fits, for every row.
+// Bit c of outFits[rotation * (rowCount + 1) + row] is set if the top-left square
+// of the block can be at (row, c). The extra row is empty, it is below the grid.
+void GetFits(const GameState& inGameState, BlockType inBlockType, std::vector<RowMask>& outFits)
+{
+    const std::size_t rowCount = inGameState.rowCount();
+    const std::size_t rotationCount = GetBlockRotationCount(inBlockType);
+    const std::size_t firstOccupiedRow = inGameState.firstOccupiedRow();
+    outFits.assign(rotationCount * (rowCount + 1), 0);
+
+    for (std::size_t rotation = 0; rotation != rotationCount; ++rotation)
+    {
+        int id = GetBlockIdentifier(inBlockType, rotation);
+        const Grid& grid = GetGrid(id);
+        const RowMask* blockMasks = GetRowMasks(id);
+        const std::size_t blockRowCount = grid.rowCount();
+        const RowMask columns = inGameState.fullRowMask() >> (grid.columnCount() - 1);
+        RowMask* fits = &outFits[rotation * (rowCount + 1)];
+
+        for (std::size_t row = 0; row + blockRowCount <= rowCount; ++row)
+        {
+            // The square in column b of the block hits the board if the board
+            // has a square in column c + b, which is bit c of the board row >> b.
+            RowMask collisions = 0;
+            if (row + blockRowCount > firstOccupiedRow)
+            {
+                for (std::size_t r = 0; r != blockRowCount; ++r)
+                {
+                    RowMask boardRow = inGameState.rowMask(row + r);
+                    RowMask blockRow = blockMasks[r];
+                    for (std::size_t b = 0; blockRow != 0; ++b, blockRow >>= 1)
+                    {
+                        if (blockRow & 1)
+                        {
+                            collisions |= boardRow >> b;
+                        }
+                    }
+                }
+            }
+            fits[row] = columns & ~collisions;
+        }
+    }
+}
+
+
+// Adds the columns that can be reached from inSeed by moving left and right within inFits.
+RowMask Spread(RowMask inSeed, RowMask inFits)
+{
+    RowMask result = inSeed & inFits;
+    RowMask previous = 0;
+    while (result != previous)
+    {
+        previous = result;
+        result |= ((result << 1) | (result >> 1)) & inFits;
+    }
+    return result;
+}
+
+
+// Breadth-first search over the (rotation, row, column) states of a block.
+// The state index is (rotation * rowCount + row) * columnCount + column.
+class PathSearch
+{
+public:
+    PathSearch(const GameState& inGameState, const Block& inStart) :
+        mRowCount(inGameState.rowCount()),
+        mColumnCount(inGameState.columnCount()),
+        mRotationCount(GetBlockRotationCount(inStart.type())),
+        mFits(),
+        mParents(mRotationCount * mRowCount * mColumnCount, -1),
+        mInputs(mParents.size(), Input_Down)
+    {
+        GetFits(inGameState, inStart.type(), mFits);
+        if (!fits(inStart.rotation(), inStart.row(), inStart.column()) || inStart.row() >= mRowCount)
+        {
+            return;
+        }
+
+        std::vector<int> queue;
+        queue.reserve(mParents.size());
+        int startIndex = index(inStart.rotation(), inStart.row(), inStart.column());
+        mParents[startIndex] = startIndex;
+        queue.push_back(startIndex);
+        for (std::size_t next = 0; next != queue.size(); ++next)
+        {
+            int current = queue[next];
+            std::size_t column = current % mColumnCount;
+            std::size_t row = (current / mColumnCount) % mRowCount;
+            std::size_t rotation = current / (mColumnCount * mRowCount);
+
+            visit(queue, current, (rotation + 1) % mRotationCount, row, column, Input_Rotate);
+            visit(queue, current, rotation, row, column - 1, Input_Left);
+            visit(queue, current, rotation, row, column + 1, Input_Right);
+            visit(queue, current, rotation, row + 1, column, Input_Down);
+        }
+    }
+
+    // A reachable state where the block can't move down.
+    bool isResting(std::size_t inRotation, std::size_t inRow, std::size_t inColumn) const
+    {
+        return mParents[index(inRotation, inRow, inColumn)] != -1 && !fits(inRotation, inRow + 1, inColumn);
+    }
+
+    bool getPath(std::size_t inRotation, std::size_t inRow, std::size_t inColumn, Inputs& outInputs) const
+    {
+        outInputs.clear();
+        int current = index(inRotation, inRow, inColumn);
+        if (mParents[current] == -1)
+        {
+            return false;
+        }
+        while (mParents[current] != current)
+        {
+            outInputs.push_back(mInputs[current]);
+            current = mParents[current];
+        }
+        std::reverse(outInputs.begin(), outInputs.end());
+        return true;
+    }
+
+    std::size_t rowCount() const { return mRowCount; }
+
+    std::size_t columnCount() const { return mColumnCount; }
+
+    std::size_t rotationCount() const { return mRotationCount; }
+
+private:
+    int index(std::size_t inRotation, std::size_t inRow, std::size_t inColumn) const
+    {
+        return static_cast<int>((inRotation * mRowCount + inRow) * mColumnCount + inColumn);
+    }
+
+    // Also rejects columns that have wrapped around.
+    bool fits(std::size_t inRotation, std::size_t inRow, std::size_t inColumn) const
+    {
+        return inRow <= mRowCount &&
+               inColumn < mColumnCount &&
+               (mFits[inRotation * (mRowCount + 1) + inRow] & (RowMask(1) << inColumn)) != 0;
+    }
+
+    void visit(std::vector<int>& ioQueue,
+               int inParent,
+               std::size_t inRotation,
+               std::size_t inRow,
+               std::size_t inColumn,
+               Input inInput)
+    {
+        if (!fits(inRotation, inRow, inColumn))
+        {
+            return;
+        }
+        int state = index(inRotation, inRow, inColumn);
+        if (mParents[state] == -1)
+        {
+            mParents[state] = inParent;
+            mInputs[state] = inInput;
+            ioQueue.push_back(state);
+        }
+    }
+
+    std::size_t mRowCount;
+    std::size_t mColumnCount;
+    std::size_t mRotationCount;
+    std::vector<RowMask> mFits;
+    std::vector<int> mParents;
+    std::vector<Input> mInputs;
+};
+
+
+} // anonymous namespace
+
+
+Block GetSpawnBlock(BlockType inBlockType, std::size_t inColumnCount)
+{
+    std::size_t blockColumnCount = GetGrid(GetBlockIdentifier(inBlockType, 0)).columnCount();
+    return Block(inBlockType, Rotation(0), Row(0), Column(DivideByTwo(inColumnCount - blockColumnCount)));
+}
+
+
+void GetReachablePlacements(const GameState& inGameState,
+                            BlockType inBlockType,
+                            std::vector<Block>& outPlacements)
+{
+    outPlacements.clear();
+
+    const std::size_t rowCount = inGameState.rowCount();
+    const std::size_t columnCount = inGameState.columnCount();
+    const std::size_t rotationCount = GetBlockRotationCount(inBlockType);
+    const std::size_t stride = rowCount + 1;
+
+    // The first half holds the fits, the second half the reachable columns.
+    std::vector<RowMask> masks;
+    GetFits(inGameState, inBlockType, masks);
+    masks.resize(2 * masks.size(), 0);
+    const RowMask* fits = &masks[0];
+    RowMask* reach = &masks[rotationCount * stride];
+
+    Block spawn = GetSpawnBlock(inBlockType, columnCount);
+    reach[0] = fits[0] & (RowMask(1) << spawn.column());
+    if (reach[0] == 0)
+    {
+        return;
+    }
+
+    // Blocks of any rotation fit everywhere in the rows above the stack, so from the
+    // spawn position they can reach every column there. A block is at most four rows high.
+    const std::size_t firstOccupiedRow = inGameState.firstOccupiedRow();
+    const std::size_t openRowCount = firstOccupiedRow >= 4 ? firstOccupiedRow - 3 : 0;
+    for (std::size_t rotation = 0; rotation != rotationCount; ++rotation)
+    {
+        std::copy(fits + rotation * stride, fits + rotation * stride + openRowCount, reach + rotation * stride);
+    }
+
+    // Blocks can't move up, so each row only depends on the rows above it.
+    for (std::size_t row = openRowCount == 0 ? 0 : openRowCount - 1; row != rowCount; ++row)
+    {
+        // Move left, right and rotate until nothing new is reached in this row.
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (std::size_t rotation = 0; rotation != rotationCount; ++rotation)
+            {
+                RowMask& current = reach[rotation * stride + row];
+                current = Spread(current, fits[rotation * stride + row]);
+
+                std::size_t nextRotation = (rotation + 1) % rotationCount;
+                RowMask& rotated = reach[nextRotation * stride + row];
+                RowMask newRotated = rotated | (current & fits[nextRotation * stride + row]);
+                if (newRotated != rotated)
+                {
+                    rotated = newRotated;
+                    changed = true;
+                }
+            }
+        }
+
+        bool any = false;
+        for (std::size_t rotation = 0; rotation != rotationCount; ++rotation)
+        {
+            RowMask down = reach[rotation * stride + row] & fits[rotation * stride + row + 1];
+            reach[rotation * stride + row + 1] = down;
+            any = any || down != 0;
+        }
+        if (!any)
+        {
+            break;
+        }
+    }
+
+    for (std::size_t column = 0; column != columnCount; ++column)
+    {
+        const RowMask bit = RowMask(1) << column;
+        for (std::size_t rotation = 0; rotation != rotationCount; ++rotation)
+        {
+            // A block in the open rows can still move down.
+            for (std::size_t row = openRowCount == 0 ? 0 : openRowCount - 1; row != rowCount; ++row)
+            {
+                std::size_t idx = rotation * stride + row;
+                if ((reach[idx] & bit) && !(fits[idx + 1] & bit))
+                {
+                    outPlacements.push_back(Block(inBlockType, Rotation(rotation), Row(row), Column(column)));
+                }
+            }
+        }
+    }
+}
+
+
+void GetReachablePlacements(const GameState& inGameState,
+                            BlockType inBlockType,
+                            std::vector<Block>& outPlacements,
+                            std::vector<Inputs>& outPaths)
+{
+    outPlacements.clear();
+    outPaths.clear();
+
+    PathSearch search(inGameState, GetSpawnBlock(inBlockType, inGameState.columnCount()));
+    for (std::size_t column = 0; column != search.columnCount(); ++column)
+    {
+        for (std::size_t rotation = 0; rotation != search.rotationCount(); ++rotation)
+        {
+            for (std::size_t row = 0; row != search.rowCount(); ++row)
+            {
+                if (search.isResting(rotation, row, column))
+                {
+                    outPlacements.push_back(Block(inBlockType, Rotation(rotation), Row(row), Column(column)));
+                    outPaths.push_back(Inputs());
+                    search.getPath(rotation, row, column, outPaths.back());
+                }
+            }
+        }
+    }
+}
+
+
+bool FindPath(const GameState& inGameState, const Block& inTarget, Inputs& outInputs)
+{
+    return FindPath(inGameState, GetSpawnBlock(inTarget.type(), inGameState.columnCount()), inTarget, outInputs);
+}
+
+
+bool FindPath(const GameState& inGameState, const Block& inStart, const Block& inTarget, Inputs& outInputs)
+{
+    Assert(inStart.type() == inTarget.type());
+    PathSearch search(inGameState, inStart);
+    if (inTarget.row() >= search.rowCount() || inTarget.column() >= search.columnCount())
+    {
+        outInputs.clear();
+        return false;
+    }
+    return search.getPath(inTarget.rotation(), inTarget.row(), inTarget.column(), outInputs);
+}
+
+
+} // namespace Tetris
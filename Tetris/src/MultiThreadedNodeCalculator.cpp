@@ -12,6 +12,7 @@
 #include "Futile/MakeString.h"
 #include "Futile/Threading.h"
 #include <boost/shared_ptr.hpp>
+#include <exception>
 #include <memory>
 #include <stdexcept>
 
@@ -19,18 +20,23 @@
 namespace Tetris {
 
 
-using Futile::LogWarning;
 using Futile::ScopedLock;
 using Futile::Worker;
 using Futile::WorkerPool;
 
 
-MultithreadedNodeCalculator::MultithreadedNodeCalculator(std::unique_ptr<GameStateNode> inNode,
+MultithreadedNodeCalculator::MultithreadedNodeCalculator(NodePtr inNode,
                                                          const BlockTypes& inBlockTypes,
                                                          const std::vector<int>& inWidths,
                                                          const Evaluator& inEvaluator,
                                                          WorkerPool& inWorkerPool) :
-    NodeCalculatorImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool)
+    NodeCalculatorImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool),
+    mExpandedNodes(),
+    mPendingCounts(),
+    mFinishedRowCount(0),
+    mExpandError(),
+    mExpandMutex(),
+    mExpandCondition()
 {
 }
 
@@ -43,85 +49,85 @@ MultithreadedNodeCalculator::~MultithreadedNodeCalculator()
 }
 
 
-void MultithreadedNodeCalculator::generateChildNodes(NodePtr ioNode,
-                                                     const Evaluator* inEvaluator,
-                                                     BlockType inBlockType,
-                                                     int /*inDepth*/,
-                                                     int inWidth)
+std::size_t MultithreadedNodeCalculator::generateChildren(NodePtr ioNode, std::size_t inRow)
 {
-    ChildNodes childNodes;
-    GenerateOffspring(ioNode, inBlockType, *inEvaluator, childNodes);
-    if (childNodes.empty())
+    // GameOver state has no children.
+    // A node that was expanded by a previous search keeps its children.
+    if (ioNode->gameState().isGameOver() || (ioNode->children().empty() && isTransposition(*ioNode)))
     {
-        throw std::logic_error("GenerateOffspring produced zero children. This should not happen!");
+        return 0;
     }
 
-    int count = 0;
-    ChildNodes::iterator it = childNodes.begin(), end = childNodes.end();
-    while (count < inWidth && it != end)
+    if (ioNode->children().empty())
     {
-        ioNode->addChild(*it);
-        ++count;
-        ++it;
+        GenerateOffspring(ioNode, mBlockTypes[inRow], mEvaluator, mWidths[inRow], ioNode->children(), mArena.get());
+        if (ioNode->children().empty())
+        {
+            throw std::logic_error("GenerateOffspring produced zero children. This should not happen!");
+        }
+        addNodeCount(ioNode->children().size());
     }
-    mTreeRowInfos.registerNode(*ioNode->children().begin());
+    mTreeRowInfos.registerNode(*ioNode->children().begin(), inRow);
+
+    // The children of the last row are not expanded.
+    return inRow + 1 < mBlockTypes.size() ? ioNode->children().size() : 0;
 }
 
 
-void MultithreadedNodeCalculator::populateNodes(NodePtr ioNode,
-                                                const BlockTypes& inBlockTypes,
-                                                const std::vector<int>& inWidths,
-                                                std::size_t inIndex,
-                                                std::size_t inEndIndex)
+void MultithreadedNodeCalculator::expandNode(NodePtr ioNode, std::size_t inRow)
 {
-
-    // We want to at least perform a search of depth 1.
-    if (inIndex > 0)
+    // Number of children that will be expanded in turn.
+    std::size_t childCount = 0;
+    try
     {
-        boost::this_thread::interruption_point();
+        childCount = generateChildren(ioNode, inRow);
     }
+    catch (const boost::thread_interrupted &)
+    {
+        finishExpansion(ioNode, inRow, 0);
+        throw;
+    }
+    catch (...)
+    {
+        // The worker must survive, and populate() must not wait for this
+        // expansion forever. It rethrows the exception instead.
+        ScopedLock lock(mExpandMutex);
+        if (!mExpandError)
+        {
+            mExpandError = std::current_exception();
+        }
+    }
+    finishExpansion(ioNode, inRow, childCount);
+}
 
 
-    if (ioNode->gameState().isGameOver())
+void MultithreadedNodeCalculator::finishExpansion(NodePtr ioNode, std::size_t inRow, std::size_t inChildCount)
+{
+    ScopedLock lock(mExpandMutex);
+
+    // Count the children before this expansion completes, so
+    // that the next row can't finish before they are scheduled.
+    if (inChildCount > 0)
     {
-        // GameOver state has no children.
-        return;
+        mPendingCounts[inRow + 1] += inChildCount;
+        mExpandedNodes.push_back(Expansion(ioNode, inRow));
     }
 
-    //
-    // Check stop conditions
-    //
-    Assert(inIndex < inEndIndex);
-    if (inIndex + 1 == inEndIndex)
+    Assert(mPendingCounts[inRow] > 0);
+    mPendingCounts[inRow]--;
+    while (mFinishedRowCount < mPendingCounts.size() && mPendingCounts[mFinishedRowCount] == 0)
     {
-        Assert(ioNode->children().empty());
-        Worker::Task task = boost::bind(&MultithreadedNodeCalculator::generateChildNodes,
-                                        this,
-                                        ioNode,
-                                        &mEvaluator,
-                                        inBlockTypes[inIndex],
-                                        inIndex + 1,
-                                        inWidths[inIndex]);
-        mWorkerPool.schedule(task);
-
-        // End of recursion.
+        mTreeRowInfos.setFinished();
+        mFinishedRowCount++;
     }
-    else
-    {
-        ChildNodes childNodes = ioNode->children();
-        if (childNodes.empty())
-        {
-            LogWarning("Nodes have disappeared.");
-        }
+    mExpandCondition.notify_all();
+}
 
-        for (ChildNodes::iterator it = childNodes.begin(); it != childNodes.end(); ++it)
-        {
-            NodePtr child = *it;
 
-            // Start recursion.
-            populateNodes(child, inBlockTypes, inWidths, inIndex + 1, inEndIndex);
-        }
-    }
+void MultithreadedNodeCalculator::scheduleExpansion(NodePtr inNode, std::size_t inRow)
+{
+    Worker::Task task = boost::bind(&MultithreadedNodeCalculator::expandNode, this, inNode, inRow);
+    mWorkerPool.schedule(task);
 }
 
 
@@ -129,17 +135,65 @@ void MultithreadedNodeCalculator::populate()
 {
     try
     {
-        // The nodes are populated using a "Iterative deepening" algorithm.
-        // See: http://en.wikipedia.org/wiki/Iterative_deepening_depth-first_search for more information.
-        std::size_t targetDepth = 1;
-        while (targetDepth <= mBlockTypes.size())
+        // The nodes are populated by "iterative deepening" without barriers between the depths.
+        // The children of a node are scheduled as soon as it has been expanded, so the workers
+        // can start on the next row while the current one is being completed. Each row still
+        // finishes in order, which keeps the per-depth results of mTreeRowInfos valid.
         {
-            ScopedLock lock(mNodeMutex);
-            populateNodes(mNode, mBlockTypes, mWidths, 0, targetDepth);
-            mWorkerPool.wait();
-            Assert(mWorkerPool.getActiveWorkerCount() == 0);
-            mTreeRowInfos.setFinished();
-            targetDepth++;
+            ScopedLock lock(mExpandMutex);
+            mPendingCounts.assign(mBlockTypes.size(), 0);
+            mPendingCounts[0] = 1;
+            mFinishedRowCount = 0;
+            mExpandError = std::exception_ptr();
+        }
+        scheduleExpansion(mNode, 0);
+
+        Expansions expandedNodes;
+        for (;;)
+        {
+            if (deadlinePassed())
+            {
+                // Outside of mExpandMutex, because the workers need it to finish.
+                interruptAtDeadline();
+            }
+
+            {
+                ScopedLock lock(mExpandMutex);
+                while (mExpandedNodes.empty() && mFinishedRowCount < mPendingCounts.size() && !mExpandError)
+                {
+                    if (!hasDeadline())
+                    {
+                        mExpandCondition.wait(lock);
+                    }
+                    else if (!mExpandCondition.timed_wait(lock, mDeadline))
+                    {
+                        break;
+                    }
+                }
+
+                if (mExpandError)
+                {
+                    // An expansion failed. Its error is rethrown below.
+                    break;
+                }
+
+                if (mFinishedRowCount == mPendingCounts.size())
+                {
+                    // All rows have finished.
+                    break;
+                }
+                expandedNodes.swap(mExpandedNodes);
+            }
+
+            for (Expansions::iterator it = expandedNodes.begin(); it != expandedNodes.end(); ++it)
+            {
+                ChildNodes& children = it->first->children();
+                for (ChildNodes::iterator childIt = children.begin(); childIt != children.end(); ++childIt)
+                {
+                    scheduleExpansion(*childIt, it->second + 1);
+                }
+            }
+            expandedNodes.clear();
         }
     }
     catch (const boost::thread_interrupted &)
@@ -152,6 +206,16 @@ void MultithreadedNodeCalculator::populate()
 
     mWorkerPool.interruptAndClearQueue();
     mWorkerPool.wait();
+
+    std::exception_ptr error;
+    {
+        ScopedLock lock(mExpandMutex);
+        error = mExpandError;
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
 }
 
 
@@ -1,6 +1,8 @@
 #include "Tetris/Config.h"
 #include "Tetris/NodeCalculator.h"
 #include "Tetris/NodeCalculatorImpl.h"
+#include "Tetris/BeamSearchNodeCalculator.h"
+#include "Tetris/ExpectimaxNodeCalculator.h"
 #include "Tetris/MultithreadedNodeCalculator.h"
 #include "Tetris/SingleThreadedNodeCalculator.h"
 
@@ -11,36 +13,73 @@ using Futile::WorkerPool;
 namespace Tetris {
 
 
-static std::unique_ptr<NodeCalculatorImpl> CreateImpl(std::unique_ptr<GameStateNode> inNode,
+static std::unique_ptr<NodeCalculatorImpl> CreateImpl(NodePtr inNode,
                                                     const BlockTypes& inBlockTypes,
                                                     const std::vector<int>& inWidths,
                                                     const Evaluator& inEvaluator,
-                                                    WorkerPool& inWorkerPool)
+                                                    WorkerPool& inWorkerPool,
+                                                    NodeCalculator::SearchType inSearchType)
 {
-    if (inWorkerPool.size() > 1)
+    if (inWorkerPool.size() == 0)
+    {
+        throw std::logic_error("Failed to create NodeCalculator object because the given WorkerPool is empty.");
+    }
+    else if (inSearchType == NodeCalculator::SearchType_Expectimax)
+    {
+        throw std::invalid_argument("The expectimax search requires the state of the block bag.");
+    }
+    else if (inSearchType == NodeCalculator::SearchType_Beam)
     {
         return std::unique_ptr<NodeCalculatorImpl>(
-            new MultithreadedNodeCalculator(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool));
+            new BeamSearchNodeCalculator(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool));
     }
-    else if (inWorkerPool.size() == 1)
+    else if (inWorkerPool.size() > 1)
     {
         return std::unique_ptr<NodeCalculatorImpl>(
-            new SingleThreadedNodeCalculator(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool));
+            new MultithreadedNodeCalculator(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool));
     }
     else
     {
-        throw std::logic_error("Failed to create NodeCalculator object because the given WorkerPool is empty.");
+        return std::unique_ptr<NodeCalculatorImpl>(
+            new SingleThreadedNodeCalculator(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool));
     }
 }
 
 
-NodeCalculator::NodeCalculator(std::unique_ptr<GameStateNode> inNode,
+NodeCalculator::NodeCalculator(NodePtr inNode,
+                               const BlockTypes& inBlockTypes,
+                               const std::vector<int>& inWidths,
+                               const Evaluator& inEvaluator,
+                               WorkerPool& inWorkerPool,
+                               SearchType inSearchType) :
+    mImpl(CreateImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool, inSearchType).release())
+{
+}
+
+
+NodeCalculator::NodeCalculator(NodePtr inNode,
                                const BlockTypes& inBlockTypes,
                                const std::vector<int>& inWidths,
                                const Evaluator& inEvaluator,
-                               WorkerPool& inWorkerPool) :
-    mImpl(CreateImpl(std::move(inNode), inBlockTypes, inWidths, inEvaluator, inWorkerPool).release())
+                               WorkerPool& inWorkerPool,
+                               const BlockTypes& inFullBag,
+                               const BlockTypes& inRemainingBlocks)
 {
+    if (inWorkerPool.size() == 0)
+    {
+        throw std::logic_error("Failed to create NodeCalculator object because the given WorkerPool is empty.");
+    }
+    if (inBlockTypes.empty() || inWidths.size() < inBlockTypes.size() || inFullBag.empty())
+    {
+        throw std::invalid_argument("Invalid arguments for the expectimax search.");
+    }
+    mImpl.reset(new ExpectimaxNodeCalculator(std::move(inNode),
+                                             inBlockTypes,
+                                             inWidths,
+                                             inEvaluator,
+                                             inWorkerPool,
+                                             inFullBag,
+                                             inRemainingBlocks));
 }
 
 
@@ -56,6 +95,18 @@ void NodeCalculator::start()
 }
 
 
+void NodeCalculator::start(int inTimeLimit)
+{
+    return mImpl->start(inTimeLimit);
+}
+
+
+void NodeCalculator::run()
+{
+    mImpl->run();
+}
+
+
 void NodeCalculator::stop()
 {
     mImpl->stop();
@@ -74,6 +125,12 @@ int NodeCalculator::getMaxSearchDepth() const
 }
 
 
+std::size_t NodeCalculator::getNodeCount() const
+{
+    return mImpl->getNodeCount();
+}
+
+
 NodePtr NodeCalculator::result() const
 {
     Assert(status() != Status_Error);
@@ -81,6 +138,13 @@ NodePtr NodeCalculator::result() const
 }
 
 
+NodePtr NodeCalculator::resultSubtree() const
+{
+    Assert(status() != Status_Error);
+    return mImpl->resultSubtree();
+}
+
+
 NodeCalculator::Status NodeCalculator::status() const
 {
     return static_cast<Status>(mImpl->status());
@@ -0,0 +1,134 @@
+#include "Tetris/Config.h"
+#include "Tetris/NodeCalculatorFactory.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameImpl.h"
+#include "Tetris/GameState.h"
+#include "Tetris/GameStateNode.h"
+#include "Futile/Assert.h"
+#include <algorithm>
+#include <vector>
+
+
+using Futile::WorkerPool;
+
+
+namespace Tetris {
+
+
+NodeCalculatorFactory::NodeCalculatorFactory() :
+    mResultSubtree(),
+    mSearchType(NodeCalculator::SearchType_Tree)
+{
+}
+
+
+std::unique_ptr<NodeCalculator> NodeCalculatorFactory::create(ComputerGame& ioGame,
+                                                              const Evaluator& inEvaluator,
+                                                              WorkerPool& inWorkerPool,
+                                                              NodeCalculator::SearchType inSearchType,
+                                                              int inSearchDepth,
+                                                              int inSearchWidth)
+{
+    // The end node becomes the new start node. It's like... a vantage point!
+    // If the previous search already looked beyond it then we continue from there.
+    NodePtr endNode;
+    const GameStateNode& gameEndNode = *ioGame.endNode();
+    if (mResultSubtree &&
+        inSearchType == NodeCalculator::SearchType_Tree &&
+        mResultSubtree->depth() == gameEndNode.depth() &&
+        mResultSubtree->gameState().hash() == gameEndNode.gameState().hash() &&
+        mResultSubtree->gameState().numLines() == gameEndNode.gameState().numLines() &&
+        &mResultSubtree->evaluator() == &inEvaluator)
+    {
+        endNode = mResultSubtree;
+    }
+    else
+    {
+        endNode.reset(gameEndNode.clone().release());
+    }
+    mResultSubtree.reset();
+    mSearchType = inSearchType;
+
+    if (endNode->gameState().isGameOver())
+    {
+        return std::unique_ptr<NodeCalculator>();
+    }
+
+    //
+    // Create the list of future blocks
+    //
+    BlockTypes futureBlocks;
+    BlockTypes fullBag;
+    BlockTypes remainingBlocks;
+    std::size_t endDepth = endNode->depth();
+    if (inSearchType == NodeCalculator::SearchType_Expectimax)
+    {
+        // Only the active block and the preview are known.
+        std::size_t knownEnd = ioGame.currentBlockIndex() + 1 + ioGame.futureBlocksCount();
+        if (endDepth >= knownEnd)
+        {
+            // Wait for the next preview block.
+            return std::unique_ptr<NodeCalculator>();
+        }
+        std::size_t knownCount = std::min<std::size_t>(inSearchDepth, knownEnd - endDepth);
+        ioGame.getFutureBlocksWithOffset(endDepth, knownCount, futureBlocks);
+        ioGame.getBlockBag(endDepth + knownCount, fullBag, remainingBlocks);
+    }
+    else
+    {
+        ioGame.getFutureBlocksWithOffset(endDepth, inSearchDepth, futureBlocks);
+    }
+
+    //
+    // Fill list of search widths (using the same width for each level).
+    // The expectimax search continues beyond the known blocks.
+    //
+    std::size_t searchDepth = inSearchType == NodeCalculator::SearchType_Expectimax ? inSearchDepth : futureBlocks.size();
+    std::vector<int> widths(searchDepth, inSearchWidth);
+
+    if (inSearchType == NodeCalculator::SearchType_Expectimax)
+    {
+        return std::unique_ptr<NodeCalculator>(new NodeCalculator(endNode,
+                                                                  futureBlocks,
+                                                                  widths,
+                                                                  inEvaluator,
+                                                                  inWorkerPool,
+                                                                  fullBag,
+                                                                  remainingBlocks));
+    }
+    return std::unique_ptr<NodeCalculator>(new NodeCalculator(endNode,
+                                                              futureBlocks,
+                                                              widths,
+                                                              inEvaluator,
+                                                              inWorkerPool,
+                                                              inSearchType));
+}
+
+
+bool NodeCalculatorFactory::appendResult(const NodeCalculator& inNodeCalculator, ComputerGame& ioGame)
+{
+    NodePtr resultNode = inNodeCalculator.result();
+    if (!resultNode || resultNode->depth() != ioGame.endNode()->depth() + 1)
+    {
+        return false;
+    }
+
+    // The gamestates of the search have no grid, so the move
+    // is committed again on the end node of the game.
+    const GameState& resultState = resultNode->gameState();
+    NodePtr gameNode(new GameStateNode(resultNode->parent(),
+                                       ioGame.endNode()->gameState().commit(resultState.originalBlock(),
+                                                                            GameOver(resultState.isGameOver())).release(),
+                                       resultNode->quality(),
+                                       resultNode->evaluator()));
+    Assert(gameNode->gameState().hash() == resultState.hash());
+    ioGame.appendPrecalculatedNode(gameNode);
+    if (mSearchType == NodeCalculator::SearchType_Tree)
+    {
+        mResultSubtree = inNodeCalculator.resultSubtree();
+    }
+    return true;
+}
+
+
+} // namespace Tetris
@@ -12,9 +12,9 @@
 #include "Futile/Logging.h"
 #include "Futile/MakeString.h"
 #include "Futile/Threading.h"
+#include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
 #include <memory>
-#include <stack>
 #include <stdexcept>
 
 
@@ -25,32 +25,65 @@ using Futile::WorkerPool;
 namespace Tetris {
 
 
-NodeCalculatorImpl::NodeCalculatorImpl(std::unique_ptr<GameStateNode> inNode,
+// Number of positions remembered by the transposition table of a search.
+static const std::size_t cTranspositionTableSize = 1 << 16;
+
+
+static std::uint64_t GetTranspositionKey(const GameStateNode& inNode)
+{
+    const GameState& gameState = inNode.gameState();
+    const std::uint64_t values[] =
+    {
+        static_cast<std::uint64_t>(inNode.depth()),
+        static_cast<std::uint64_t>(gameState.numSingles()),
+        static_cast<std::uint64_t>(gameState.numDoubles()),
+        static_cast<std::uint64_t>(gameState.numTriples()),
+        static_cast<std::uint64_t>(gameState.numTetrises())
+    };
+
+    std::uint64_t result = gameState.hash();
+    for (std::size_t idx = 0; idx != sizeof(values) / sizeof(values[0]); ++idx)
+    {
+        result ^= values[idx] + 0x9E3779B97F4A7C15ULL + (result << 6) + (result >> 2);
+    }
+    return result;
+}
+
+
+NodeCalculatorImpl::NodeCalculatorImpl(NodePtr inNode,
                                        const BlockTypes& inBlockTypes,
                                        const std::vector<int>& inWidths,
                                        const Evaluator& inEvaluator,
                                        WorkerPool& inWorkerPool) :
-    mNode(inNode.release()),
+    mArena(new Futile::Arena),
+    mNode(inNode),
     mResult(),
+    mResultSubtree(),
     mNodeMutex(),
     mQuitFlag(false),
     mQuitFlagMutex(),
     mTreeRowInfos(inEvaluator, inBlockTypes.size()),
+    mTranspositionTable(cTranspositionTableSize),
+    mNodeCount(0),
     mBlockTypes(inBlockTypes),
     mWidths(inWidths),
     mEvaluator(inEvaluator),
     mStatus(0),
     mStatusMutex(),
     mMainWorker("NodeCalculatorImpl"),
-    mWorkerPool(inWorkerPool)
+    mWorkerPool(inWorkerPool),
+    mHasTimeLimit(false),
+    mDeadline()
 {
     Assert(!mNode->gameState().isGameOver());
-    Assert(mNode->children().empty());
 }
 
 
 NodeCalculatorImpl::~NodeCalculatorImpl()
 {
+    // The nodes of the search are released with the arena, all at once.
+    // The start node may live on, so it must not refer to them.
+    mNode->clearChildren();
     mNode.reset();
 }
 
@@ -81,6 +114,18 @@ int NodeCalculatorImpl::getMaxSearchDepth() const
 }
 
 
+std::size_t NodeCalculatorImpl::getNodeCount() const
+{
+    return mNodeCount.load(std::memory_order_relaxed);
+}
+
+
+void NodeCalculatorImpl::addNodeCount(std::size_t inCount) const
+{
+    mNodeCount.fetch_add(inCount, std::memory_order_relaxed);
+}
+
+
 NodePtr NodeCalculatorImpl::result() const
 {
     Assert(status() == NodeCalculator::Status_Finished);
@@ -89,6 +134,14 @@ NodePtr NodeCalculatorImpl::result() const
 }
 
 
+NodePtr NodeCalculatorImpl::resultSubtree() const
+{
+    Assert(status() == NodeCalculator::Status_Finished);
+    ScopedLock lock(mNodeMutex);
+    return mResultSubtree;
+}
+
+
 int NodeCalculatorImpl::status() const
 {
     ScopedLock lock(mStatusMutex);
@@ -109,6 +162,18 @@ void NodeCalculatorImpl::setStatus(int inStatus)
 }
 
 
+bool NodeCalculatorImpl::compareAndSetStatus(int inOldStatus, int inNewStatus)
+{
+    ScopedLock lock(mStatusMutex);
+    if (mStatus != inOldStatus)
+    {
+        return false;
+    }
+    mStatus = inNewStatus;
+    return true;
+}
+
+
 void NodeCalculatorImpl::populateNodesRecursively(
     NodePtr ioNode,
     const BlockTypes& inBlockTypes,
@@ -121,6 +186,10 @@ void NodeCalculatorImpl::populateNodesRecursively(
     if (inIndex > 0)
     {
         boost::this_thread::interruption_point();
+        if (deadlinePassed())
+        {
+            interruptAtDeadline();
+        }
     }
 
     //
@@ -145,22 +214,25 @@ void NodeCalculatorImpl::populateNodesRecursively(
     // It is possible that the nodes were already generated at this depth.
     // If that is the case then we immediately jump to the recursive call below.
     //
-    ChildNodes generatedChildNodes = ioNode->children();
-    if (generatedChildNodes.empty())
+    ChildNodes& children = ioNode->children();
+    if (children.empty())
     {
-        generatedChildNodes = ChildNodes(GameStateComparator());
-        GenerateOffspring(ioNode, inBlockTypes[inIndex], mEvaluator, generatedChildNodes);
-
-        int count = 0;
-        ChildNodes::iterator it = generatedChildNodes.begin(), end = generatedChildNodes.end();
-        while (count < inWidths[inIndex] && it != end)
+        // A childless node above the current row was skipped by an earlier
+        // iteration. The transposition table may have forgotten it since.
+        if (inIndex < inMaxIndex || isTransposition(*ioNode))
         {
-            ioNode->addChild(*it);
-            ++count;
-            ++it;
+            return;
         }
-        Assert(count >= 1);
-        mTreeRowInfos.registerNode(*ioNode->children().begin());
+
+        GenerateOffspring(ioNode, inBlockTypes[inIndex], mEvaluator, inWidths[inIndex], children, mArena.get());
+        Assert(!children.empty());
+        addNodeCount(children.size());
+        mTreeRowInfos.registerNode(*children.begin(), inIndex);
+    }
+    else if (inIndex == inMaxIndex)
+    {
+        // The children were generated by a previous search.
+        mTreeRowInfos.registerNode(*children.begin(), inIndex);
     }
 
 
@@ -169,7 +241,7 @@ void NodeCalculatorImpl::populateNodesRecursively(
     //
     if (inIndex < inMaxIndex)
     {
-        for (ChildNodes::iterator it = generatedChildNodes.begin(); it != generatedChildNodes.end(); ++it)
+        for (ChildNodes::iterator it = children.begin(); it != children.end(); ++it)
         {
             NodePtr child = *it;
             populateNodesRecursively(child, inBlockTypes, inWidths, inIndex + 1, inMaxIndex);
@@ -178,6 +250,12 @@ void NodeCalculatorImpl::populateNodesRecursively(
 }
 
 
+bool NodeCalculatorImpl::isTransposition(const GameStateNode& inNode)
+{
+    return !mTranspositionTable.claim(GetTranspositionKey(inNode), &inNode);
+}
+
+
 void NodeCalculatorImpl::destroyInferiorChildren()
 {
     std::size_t reachedDepth = getCurrentSearchDepth();
@@ -215,41 +293,29 @@ void NodeCalculatorImpl::calculateResult()
 
     ScopedLock lock(mNodeMutex);
 
-    // Backtrack the best end-node to its starting node.
-    std::stack<NodePtr> results;
-    NodePtr endNode = mTreeRowInfos.bestNode();
-    while (endNode->depth() > mNode->depth())
+    // Backtrack the best end-node to the first move.
+    NodePtr firstMove = mTreeRowInfos.bestNode();
+    while (firstMove->depth() > mNode->depth() + 1)
     {
-        results.push(endNode);
-        endNode = endNode->parent();
+        firstMove = firstMove->parent();
     }
 
-    NodePtr currentNode;
-    NodePtr currentParent = mNode;
-    while (!results.empty())
-    {
-        currentNode = results.top();
-        NodePtr copy(new GameStateNode(currentParent, new GameState(currentNode->gameState()), currentNode->evaluator()));
-        if (!mResult)
-        {
-            mResult = copy;
-        }
-        else
-        {
-            Assert(mResult->endNode()->depth() + 1 == copy->depth());
-            mResult->endNode()->addChild(copy);
-        }
-        currentParent = copy;
-        results.pop();
-    }
+    // Only the first move is played. The rest of the path is searched
+    // again by the next search, which knows one more block.
+    mResult.reset(new GameStateNode(mNode, new GameState(firstMove->gameState()), firstMove->evaluator()));
+
+    // Copy the nodes that were searched below the first move out of the
+    // arena, so that the next search only needs to add a row to them.
+    mResultSubtree = firstMove->clone(boost::make_shared<Futile::Arena>());
 }
 
 
 void NodeCalculatorImpl::stop()
 {
-    if (status() == NodeCalculator::Status_Started || status() == NodeCalculator::Status_Working)
+    // A search that has just finished must keep its status.
+    if (compareAndSetStatus(NodeCalculator::Status_Started, NodeCalculator::Status_Stopped) ||
+        compareAndSetStatus(NodeCalculator::Status_Working, NodeCalculator::Status_Stopped))
     {
-        setStatus(NodeCalculator::Status_Stopped);
         Assert(mMainWorker.size() <= 1);
         mMainWorker.interruptAndClearQueue();
         mWorkerPool.interruptAndClearQueue();
@@ -262,7 +328,8 @@ void NodeCalculatorImpl::startImpl()
     // Thread entry point has try/catch block
     try
     {
-        setStatus(NodeCalculator::Status_Working);
+        // The search may have been stopped before it started.
+        compareAndSetStatus(NodeCalculator::Status_Started, NodeCalculator::Status_Working);
         populate();
         calculateResult();
         setStatus(NodeCalculator::Status_Finished);
@@ -284,4 +351,60 @@ void NodeCalculatorImpl::start()
 }
 
 
+void NodeCalculatorImpl::start(int inTimeLimit)
+{
+    // The thread that runs populate() waits for the workers with a timeout, or
+    // checks the deadline between the nodes if it does the work itself.
+    mHasTimeLimit = true;
+    mDeadline = boost::get_system_time() + boost::posix_time::milliseconds(inTimeLimit);
+    start();
+}
+
+
+void NodeCalculatorImpl::run()
+{
+    {
+        ScopedLock lock(mStatusMutex);
+        Assert(mStatus == NodeCalculator::Status_Nil);
+        mStatus = NodeCalculator::Status_Started;
+    }
+    startImpl();
+}
+
+
+bool NodeCalculatorImpl::hasDeadline() const
+{
+    // Without a finished search depth there is no result to return.
+    return mHasTimeLimit && getCurrentSearchDepth() > 0;
+}
+
+
+bool NodeCalculatorImpl::deadlinePassed() const
+{
+    return hasDeadline() && boost::get_system_time() >= mDeadline;
+}
+
+
+void NodeCalculatorImpl::interruptAtDeadline()
+{
+    // The search finishes with the result of the deepest finished depth.
+    compareAndSetStatus(NodeCalculator::Status_Working, NodeCalculator::Status_Stopped);
+    mWorkerPool.interruptAndClearQueue();
+    throw boost::thread_interrupted();
+}
+
+
+void NodeCalculatorImpl::waitForWorkers()
+{
+    if (!hasDeadline())
+    {
+        mWorkerPool.wait();
+    }
+    else if (!mWorkerPool.wait(mDeadline))
+    {
+        interruptAtDeadline();
+    }
+}
+
+
 } // namespace Tetris
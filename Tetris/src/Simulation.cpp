@@ -0,0 +1,252 @@
+#include "Tetris/Config.h"
+#include "Tetris/Simulation.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameImpl.h"
+#include "Tetris/GameState.h"
+#include "Tetris/GameStateNode.h"
+#include "Tetris/Gravity.h"
+#include "Tetris/NodeCalculatorFactory.h"
+#include "Futile/Assert.h"
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+
+using Futile::Locker;
+using Futile::ThreadSafe;
+using Futile::WorkerPool;
+
+
+namespace Tetris {
+
+
+extern const int cMaxLevel;
+
+
+struct Simulation::Impl : boost::noncopyable
+{
+    Impl(std::size_t inRowCount,
+         std::size_t inColumnCount,
+         unsigned inSeed,
+         const Evaluator& inEvaluator,
+         WorkerPool& inWorkerPool) :
+        mGame(ComputerGame::Create(inRowCount, inColumnCount, inSeed)),
+        mEvaluator(inEvaluator),
+        mWorkerPool(inWorkerPool),
+        mNodeCalculatorFactory(),
+        mSearchDepth(6),
+        mSearchWidth(4),
+        mSearchType(NodeCalculator::SearchType_Tree),
+        mMaxBlockCount(0),
+        mGarbageInterval(0),
+        mGarbageLineCount(0),
+        mNextGarbageTime(0),
+        mBlockCount(0),
+        mNodeCount(0),
+        mVirtualTime(0)
+    {
+        Locker<GameImpl>(mGame)->setMuted(true);
+    }
+
+    void search(ComputerGame& ioGame);
+
+    void commitBlock(ComputerGame& ioGame);
+
+    void advanceTime(ComputerGame& ioGame);
+
+    ThreadSafe<GameImpl> mGame;
+    const Evaluator& mEvaluator;
+    WorkerPool& mWorkerPool;
+
+    NodeCalculatorFactory mNodeCalculatorFactory;
+    int mSearchDepth;
+    int mSearchWidth;
+    NodeCalculator::SearchType mSearchType;
+    std::size_t mMaxBlockCount;
+    int mGarbageInterval;
+    int mGarbageLineCount;
+    int mNextGarbageTime;
+    std::size_t mBlockCount;
+    std::size_t mNodeCount;
+    int mVirtualTime;
+};
+
+
+Simulation::Simulation(std::size_t inRowCount,
+                       std::size_t inColumnCount,
+                       unsigned inSeed,
+                       const Evaluator& inEvaluator,
+                       WorkerPool& inWorkerPool) :
+    mImpl(new Impl(inRowCount, inColumnCount, inSeed, inEvaluator, inWorkerPool))
+{
+}
+
+
+Simulation::~Simulation()
+{
+    mImpl.reset();
+}
+
+
+int Simulation::searchDepth() const
+{
+    return mImpl->mSearchDepth;
+}
+
+
+void Simulation::setSearchDepth(int inSearchDepth)
+{
+    if (inSearchDepth < 1)
+    {
+        throw std::invalid_argument("Simulation: the search depth must be at least one.");
+    }
+    mImpl->mSearchDepth = inSearchDepth;
+}
+
+
+int Simulation::searchWidth() const
+{
+    return mImpl->mSearchWidth;
+}
+
+
+void Simulation::setSearchWidth(int inSearchWidth)
+{
+    if (inSearchWidth < 1)
+    {
+        throw std::invalid_argument("Simulation: the search width must be at least one.");
+    }
+    mImpl->mSearchWidth = inSearchWidth;
+}
+
+
+NodeCalculator::SearchType Simulation::searchType() const
+{
+    return mImpl->mSearchType;
+}
+
+
+void Simulation::setSearchType(NodeCalculator::SearchType inSearchType)
+{
+    mImpl->mSearchType = inSearchType;
+}
+
+
+void Simulation::setMaxBlockCount(std::size_t inMaxBlockCount)
+{
+    mImpl->mMaxBlockCount = inMaxBlockCount;
+}
+
+
+void Simulation::setGarbage(int inInterval, int inLineCount)
+{
+    mImpl->mGarbageInterval = std::max(inInterval, 0);
+    mImpl->mGarbageLineCount = inLineCount;
+    mImpl->mNextGarbageTime = mImpl->mVirtualTime + mImpl->mGarbageInterval;
+}
+
+
+GameStateStats Simulation::run()
+{
+    while (true)
+    {
+        Locker<GameImpl> wgame(mImpl->mGame);
+        ComputerGame& game(dynamic_cast<ComputerGame&>(*wgame.get()));
+        if (game.isGameOver() || (mImpl->mMaxBlockCount != 0 && mImpl->mBlockCount >= mImpl->mMaxBlockCount))
+        {
+            const ComputerGame& constGame(game);
+            const GameState& gameState = constGame.gameState();
+            return GameStateStats(gameState.numLines(),
+                                  gameState.numSingles(),
+                                  gameState.numDoubles(),
+                                  gameState.numTriples(),
+                                  gameState.numTetrises(),
+                                  gameState.currentHeight());
+        }
+
+        if (game.numPrecalculatedMoves() == 0)
+        {
+            mImpl->search(game);
+        }
+        mImpl->commitBlock(game);
+        mImpl->advanceTime(game);
+    }
+}
+
+
+std::size_t Simulation::blockCount() const
+{
+    return mImpl->mBlockCount;
+}
+
+
+std::size_t Simulation::nodeCount() const
+{
+    return mImpl->mNodeCount;
+}
+
+
+int Simulation::virtualTime() const
+{
+    return mImpl->mVirtualTime;
+}
+
+
+const ThreadSafe<GameImpl>& Simulation::gameImpl() const
+{
+    return mImpl->mGame;
+}
+
+
+void Simulation::Impl::search(ComputerGame& ioGame)
+{
+    std::unique_ptr<NodeCalculator> nodeCalculator = mNodeCalculatorFactory.create(ioGame,
+                                                                                   mEvaluator,
+                                                                                   mWorkerPool,
+                                                                                   mSearchType,
+                                                                                   mSearchDepth,
+                                                                                   mSearchWidth);
+    if (!nodeCalculator)
+    {
+        // Game over. The block falls where it appeared.
+        return;
+    }
+
+    nodeCalculator->run();
+    mNodeCount += nodeCalculator->getNodeCount();
+    if (nodeCalculator->status() == NodeCalculator::Status_Error)
+    {
+        throw std::runtime_error("Simulation: " + nodeCalculator->errorMessage());
+    }
+    mNodeCalculatorFactory.appendResult(*nodeCalculator, ioGame);
+}
+
+
+void Simulation::Impl::commitBlock(ComputerGame& ioGame)
+{
+    if (!ioGame.navigateNodeDown())
+    {
+        // No move was found. The block falls where it appeared.
+        ioGame.dropAndCommit();
+    }
+}
+
+
+void Simulation::Impl::advanceTime(ComputerGame& ioGame)
+{
+    int level = std::min(ioGame.level(), cMaxLevel);
+    mVirtualTime += static_cast<int>(0.5 + 1000.0 / Gravity::CalculateSpeed(level));
+
+    while (mGarbageInterval != 0 && mVirtualTime >= mNextGarbageTime && !ioGame.isGameOver())
+    {
+        ioGame.applyLinePenalty(mGarbageLineCount);
+        mNextGarbageTime += mGarbageInterval;
+    }
+
+    // Garbage may also commit the active block, so count the depth.
+    mBlockCount = ioGame.currentBlockIndex();
+}
+
+
+} // namespace Tetris
@@ -20,7 +20,7 @@ using Futile::WorkerPool;
 namespace Tetris {
 
 
-SingleThreadedNodeCalculator::SingleThreadedNodeCalculator(std::unique_ptr<GameStateNode> inNode,
+SingleThreadedNodeCalculator::SingleThreadedNodeCalculator(NodePtr inNode,
                                                            const BlockTypes& inBlockTypes,
                                                            const std::vector<int>& inWidths,
                                                            const Evaluator& inEvaluator,
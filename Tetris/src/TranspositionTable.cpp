@@ -0,0 +1,54 @@
+#include "Tetris/Config.h"
+#include "Tetris/TranspositionTable.h"
+#include "Futile/Assert.h"
+
+
+namespace Tetris {
+
+
+static std::size_t RoundUpToPowerOfTwo(std::size_t inValue)
+{
+    std::size_t result = 1;
+    while (result < inValue)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+
+TranspositionTable::TranspositionTable(std::size_t inSlotCount) :
+    mSlots(RoundUpToPowerOfTwo(inSlotCount)),
+    mMask(mSlots.size() - 1)
+{
+    for (std::size_t idx = 0; idx != mSlots.size(); ++idx)
+    {
+        mSlots[idx].mCheck.store(0, std::memory_order_relaxed);
+        mSlots[idx].mOwner.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+bool TranspositionTable::claim(std::uint64_t inKey, const void* inOwner)
+{
+    Assert(inOwner);
+    std::uint64_t owner = reinterpret_cast<std::uintptr_t>(inOwner);
+    Slot& slot = mSlots[inKey & mMask];
+
+    // The slots don't publish any other data, so relaxed ordering suffices.
+    std::uint64_t storedOwner = slot.mOwner.load(std::memory_order_relaxed);
+    std::uint64_t storedCheck = slot.mCheck.load(std::memory_order_relaxed);
+    if (storedOwner != 0 && (storedCheck ^ storedOwner) == inKey)
+    {
+        return storedOwner == owner;
+    }
+
+    // Two threads may claim the same key at the same time. Both then expand
+    // their node, which wastes some work but is otherwise harmless.
+    slot.mOwner.store(owner, std::memory_order_relaxed);
+    slot.mCheck.store(inKey ^ owner, std::memory_order_relaxed);
+    return true;
+}
+
+
+} // namespace Tetris
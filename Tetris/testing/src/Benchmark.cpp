@@ -1,89 +1,532 @@
-#include "TetrisTest.h"
+#include "BenchSupport.h"
+#include "Tetris/AISupport.h"
+#include "Tetris/Block.h"
 #include "Tetris/Evaluator.h"
 #include "Tetris/GameState.h"
+#include "Tetris/GameStateNode.h"
 #include "Tetris/NodeCalculator.h"
-#include "Tetris/NodeCalculatorImpl.h"
-#include "Futile/Threading.h"
+#include "Futile/Arena.h"
+#include "Futile/WorkerPool.h"
+#include "Poco/Stopwatch.h"
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 
-namespace testing {
+using Futile::WorkerPool;
+using namespace Tetris;
 
 
-using namespace Futile;
-using namespace Tetris;
+namespace {
 
 
-struct Benchmark : public TetrisTest { };
+struct Options
+{
+    Options() :
+        mFormat("csv"),
+        mFilter(),
+        mMinTime(200),
+        mDepths(),
+        mWidths(),
+        mWorkerCounts()
+    {
+        mDepths.push_back(2);
+        mDepths.push_back(4);
+        mDepths.push_back(6);
+        mWidths.push_back(2);
+        mWidths.push_back(4);
+        mWidths.push_back(6);
+        mWorkerCounts.push_back(1);
+        mWorkerCounts.push_back(2);
+        mWorkerCounts.push_back(4);
+    }
 
+    std::string mFormat;
+    std::string mFilter;
+    int mMinTime;
+    std::vector<int> mDepths;
+    std::vector<int> mWidths;
+    std::vector<int> mWorkerCounts;
+};
 
-namespace { // anonymous
 
+// One line of output.
+struct Result
+{
+    Result() :
+        mName(),
+        mParameters(),
+        mIterations(0),
+        mSeconds(0),
+        mNodeCount(0)
+    {
+    }
+
+    std::string mName;
+    std::string mParameters;
+    std::size_t mIterations;
+    double mSeconds;
+    std::size_t mNodeCount;
+};
 
-BlockTypes GetBlockTypes(unsigned inDepth)
+
+void PrintUsage()
+{
+    std::cout << "Usage: TetrisBenchmark [options]" << std::endl
+              << "  --format FORMAT        csv or json (default csv)" << std::endl
+              << "  --filter TEXT          only run the benchmarks whose name contains TEXT" << std::endl
+              << "  --min-time MS          minimum time per benchmark and search configuration (default 200)" << std::endl
+              << "  --depths A,B,...       search depths (default 2,4,6)" << std::endl
+              << "  --widths A,B,...       search widths (default 2,4,6)" << std::endl
+              << "  --workers A,B,...      worker thread counts (default 1,2,4)" << std::endl
+              << "  --quick                a short run, to check that everything works" << std::endl;
+}
+
+
+std::vector<int> ParseIntList(const std::string& inOption, const std::string& inValue, int inMin)
+{
+    std::vector<int> result;
+    std::stringstream ss(inValue);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        result.push_back(ParseInt(inOption, item, inMin));
+    }
+    if (result.empty())
+    {
+        throw std::invalid_argument("Missing values for " + inOption);
+    }
+    return result;
+}
+
+
+// Returns false if only the usage was requested.
+bool ParseOptions(int argc, char* argv[], Options& outOptions)
+{
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string option = argv[idx];
+        if (option == "--help" || option == "-h")
+        {
+            PrintUsage();
+            return false;
+        }
+        if (option == "--quick")
+        {
+            outOptions.mMinTime = 20;
+            outOptions.mDepths.assign(1, 2);
+            outOptions.mWidths.assign(1, 2);
+            outOptions.mWorkerCounts.assign(1, 1);
+            continue;
+        }
+        if (idx + 1 == argc)
+        {
+            throw std::invalid_argument("Missing value for " + option);
+        }
+        std::string value = argv[++idx];
+        if (option == "--format")
+        {
+            if (value != "csv" && value != "json")
+            {
+                throw std::invalid_argument("Invalid format: " + value);
+            }
+            outOptions.mFormat = value;
+        }
+        else if (option == "--filter")
+        {
+            outOptions.mFilter = value;
+        }
+        else if (option == "--min-time")
+        {
+            outOptions.mMinTime = ParseInt(option, value, 1);
+        }
+        else if (option == "--depths")
+        {
+            outOptions.mDepths = ParseIntList(option, value, 1);
+        }
+        else if (option == "--widths")
+        {
+            outOptions.mWidths = ParseIntList(option, value, 1);
+        }
+        else if (option == "--workers")
+        {
+            outOptions.mWorkerCounts = ParseIntList(option, value, 1);
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option: " + option);
+        }
+    }
+    return true;
+}
+
+
+// A mid-game board with some holes and overhangs. The top rows are empty.
+const char* cBoardRows[] = {
+    "..........",
+    ".X........",
+    "XX.....X..",
+    "XXX.X.XXX.",
+    "XXXXX.XXX.",
+    "XX.XXXXXXX",
+    "XXXX.XXXXX",
+    "X.XXXXXXXX"
+};
+
+
+// The bottom four rows are full except for the last column.
+const char* cTetrisRows[] = {
+    "....X.....",
+    "XX.XXX..X.",
+    "XXXXXXXXX.",
+    "XXXXXXXXX.",
+    "XXXXXXXXX.",
+    "XXXXXXXXX."
+};
+
+
+GameState CreateGameState(const char* const* inRows, std::size_t inRowCount)
+{
+    GameState gameState(20, 10);
+    Grid grid(20, 10, BlockType_Nil);
+    std::size_t offset = grid.rowCount() - inRowCount;
+    for (std::size_t r = 0; r != inRowCount; ++r)
+    {
+        for (std::size_t c = 0; c != grid.columnCount(); ++c)
+        {
+            if (inRows[r][c] == 'X')
+            {
+                grid.set(offset + r, c, BlockType_J);
+            }
+        }
+    }
+    gameState.setGrid(grid);
+    return gameState;
+}
+
+
+BlockTypes GetBlockTypes(std::size_t inCount)
 {
     BlockTypes blockTypes;
-    int type = BlockType_Begin;
-    for (unsigned idx = 0; idx != inDepth; ++idx)
+    for (std::size_t idx = 0; idx != inCount; ++idx)
     {
-        blockTypes.push_back(BlockType(type));
-        type = (type + 1) < int(BlockType_End) ? (type + 1) : int(BlockType_Begin);
+        blockTypes.push_back(BlockType(BlockType_Begin + idx % (BlockType_End - BlockType_Begin)));
     }
     return blockTypes;
 }
 
 
-std::vector<int> GetWidths(unsigned inDepth, int inWidth)
+// The operations below do inIterations units of work and return a value
+// that depends on all of them, so that the compiler can't drop the work.
+typedef boost::function<std::size_t(std::size_t)> Operation;
+
+
+std::size_t CheckPositionValid(const GameState& inGameState, std::size_t inIterations)
+{
+    std::size_t result = 0;
+    const std::size_t positionCount = inGameState.rowCount() * inGameState.columnCount();
+    Block block(BlockType_T, Rotation(0), Row(0), Column(0));
+    for (std::size_t idx = 0; idx != inIterations; ++idx)
+    {
+        std::size_t position = idx % positionCount;
+        if (inGameState.checkPositionValid(block, position / inGameState.columnCount(), position % inGameState.columnCount()))
+        {
+            result++;
+        }
+    }
+    return result;
+}
+
+
+// Drops a T in every column and rotation, each time on the same board.
+std::size_t Commit(const GameState& inGameState, std::size_t inIterations)
 {
-    return std::vector<int>(inDepth, inWidth);
+    std::size_t result = 0;
+    const std::size_t rotationCount = GetBlockRotationCount(BlockType_T);
+    for (std::size_t idx = 0; idx != inIterations; ++idx)
+    {
+        Block block(BlockType_T, Rotation(idx % rotationCount), Row(0), Column(0));
+        std::size_t maxColumn = inGameState.columnCount() - block.columnCount();
+        block.setColumn(idx / rotationCount % (maxColumn + 1));
+        while (inGameState.checkPositionValid(block, block.row() + 1, block.column()))
+        {
+            block.setRow(block.row() + 1);
+        }
+        result += inGameState.commit(block, GameOver(false))->numHoles();
+    }
+    return result;
 }
 
 
-void PerformBenchmark(unsigned inWidth, unsigned inDepth)
+// The vertical I that completes the four lines of cTetrisRows.
+Block GetTetrisBlock()
 {
-    UInt64 startTime = GetCurrentTimeMs();
-    Worker worker("Main Worker");
-    WorkerPool workerPool("Worker Pool", 8);
-    std::cout << "Starting test with Depth=" << inDepth << " and Width=" << inWidth << std::endl;
-    NodeCalculator nodeCalculator(GameState(20, 10),
-                                  GetBlockTypes(inWidth),
-                                  GetWidths(inWidth, inDepth),
-                                  MakeTetrises::Instance(),
-                                  worker,
-                                  workerPool);
+    return Block(BlockType_I, Rotation(1), Row(16), Column(9));
+}
 
-    nodeCalculator.start();
-    std::cout << std::endl;
-    while (nodeCalculator.status() != NodeCalculator::Status_Finished)
+
+std::size_t ClearLines(const GameState& inGameState, std::size_t inIterations)
+{
+    std::size_t result = 0;
+    const Block block = GetTetrisBlock();
+    for (std::size_t idx = 0; idx != inIterations; ++idx)
     {
-        Sleep(UInt64(50));
+        result += inGameState.commit(block, GameOver(false))->numLines();
     }
+    return result;
+}
+
 
-    std::cout << "Finished in " << (GetCurrentTimeMs() - startTime) << "ms." << std::endl;
+std::size_t Evaluate(const Evaluator& inEvaluator, const GameState& inGameState, std::size_t inIterations)
+{
+    std::size_t result = 0;
+    for (std::size_t idx = 0; idx != inIterations; ++idx)
+    {
+        result += inEvaluator.evaluate(inGameState);
+    }
+    return result;
 }
 
 
-void Print(const std::exception& exc)
+std::size_t Generate(const NodePtr& inNode, const Evaluator& inEvaluator, std::size_t inIterations)
 {
-    std::cout << "Anticipated exception: " << exc.what() << std::endl;
+    std::size_t result = 0;
+    const std::size_t typeCount = BlockType_End - BlockType_Begin;
+    ChildNodes childNodes;
+    for (std::size_t idx = 0; idx != inIterations; ++idx)
+    {
+        // The children are released with the arena, like in the search.
+        Futile::Arena arena;
+        GenerateOffspring(inNode, BlockType(BlockType_Begin + idx % typeCount), inEvaluator, childNodes, &arena);
+        result += childNodes.size();
+        childNodes.clear();
+    }
+    return result;
 }
 
 
-} // anonymous namespace
+// Doubles the number of iterations until the operation takes at least inMinTime.
+Result Measure(const std::string& inName, const std::string& inParameters, const Operation& inOperation, int inMinTime)
+{
+    Result result;
+    result.mName = inName;
+    result.mParameters = inParameters;
 
+    std::size_t iterations = 1;
+    std::size_t checksum = 0;
+    for (;;)
+    {
+        Poco::Stopwatch stopwatch;
+        stopwatch.start();
+        checksum += inOperation(iterations);
+        double seconds = stopwatch.elapsed() / 1000000.0;
+        if (seconds >= inMinTime / 1000.0)
+        {
+            result.mIterations = iterations;
+            result.mSeconds = seconds;
+            break;
+        }
+        iterations *= 2;
+    }
 
-TEST_F(Benchmark, Quick)
+    // Never true, but the compiler doesn't know that.
+    if (checksum == std::size_t(-1))
+    {
+        std::cerr << checksum << std::endl;
+    }
+    return result;
+}
+
+
+// Runs complete searches until they took at least inMinTime in total.
+Result MeasureSearch(int inDepth, int inWidth, int inWorkerCount, int inMinTime)
+{
+    std::stringstream parameters;
+    parameters << "depth=" << inDepth << " width=" << inWidth << " workers=" << inWorkerCount;
+
+    Result result;
+    result.mName = "NodeCalculator";
+    result.mParameters = parameters.str();
+
+    const GameState board = CreateGameState(cBoardRows, sizeof(cBoardRows) / sizeof(cBoardRows[0]));
+    WorkerPool workerPool("TetrisBenchmark", inWorkerCount);
+    while (result.mSeconds < inMinTime / 1000.0)
+    {
+        NodePtr rootNode(new GameStateNode(new GameState(board), Balanced::Instance()));
+        NodeCalculator nodeCalculator(rootNode,
+                                      GetBlockTypes(inDepth),
+                                      std::vector<int>(inDepth, inWidth),
+                                      Balanced::Instance(),
+                                      workerPool);
+
+        Poco::Stopwatch stopwatch;
+        stopwatch.start();
+        nodeCalculator.run();
+        result.mSeconds += stopwatch.elapsed() / 1000000.0;
+        if (nodeCalculator.status() == NodeCalculator::Status_Error)
+        {
+            throw std::runtime_error("NodeCalculator: " + nodeCalculator.errorMessage());
+        }
+        result.mIterations++;
+        result.mNodeCount += nodeCalculator.getNodeCount();
+    }
+    return result;
+}
+
+
+void PrintHeader(const Options& inOptions)
+{
+    if (inOptions.mFormat == "csv")
+    {
+        std::cout << "benchmark,parameters,iterations,seconds,ns_per_op,nodes,nodes_per_s" << std::endl;
+    }
+    else
+    {
+        std::cout << "[" << std::endl;
+    }
+}
+
+
+void PrintResult(const Options& inOptions, const Result& inResult, bool inFirst)
+{
+    std::stringstream ss;
+    ss << std::fixed;
+    if (inOptions.mFormat == "csv")
+    {
+        ss << inResult.mName
+           << "," << inResult.mParameters
+           << "," << inResult.mIterations
+           << "," << std::setprecision(6) << inResult.mSeconds
+           << "," << std::setprecision(1) << Divide(inResult.mSeconds * 1e9, inResult.mIterations)
+           << "," << inResult.mNodeCount
+           << "," << std::setprecision(0) << Divide(inResult.mNodeCount, inResult.mSeconds);
+    }
+    else
+    {
+        ss << (inFirst ? "" : ",\n")
+           << "  {\"benchmark\": \"" << inResult.mName << "\""
+           << ", \"parameters\": \"" << inResult.mParameters << "\""
+           << ", \"iterations\": " << inResult.mIterations
+           << ", \"seconds\": " << std::setprecision(6) << inResult.mSeconds
+           << ", \"ns_per_op\": " << std::setprecision(1) << Divide(inResult.mSeconds * 1e9, inResult.mIterations)
+           << ", \"nodes\": " << inResult.mNodeCount
+           << ", \"nodes_per_s\": " << std::setprecision(0) << Divide(inResult.mNodeCount, inResult.mSeconds)
+           << "}";
+    }
+
+    // The JSON lines are separated by the next result.
+    std::cout << ss.str();
+    if (inOptions.mFormat == "csv")
+    {
+        std::cout << std::endl;
+    }
+    else
+    {
+        std::cout.flush();
+    }
+}
+
+
+void PrintFooter(const Options& inOptions)
 {
-    try { PerformBenchmark(0, 0); } catch (const std::exception& exc) { Print(exc); }
-    try { PerformBenchmark(0, 1); } catch (const std::exception& exc) { Print(exc); }
-    try { PerformBenchmark(1, 0); } catch (const std::exception& exc) { Print(exc); }
+    if (inOptions.mFormat == "json")
+    {
+        std::cout << std::endl << "]" << std::endl;
+    }
+}
+
+
+bool IsSelected(const Options& inOptions, const std::string& inName)
+{
+    return inName.find(inOptions.mFilter) != std::string::npos;
+}
+
+
+int Run(const Options& inOptions)
+{
+    const GameState board = CreateGameState(cBoardRows, sizeof(cBoardRows) / sizeof(cBoardRows[0]));
+    const GameState tetrisBoard = CreateGameState(cTetrisRows, sizeof(cTetrisRows) / sizeof(cTetrisRows[0]));
+    if (!tetrisBoard.checkPositionValid(GetTetrisBlock(), GetTetrisBlock().row(), GetTetrisBlock().column()) ||
+        tetrisBoard.commit(GetTetrisBlock(), GameOver(false))->numLines() != 4)
+    {
+        throw std::logic_error("The tetris board doesn't clear four lines.");
+    }
+
+    // Evaluators score boards right after a commit.
+    std::unique_ptr<GameState> committed = board.commit(Block(BlockType_O, Rotation(0), Row(13), Column(3)), GameOver(false));
+    NodePtr node(new GameStateNode(new GameState(board), Balanced::Instance()));
+
+    struct Microbenchmark
+    {
+        const char* mName;
+        const char* mParameters;
+        Operation mOperation;
+    };
+
+    const Microbenchmark microbenchmarks[] = {
+        { "GameState::checkPositionValid", "block=T", boost::bind(&CheckPositionValid, boost::cref(board), boost::placeholders::_1) },
+        { "GameState::commit", "block=T", boost::bind(&Commit, boost::cref(board), boost::placeholders::_1) },
+        { "GameState::clearLines", "lines=4", boost::bind(&ClearLines, boost::cref(tetrisBoard), boost::placeholders::_1) },
+        { "Evaluator::evaluate", "evaluator=Balanced", boost::bind(&Evaluate, boost::cref(Balanced::Instance()), boost::cref(*committed), boost::placeholders::_1) },
+        { "Evaluator::evaluate", "evaluator=MakeTetrises", boost::bind(&Evaluate, boost::cref(MakeTetrises::Instance()), boost::cref(*committed), boost::placeholders::_1) },
+        { "GenerateOffspring", "evaluator=Balanced", boost::bind(&Generate, boost::cref(node), boost::cref(Balanced::Instance()), boost::placeholders::_1) }
+    };
 
-    PerformBenchmark(1, 1);
-    PerformBenchmark(2, 2);
-    PerformBenchmark(4, 4);
-    PerformBenchmark(6, 6);
+    PrintHeader(inOptions);
+    bool first = true;
+    for (std::size_t idx = 0; idx != sizeof(microbenchmarks) / sizeof(microbenchmarks[0]); ++idx)
+    {
+        const Microbenchmark& microbenchmark = microbenchmarks[idx];
+        if (IsSelected(inOptions, microbenchmark.mName))
+        {
+            PrintResult(inOptions, Measure(microbenchmark.mName, microbenchmark.mParameters, microbenchmark.mOperation, inOptions.mMinTime), first);
+            first = false;
+        }
+    }
+
+    if (IsSelected(inOptions, "NodeCalculator"))
+    {
+        for (std::size_t d = 0; d != inOptions.mDepths.size(); ++d)
+        {
+            for (std::size_t w = 0; w != inOptions.mWidths.size(); ++w)
+            {
+                for (std::size_t t = 0; t != inOptions.mWorkerCounts.size(); ++t)
+                {
+                    PrintResult(inOptions,
+                                MeasureSearch(inOptions.mDepths[d], inOptions.mWidths[w], inOptions.mWorkerCounts[t], inOptions.mMinTime),
+                                first);
+                    first = false;
+                }
+            }
+        }
+    }
+    PrintFooter(inOptions);
+    return 0;
+}
+
+
+int Main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        return 0;
+    }
+    return Run(options);
 }
 
 
-} // namespace testing
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+    return RunHeadless(argc, argv, &Main);
+}
@@ -0,0 +1,77 @@
+#include "Tetris/BlockFactory.h"
+#include "Tetris/BlockType.h"
+#include "Tetris/BlockTypes.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+
+
+using namespace Tetris;
+
+
+namespace { // anonymous
+
+
+const std::size_t cBlockCount = 1000;
+
+
+BlockTypes GetBlocks(const BlockFactory& inBlockFactory, std::size_t inCount)
+{
+    BlockTypes result;
+    for (std::size_t idx = 0; idx != inCount; ++idx)
+    {
+        result.push_back(inBlockFactory.getNext());
+    }
+    return result;
+}
+
+
+} // anonymous namespace
+
+
+TEST(BlockFactoryTest, SameSeedGivesTheSameBlocks)
+{
+    BlockFactory blockFactory(2, 42);
+    BlockFactory sameSeed(2, 42);
+    BlockFactory otherSeed(2, 43);
+    BlockTypes blocks = GetBlocks(blockFactory, cBlockCount);
+    EXPECT_EQ(blocks, GetBlocks(sameSeed, cBlockCount));
+    EXPECT_NE(blocks, GetBlocks(otherSeed, cBlockCount));
+
+    // Splitting off a stream doesn't change the blocks.
+    BlockFactory splitFactory(2, 42);
+    BlockTypes splitBlocks = GetBlocks(splitFactory, cBlockCount / 2);
+    BlockFactory child(2, splitFactory.split());
+    splitFactory.split();
+    BlockTypes moreBlocks = GetBlocks(splitFactory, cBlockCount - cBlockCount / 2);
+    splitBlocks.insert(splitBlocks.end(), moreBlocks.begin(), moreBlocks.end());
+    EXPECT_EQ(blocks, splitBlocks);
+}
+
+
+TEST(BlockFactoryTest, RemainingBlocksAreTheRestOfTheBag)
+{
+    for (int bagSize = 1; bagSize != 4; ++bagSize)
+    {
+        BlockFactory blockFactory(bagSize, 7);
+        BlockTypes bag;
+        blockFactory.getBag(bag);
+        ASSERT_EQ(bagSize * cBlockTypeCount, bag.size());
+        ASSERT_TRUE(std::is_sorted(bag.begin(), bag.end()));
+
+        BlockTypes blocks = GetBlocks(blockFactory, 3 * bag.size());
+        for (std::size_t drawCount = 0; drawCount != blocks.size(); ++drawCount)
+        {
+            // Every round of the bag's size contains a full bag.
+            std::size_t roundBegin = drawCount - drawCount % bag.size();
+            BlockTypes round(blocks.begin() + roundBegin, blocks.begin() + roundBegin + bag.size());
+            std::sort(round.begin(), round.end());
+            ASSERT_EQ(bag, round);
+
+            BlockTypes remaining;
+            blockFactory.getRemainingBlocks(blocks, drawCount, remaining);
+            BlockTypes rest(blocks.begin() + drawCount, blocks.begin() + roundBegin + bag.size());
+            std::sort(rest.begin(), rest.end());
+            ASSERT_EQ(rest, remaining);
+        }
+    }
+}
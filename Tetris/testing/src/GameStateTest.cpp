@@ -0,0 +1,240 @@
+#include "Tetris/Block.h"
+#include "Tetris/BlockType.h"
+#include "Tetris/GameState.h"
+#include "Tetris/Grid.h"
+#include "Tetris/TranspositionTable.h"
+#include "Futile/Arena.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <random>
+
+
+using namespace Tetris;
+
+
+namespace { // anonymous
+
+
+// Number of random moves that each test checks.
+const std::size_t cMoveCount = 400;
+
+
+BlockType GetRandomBlockType(std::mt19937& ioRandom)
+{
+    return BlockType(BlockType_Begin + ioRandom() % (BlockType_End - BlockType_Begin));
+}
+
+
+// Drops a random block straight down from the top of the grid. Starts a new
+// game when the block doesn't fit at the top, so that the boards stay varied.
+Block DropRandomBlock(std::unique_ptr<GameState>& ioGameState, std::mt19937& ioRandom)
+{
+    for (;;)
+    {
+        std::size_t rowCount = ioGameState->grid().rowCount();
+        std::size_t columnCount = ioGameState->grid().columnCount();
+        BlockType type = GetRandomBlockType(ioRandom);
+        Block block(type, Rotation(ioRandom() % GetBlockRotationCount(type)), Row(0), Column(0));
+        std::size_t column = ioRandom() % (columnCount - block.columnCount() + 1);
+        if (!ioGameState->checkPositionValid(block, 0, column))
+        {
+            ioGameState.reset(new GameState(rowCount, columnCount));
+            continue;
+        }
+
+        std::size_t row = 0;
+        while (ioGameState->checkPositionValid(block, row + 1, column))
+        {
+            row++;
+        }
+        return Block(type, Rotation(block.rotation()), Row(row), Column(column));
+    }
+}
+
+
+// Same occupancy and the statistics that follow from it.
+// Works on gamestates that are not materialized.
+void ExpectSameSquares(const GameState& lhs, const GameState& rhs)
+{
+    EXPECT_EQ(lhs.hash(), rhs.hash());
+    EXPECT_EQ(lhs.numHoles(), rhs.numHoles());
+    EXPECT_EQ(lhs.numOccupiedSquares(), rhs.numOccupiedSquares());
+    EXPECT_EQ(lhs.firstOccupiedRow(), rhs.firstOccupiedRow());
+    for (std::size_t r = 0; r != lhs.rowCount(); ++r)
+    {
+        EXPECT_EQ(lhs.rowMask(r), rhs.rowMask(r));
+    }
+}
+
+
+// Also the same line statistics.
+void ExpectSameBoard(const GameState& lhs, const GameState& rhs)
+{
+    ExpectSameSquares(lhs, rhs);
+    EXPECT_EQ(lhs.numLines(), rhs.numLines());
+    EXPECT_EQ(lhs.numTetrises(), rhs.numTetrises());
+    EXPECT_EQ(lhs.score(), rhs.score());
+}
+
+
+// Counts the empty squares that are directly below an occupied square.
+int CountHoles(const Grid& inGrid)
+{
+    int result = 0;
+    for (std::size_t r = 1; r < inGrid.rowCount(); ++r)
+    {
+        for (std::size_t c = 0; c != inGrid.columnCount(); ++c)
+        {
+            if (inGrid.get(r - 1, c) != BlockType_Nil && inGrid.get(r, c) == BlockType_Nil)
+            {
+                result++;
+            }
+        }
+    }
+    return result;
+}
+
+
+// Counts the occupied squares.
+int CountOccupiedSquares(const Grid& inGrid)
+{
+    int result = 0;
+    for (std::size_t r = 0; r != inGrid.rowCount(); ++r)
+    {
+        for (std::size_t c = 0; c != inGrid.columnCount(); ++c)
+        {
+            if (inGrid.get(r, c) != BlockType_Nil)
+            {
+                result++;
+            }
+        }
+    }
+    return result;
+}
+
+
+// Checks a block position square by square against the grid.
+bool FitsInGrid(const Grid& inGrid, const Block& inBlock, std::size_t inRow, std::size_t inColumn)
+{
+    const Grid& blockGrid = inBlock.grid();
+    if (inRow + blockGrid.rowCount() > inGrid.rowCount() || inColumn + blockGrid.columnCount() > inGrid.columnCount())
+    {
+        return false;
+    }
+    for (std::size_t r = 0; r != blockGrid.rowCount(); ++r)
+    {
+        for (std::size_t c = 0; c != blockGrid.columnCount(); ++c)
+        {
+            if (blockGrid.get(r, c) != BlockType_Nil && inGrid.get(inRow + r, inColumn + c) != BlockType_Nil)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+} // anonymous namespace
+
+
+TEST(GameStateTest, CommitDeltaMatchesCommit)
+{
+    std::mt19937 random(3);
+    std::unique_ptr<GameState> gameState(new GameState(20, 10));
+    for (std::size_t move = 0; move != cMoveCount; ++move)
+    {
+        for (std::size_t probe = 0; probe != 4; ++probe)
+        {
+            Block block = DropRandomBlock(gameState, random);
+            std::unique_ptr<GameState> committed = gameState->commit(block, GameOver(false));
+
+            // The delta knows its statistics and rows before it is materialized.
+            std::unique_ptr<GameState> delta = gameState->commitDelta(block);
+            ASSERT_FALSE(delta->isMaterialized());
+            ExpectSameBoard(*committed, *delta);
+
+            delta->materialize();
+            ASSERT_TRUE(delta->isMaterialized());
+            ExpectSameBoard(*committed, *delta);
+
+            // Same for the gamestates of the search, which have no grid.
+            Futile::Arena arena;
+            GameState* arenaDelta = gameState->commitDelta(block, arena);
+            arenaDelta->materialize();
+            EXPECT_FALSE(arenaDelta->hasGrid());
+            ExpectSameBoard(*committed, *arenaDelta);
+        }
+        Block block = DropRandomBlock(gameState, random);
+        gameState = gameState->commit(block, GameOver(false));
+    }
+}
+
+
+TEST(GameStateTest, HashDependsOnTheOccupiedSquaresOnly)
+{
+    // Two O blocks on the floor, placed in either order.
+    GameState empty(20, 10);
+    Block left(BlockType_O, Rotation(0), Row(18), Column(0));
+    Block right(BlockType_O, Rotation(0), Row(18), Column(4));
+    std::unique_ptr<GameState> leftFirst = empty.commit(left, GameOver(false))->commit(right, GameOver(false));
+    std::unique_ptr<GameState> rightFirst = empty.commit(right, GameOver(false))->commit(left, GameOver(false));
+    EXPECT_EQ(leftFirst->hash(), rightFirst->hash());
+    EXPECT_NE(leftFirst->hash(), empty.commit(left, GameOver(false))->hash());
+    EXPECT_NE(empty.hash(), empty.commit(left, GameOver(false))->hash());
+
+    // The first claim of a position wins, the other boards are transpositions.
+    TranspositionTable table(1024);
+    EXPECT_TRUE(table.claim(leftFirst->hash(), leftFirst.get()));
+    EXPECT_TRUE(table.claim(leftFirst->hash(), leftFirst.get()));
+    EXPECT_FALSE(table.claim(rightFirst->hash(), rightFirst.get()));
+    EXPECT_TRUE(table.claim(empty.hash(), &empty));
+
+    // The hash of a played board equals the hash of the same squares set at once,
+    // also after lines were cleared.
+    std::mt19937 random(4);
+    std::unique_ptr<GameState> gameState(new GameState(20, 10));
+    for (std::size_t move = 0; move != cMoveCount; ++move)
+    {
+        Block block = DropRandomBlock(gameState, random);
+        gameState = gameState->commit(block, GameOver(false));
+
+        GameState rebuilt(gameState->rowCount(), gameState->columnCount());
+        rebuilt.setGrid(gameState->grid());
+        ExpectSameSquares(*gameState, rebuilt);
+    }
+}
+
+
+TEST(GameStateTest, RowMasksMatchTheGrid)
+{
+    std::mt19937 random(5);
+    std::unique_ptr<GameState> gameState(new GameState(20, 10));
+    for (std::size_t move = 0; move != cMoveCount; ++move)
+    {
+        Block block = DropRandomBlock(gameState, random);
+        gameState = gameState->commit(block, GameOver(false));
+
+        const Grid& grid = gameState->grid();
+        for (std::size_t r = 0; r != grid.rowCount(); ++r)
+        {
+            for (std::size_t c = 0; c != grid.columnCount(); ++c)
+            {
+                bool occupied = (gameState->rowMask(r) >> c) & 1;
+                ASSERT_EQ(grid.get(r, c) != BlockType_Nil, occupied);
+            }
+        }
+        ASSERT_EQ(CountHoles(grid), gameState->numHoles());
+        ASSERT_EQ(CountOccupiedSquares(grid), gameState->numOccupiedSquares());
+
+        // Collisions of random positions, including positions outside of the grid.
+        for (std::size_t probe = 0; probe != 20; ++probe)
+        {
+            BlockType type = GetRandomBlockType(random);
+            Block probeBlock(type, Rotation(random() % GetBlockRotationCount(type)), Row(0), Column(0));
+            std::size_t row = random() % grid.rowCount();
+            std::size_t column = random() % grid.columnCount();
+            ASSERT_EQ(FitsInGrid(grid, probeBlock, row, column), gameState->checkPositionValid(probeBlock, row, column));
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#include "Futile/Allocator.h"
+#include "Futile/GenericGrid.h"
+#include "Futile/MemoryPool.h"
+#include "gtest/gtest.h"
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <vector>
+
+
+using Futile::Memory::Pool::FixedSizePool;
+using Futile::Memory::Pool::GetSharedPool;
+
+
+namespace { // anonymous
+
+
+typedef std::vector<void*> Slots;
+
+
+void AcquireSlots(FixedSizePool* ioPool, std::size_t inCount, Slots* outSlots)
+{
+    for (std::size_t idx = 0; idx != inCount; ++idx)
+    {
+        outSlots->push_back(ioPool->acquire());
+    }
+}
+
+
+void ReleaseSlots(FixedSizePool* ioPool, const Slots* inSlots)
+{
+    for (std::size_t idx = 0; idx != inSlots->size(); ++idx)
+    {
+        ioPool->release((*inSlots)[idx]);
+    }
+}
+
+
+// Fills the thread's cache of the pool, and keeps it until inExit is set.
+void UseAndWait(FixedSizePool* ioPool, std::atomic<bool>* outReady, const std::atomic<bool>* inExit)
+{
+    Slots slots;
+    AcquireSlots(ioPool, 16, &slots);
+    ReleaseSlots(ioPool, &slots);
+    *outReady = true;
+    while (!*inExit)
+    {
+        boost::this_thread::yield();
+    }
+}
+
+
+} // anonymous namespace
+
+
+TEST(MemoryPoolTest, PoolGrowsByOneBlock)
+{
+    FixedSizePool pool(24, 8);
+    EXPECT_EQ(32u, pool.slotSize());
+    EXPECT_EQ(0u, pool.capacity());
+
+    Slots slots;
+    AcquireSlots(&pool, 20, &slots);
+    EXPECT_EQ(24u, pool.capacity());
+
+    // The slots don't overlap and are aligned for any type.
+    std::set<void*> unique(slots.begin(), slots.end());
+    EXPECT_EQ(slots.size(), unique.size());
+    for (std::size_t idx = 0; idx != slots.size(); ++idx)
+    {
+        EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(slots[idx]) % 16);
+    }
+
+    // Released slots are reused.
+    ReleaseSlots(&pool, &slots);
+    slots.clear();
+    AcquireSlots(&pool, 20, &slots);
+    EXPECT_EQ(24u, pool.capacity());
+    ReleaseSlots(&pool, &slots);
+}
+
+
+TEST(MemoryPoolTest, ReleaseDoesNotDependOnThePoolSize)
+{
+    // The old pool searched the used slots on every release. With this many
+    // slots that took seconds, the free list takes milliseconds.
+    const std::size_t cSlotCount = 200 * 1000;
+    FixedSizePool pool(16, 1024);
+    Slots slots;
+    AcquireSlots(&pool, cSlotCount, &slots);
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    for (std::size_t idx = cSlotCount; idx != 0; --idx)
+    {
+        pool.release(slots[idx - 1]);
+    }
+    boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::universal_time() - start;
+    EXPECT_LT(duration.total_milliseconds(), 1000);
+}
+
+
+TEST(MemoryPoolTest, SlotsCanBeReleasedByAnotherThread)
+{
+    FixedSizePool pool(64, 32);
+    Slots slots;
+    AcquireSlots(&pool, 100, &slots);
+    std::size_t capacity = pool.capacity();
+
+    // The other thread returns its cache to the pool when it exits.
+    boost::thread thread(boost::bind(&ReleaseSlots, &pool, &slots));
+    thread.join();
+
+    Slots moreSlots;
+    AcquireSlots(&pool, 100, &moreSlots);
+    EXPECT_EQ(capacity, pool.capacity());
+    ReleaseSlots(&pool, &moreSlots);
+}
+
+
+TEST(MemoryPoolTest, ThreadMayExitAfterThePoolIsDestroyed)
+{
+    std::atomic<bool> ready(false);
+    std::atomic<bool> exit(false);
+    std::unique_ptr<FixedSizePool> pool(new FixedSizePool(32, 8));
+    boost::thread thread(boost::bind(&UseAndWait, pool.get(), &ready, &exit));
+    while (!ready)
+    {
+        boost::this_thread::yield();
+    }
+
+    // The thread's cache still holds slots of the pool.
+    pool.reset();
+    exit = true;
+    thread.join();
+}
+
+
+TEST(MemoryPoolTest, SharedPoolsPerSizeClass)
+{
+    EXPECT_TRUE(GetSharedPool(0) == 0);
+    EXPECT_TRUE(GetSharedPool(4097) == 0);
+    EXPECT_TRUE(GetSharedPool(1) == GetSharedPool(16));
+    EXPECT_TRUE(GetSharedPool(16) != GetSharedPool(17));
+    EXPECT_EQ(4096u, GetSharedPool(4096)->slotSize());
+
+    // Grids that use the shared pools behave like the other grids.
+    typedef Futile::GenericGrid<int, Futile::Allocator_Pool> PoolGrid;
+    PoolGrid grid(20, 10, 0);
+    grid.set(19, 9, 7);
+    PoolGrid copy(grid);
+    EXPECT_EQ(7, copy.get(19, 9));
+    EXPECT_EQ(0, copy.get(0, 0));
+    PoolGrid big(100, 100, 1);
+    big = copy;
+    EXPECT_EQ(7, big.get(19, 9));
+}
@@ -0,0 +1,139 @@
+#include "Tetris/AISupport.h"
+#include "Tetris/Block.h"
+#include "Tetris/BlockType.h"
+#include "Tetris/GameState.h"
+#include "Tetris/MoveGenerator.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <random>
+#include <vector>
+
+
+using namespace Tetris;
+
+
+namespace { // anonymous
+
+
+// Number of random moves that each test checks.
+const std::size_t cMoveCount = 400;
+
+
+BlockType GetRandomBlockType(std::mt19937& ioRandom)
+{
+    return BlockType(BlockType_Begin + ioRandom() % (BlockType_End - BlockType_Begin));
+}
+
+
+// Plays a random reachable placement. Starts a new game when the
+// block can't be spawned, so that the boards stay varied.
+void PlayRandomMove(std::unique_ptr<GameState>& ioGameState, std::mt19937& ioRandom)
+{
+    std::vector<Block> placements;
+    GetReachablePlacements(*ioGameState, GetRandomBlockType(ioRandom), placements);
+    if (placements.empty())
+    {
+        ioGameState.reset(new GameState(ioGameState->rowCount(), ioGameState->columnCount()));
+        return;
+    }
+    ioGameState = ioGameState->commit(placements[ioRandom() % placements.size()], GameOver(false));
+}
+
+
+bool Equals(const Block& lhs, const Block& rhs)
+{
+    return lhs.type() == rhs.type() &&
+           lhs.rotation() == rhs.rotation() &&
+           lhs.row() == rhs.row() &&
+           lhs.column() == rhs.column();
+}
+
+
+} // anonymous namespace
+
+
+TEST(MoveGeneratorTest, SpawnBlockIsCentered)
+{
+    for (std::size_t columnCount = 8; columnCount != 12; ++columnCount)
+    {
+        GameState gameState(20, columnCount);
+        for (BlockType type = BlockType_Begin; type != BlockType_End; ++type)
+        {
+            // Blocks that can't be centered exactly are moved to the right.
+            Block block = GetSpawnBlock(type, columnCount);
+            EXPECT_EQ(0u, block.rotation());
+            EXPECT_EQ(0u, block.row());
+            EXPECT_EQ((columnCount - block.columnCount() + 1) / 2, block.column());
+            EXPECT_FALSE(IsGameOver(gameState, type));
+        }
+    }
+}
+
+
+TEST(MoveGeneratorTest, FastPathMatchesPathSearch)
+{
+    std::mt19937 random(1);
+    std::unique_ptr<GameState> gameState(new GameState(20, 10));
+    for (std::size_t move = 0; move != cMoveCount; ++move)
+    {
+        for (BlockType type = BlockType_Begin; type != BlockType_End; ++type)
+        {
+            std::vector<Block> fastPlacements;
+            GetReachablePlacements(*gameState, type, fastPlacements);
+
+            std::vector<Block> placements;
+            std::vector<Inputs> paths;
+            GetReachablePlacements(*gameState, type, placements, paths);
+
+            ASSERT_EQ(placements.size(), fastPlacements.size());
+            for (std::size_t idx = 0; idx != placements.size(); ++idx)
+            {
+                ASSERT_TRUE(Equals(placements[idx], fastPlacements[idx]));
+            }
+            ASSERT_EQ(placements.empty(), IsGameOver(*gameState, type));
+        }
+        PlayRandomMove(gameState, random);
+    }
+}
+
+
+TEST(MoveGeneratorTest, PathsReplayToTheirPlacement)
+{
+    std::mt19937 random(2);
+    std::unique_ptr<GameState> gameState(new GameState(20, 10));
+    for (std::size_t move = 0; move != cMoveCount; ++move)
+    {
+        BlockType type = GetRandomBlockType(random);
+        std::vector<Block> placements;
+        std::vector<Inputs> paths;
+        GetReachablePlacements(*gameState, type, placements, paths);
+        ASSERT_EQ(placements.size(), paths.size());
+
+        for (std::size_t idx = 0; idx != placements.size(); ++idx)
+        {
+            // Every input must lead to a valid position.
+            Block block = GetSpawnBlock(type, gameState->columnCount());
+            const Inputs& inputs = paths[idx];
+            for (std::size_t step = 0; step != inputs.size(); ++step)
+            {
+                switch (inputs[step])
+                {
+                    case Input_Left: block.setColumn(block.column() - 1); break;
+                    case Input_Right: block.setColumn(block.column() + 1); break;
+                    case Input_Down: block.setRow(block.row() + 1); break;
+                    case Input_Rotate: block.rotate(); break;
+                }
+                ASSERT_TRUE(gameState->checkPositionValid(block, block.row(), block.column()));
+            }
+            ASSERT_TRUE(Equals(placements[idx], block));
+
+            // The placement rests on the stack or on the floor.
+            EXPECT_FALSE(gameState->checkPositionValid(block, block.row() + 1, block.column()));
+
+            Inputs foundInputs;
+            ASSERT_TRUE(FindPath(*gameState, placements[idx], foundInputs));
+            EXPECT_EQ(inputs, foundInputs);
+        }
+        PlayRandomMove(gameState, random);
+    }
+}
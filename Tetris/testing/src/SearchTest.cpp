@@ -0,0 +1,144 @@
+#include "Tetris/BlockTypes.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/GameState.h"
+#include "Tetris/GameStateNode.h"
+#include "Tetris/NodeCalculator.h"
+#include "Futile/WorkerPool.h"
+#include "gtest/gtest.h"
+#include <boost/thread.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace Tetris;
+using Futile::WorkerPool;
+
+
+namespace { // anonymous
+
+
+// Fails after a number of batches, like a search that runs out of memory.
+class FailingEvaluator : public CustomEvaluator
+{
+public:
+    FailingEvaluator(int inBatchCount) :
+        CustomEvaluator(GameHeightFactor(-2),
+                        LastBlockHeightFactor(-1),
+                        NumHolesFactor(-4),
+                        NumSinglesFactor(1),
+                        NumDoublesFactor(2),
+                        NumTriplesFactor(4),
+                        NumTetrisesFactor(8),
+                        SearchDepth(4),
+                        SearchWidth(4)),
+        mBatchCount(inBatchCount)
+    {
+    }
+
+    virtual void evaluateBatch(const std::vector<const GameState*>& inChildren,
+                               std::vector<int>& outScores) const
+    {
+        if (mBatchCount-- <= 0)
+        {
+            throw std::runtime_error("FailingEvaluator");
+        }
+        CustomEvaluator::evaluateBatch(inChildren, outScores);
+    }
+
+private:
+    mutable std::atomic<int> mBatchCount;
+};
+
+
+BlockTypes GetBlockTypes(std::size_t inCount)
+{
+    BlockTypes result;
+    for (std::size_t idx = 0; idx != inCount; ++idx)
+    {
+        result.push_back(BlockType(BlockType_Begin + idx % (BlockType_End - BlockType_Begin)));
+    }
+    return result;
+}
+
+
+} // anonymous namespace
+
+
+TEST(SearchTest, FailingExpansionEndsTheSearch)
+{
+    for (std::size_t workerCount = 1; workerCount <= 4; workerCount *= 2)
+    {
+        WorkerPool workerPool("SearchTest", workerCount);
+        FailingEvaluator evaluator(10);
+        NodePtr rootNode(new GameStateNode(new GameState(20, 10), evaluator));
+        NodeCalculator nodeCalculator(rootNode, GetBlockTypes(4), std::vector<int>(4, 4), evaluator, workerPool);
+        nodeCalculator.run();
+        ASSERT_EQ(NodeCalculator::Status_Error, nodeCalculator.status());
+        ASSERT_EQ("FailingEvaluator", nodeCalculator.errorMessage());
+    }
+}
+
+
+TEST(SearchTest, TimeLimitStopsTheSearch)
+{
+    // Both searches are far too large to finish within the time limit.
+    NodeCalculator::SearchType searchTypes[] = { NodeCalculator::SearchType_Tree, NodeCalculator::SearchType_Beam };
+    std::size_t depths[] = { 8, 100 };
+    int widths[] = { 20, 1000 };
+    for (std::size_t typeIdx = 0; typeIdx != sizeof(searchTypes) / sizeof(searchTypes[0]); ++typeIdx)
+    {
+        for (std::size_t workerCount = 1; workerCount <= 4; workerCount *= 2)
+        {
+            WorkerPool workerPool("SearchTest", workerCount);
+            const Evaluator & evaluator = MakeTetrises::Instance();
+            NodePtr rootNode(new GameStateNode(new GameState(20, 10), evaluator));
+            NodeCalculator nodeCalculator(rootNode,
+                                          GetBlockTypes(depths[typeIdx]),
+                                          std::vector<int>(depths[typeIdx], widths[typeIdx]),
+                                          evaluator,
+                                          workerPool,
+                                          searchTypes[typeIdx]);
+
+            boost::system_time begin = boost::get_system_time();
+            nodeCalculator.start(20);
+            // A stopped search still calculates its result, and then finishes.
+            while (nodeCalculator.status() != NodeCalculator::Status_Finished &&
+                   nodeCalculator.status() != NodeCalculator::Status_Error)
+            {
+                ASSERT_LT(boost::get_system_time() - begin, boost::posix_time::seconds(10));
+                boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            }
+
+            ASSERT_EQ(NodeCalculator::Status_Finished, nodeCalculator.status());
+            ASSERT_GE(nodeCalculator.getCurrentSearchDepth(), 1);
+            ASSERT_LT(nodeCalculator.getCurrentSearchDepth(), nodeCalculator.getMaxSearchDepth());
+            ASSERT_TRUE(nodeCalculator.result());
+        }
+    }
+}
+
+
+TEST(SearchTest, NextSearchAddsOneRow)
+{
+    WorkerPool workerPool("SearchTest", 1);
+    const Evaluator & evaluator = MakeTetrises::Instance();
+    BlockTypes blockTypes = GetBlockTypes(4);
+    std::vector<int> widths(3, 3);
+
+    NodePtr rootNode(new GameStateNode(new GameState(20, 10), evaluator));
+    NodeCalculator first(rootNode, BlockTypes(blockTypes.begin(), blockTypes.begin() + 3), widths, evaluator, workerPool);
+    first.run();
+    ASSERT_EQ(NodeCalculator::Status_Finished, first.status());
+    ASSERT_EQ(1, first.result()->depth());
+    ASSERT_EQ(first.result()->gameState().hash(), first.resultSubtree()->gameState().hash());
+
+    // The first two rows below the first move are reused.
+    NodeCalculator second(first.resultSubtree(), BlockTypes(blockTypes.begin() + 1, blockTypes.end()), widths, evaluator, workerPool);
+    second.run();
+    ASSERT_EQ(NodeCalculator::Status_Finished, second.status());
+    ASSERT_EQ(3, second.getCurrentSearchDepth());
+    ASSERT_EQ(2, second.result()->depth());
+    ASSERT_GT(second.getNodeCount(), 0u);
+    ASSERT_LE(second.getNodeCount(), 27u);
+}
@@ -0,0 +1,87 @@
+#include "Futile/Worker.h"
+#include "Futile/WorkerPool.h"
+#include "gtest/gtest.h"
+#include <atomic>
+
+
+using Futile::Worker;
+using Futile::WorkerPool;
+
+
+namespace { // anonymous
+
+
+// More tasks than fit in the preallocated queue of a worker.
+const std::size_t cTaskCount = 4 * Worker::cQueueCapacity;
+
+
+void Increment(std::atomic<std::size_t>* ioCounter)
+{
+    (*ioCounter)++;
+}
+
+
+// Keeps a worker busy until it is interrupted.
+void Block()
+{
+    for (;;)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+}
+
+
+template<class Scheduler>
+void ScheduleIncrements(Scheduler* inScheduler, std::atomic<std::size_t>* ioCounter)
+{
+    for (std::size_t idx = 0; idx != cTaskCount; ++idx)
+    {
+        inScheduler->schedule(boost::bind(&Increment, ioCounter));
+    }
+}
+
+
+} // anonymous namespace
+
+
+TEST(WorkerQueueTest, TaskSchedulesOnItsOwnWorker)
+{
+    std::atomic<std::size_t> counter(0);
+    Worker worker("WorkerQueueTest");
+    worker.schedule(boost::bind(&ScheduleIncrements<Worker>, &worker, &counter));
+    worker.wait();
+    ASSERT_EQ(cTaskCount, counter.load());
+    ASSERT_TRUE(worker.empty());
+}
+
+
+TEST(WorkerQueueTest, TaskSchedulesOnItsOwnPool)
+{
+    std::atomic<std::size_t> counter(0);
+    WorkerPool workerPool("WorkerQueueTest", 2);
+    workerPool.schedule(boost::bind(&ScheduleIncrements<WorkerPool>, &workerPool, &counter));
+    workerPool.wait();
+    ASSERT_EQ(cTaskCount, counter.load());
+}
+
+
+TEST(WorkerQueueTest, FullQueueRunsTheTaskInline)
+{
+    Worker worker("WorkerQueueTest");
+    worker.schedule(&Block);
+    worker.waitForStatus(Futile::WorkerStatus_Working);
+
+    // The tasks that don't fit run on this thread.
+    const std::size_t cInlineCount = 10;
+    std::atomic<std::size_t> counter(0);
+    for (std::size_t idx = 0; idx != Worker::cQueueCapacity + cInlineCount; ++idx)
+    {
+        worker.schedule(boost::bind(&Increment, &counter));
+    }
+    ASSERT_EQ(cInlineCount, counter.load());
+    ASSERT_EQ(Worker::cQueueCapacity, worker.size());
+
+    worker.interruptAndClearQueue();
+    ASSERT_EQ(cInlineCount, counter.load());
+    ASSERT_TRUE(worker.empty());
+}
@@ -0,0 +1,71 @@
+#include "BenchSupport.h"
+#include "Futile/Logger.h"
+#include "Futile/MainThreadImpl.h"
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+
+namespace Futile {
+
+
+// The games are muted, so nothing is ever posted to the main thread.
+std::unique_ptr<MainThreadImpl> CreateMainThreadImpl()
+{
+    throw std::logic_error("This program has no main thread.");
+}
+
+
+} // namespace Futile
+
+
+namespace Tetris {
+
+
+using Futile::Logger;
+
+
+static void PrintLogMessage(const std::string& inMessage)
+{
+    std::cerr << inMessage << std::endl;
+}
+
+
+int RunHeadless(int argc, char* argv[], const MainFunction& inMain)
+{
+    try
+    {
+        Logger::ScopedInitializer initLogger;
+        Logger::Instance().setLogHandler(&PrintLogMessage);
+        int result = inMain(argc, argv);
+        Logger::Instance().flush();
+        return result;
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr << "Exception caught in main: " << exc.what() << std::endl;
+    }
+    return 1;
+}
+
+
+int ParseInt(const std::string& inOption, const std::string& inValue, int inMin)
+{
+    char* end = 0;
+    long value = std::strtol(inValue.c_str(), &end, 10);
+    if (inValue.empty() || *end != '\0' || value < inMin)
+    {
+        throw std::invalid_argument("Invalid value for " + inOption + ": " + inValue);
+    }
+    return static_cast<int>(value);
+}
+
+
+double Divide(double inValue, double inDivisor)
+{
+    return inDivisor > 0 ? inValue / inDivisor : 0;
+}
+
+
+} // namespace Tetris
@@ -0,0 +1,39 @@
+#ifndef TETRISBENCH_BENCHSUPPORT_H_INCLUDED
+#define TETRISBENCH_BENCHSUPPORT_H_INCLUDED
+
+
+#include <boost/function.hpp>
+#include <string>
+
+
+namespace Tetris {
+
+
+/**
+ * Helpers that TetrisBench and TetrisBenchmark share.
+ *
+ * Linking this code also provides Futile::CreateMainThreadImpl. These
+ * programs run without a main thread, so nothing may be posted to it.
+ */
+
+
+typedef boost::function<int(int, char*[])> MainFunction;
+
+
+// Runs inMain with the logger writing to stderr. Exceptions are printed
+// and turned into exit code 1.
+int RunHeadless(int argc, char* argv[], const MainFunction& inMain);
+
+
+// Throws std::invalid_argument if inValue is not an integer of at least inMin.
+int ParseInt(const std::string& inOption, const std::string& inValue, int inMin);
+
+
+// Returns zero instead of dividing by zero.
+double Divide(double inValue, double inDivisor);
+
+
+} // namespace Tetris
+
+
+#endif // TETRISBENCH_BENCHSUPPORT_H_INCLUDED
@@ -0,0 +1,513 @@
+#include "BenchSupport.h"
+#include "Tetris/Evaluator.h"
+#include "Tetris/EvaluatorTuner.h"
+#include "Tetris/GameStateStats.h"
+#include "Tetris/NodeCalculator.h"
+#include "Tetris/Simulation.h"
+#include "Futile/WorkerPool.h"
+#include "Poco/Stopwatch.h"
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+using Futile::WorkerPool;
+using namespace Tetris;
+
+
+namespace {
+
+
+struct Options
+{
+    Options() :
+        mGameCount(8),
+        mThreadCount(boost::thread::hardware_concurrency()),
+        mSeed(1),
+        mEvaluators(1, "Balanced"),
+        mSearchDepth(4),
+        mSearchWidth(4),
+        mSearchType(NodeCalculator::SearchType_Tree),
+        mMaxBlockCount(1000),
+        mRowCount(20),
+        mColumnCount(10),
+        mGarbageInterval(0),
+        mGarbageLineCount(2),
+        mGenerationCount(0),
+        mPopulationSize(12),
+        mGamesPerCandidate(4),
+        mCheckpoint()
+    {
+    }
+
+    std::size_t mGameCount;
+    std::size_t mThreadCount;
+    unsigned mSeed;
+    std::vector<std::string> mEvaluators;
+    int mSearchDepth;
+    int mSearchWidth;
+    NodeCalculator::SearchType mSearchType;
+    std::size_t mMaxBlockCount;
+    std::size_t mRowCount;
+    std::size_t mColumnCount;
+    int mGarbageInterval;
+    int mGarbageLineCount;
+
+    // Tuning mode, see EvaluatorTuner.
+    std::size_t mGenerationCount;
+    std::size_t mPopulationSize;
+    std::size_t mGamesPerCandidate;
+    std::string mCheckpoint;
+};
+
+
+// The settings of one game.
+struct GameSettings
+{
+    unsigned mSeed;
+    const Evaluator* mEvaluator;
+    int mSearchDepth;
+    int mSearchWidth;
+    NodeCalculator::SearchType mSearchType;
+};
+
+
+struct GameResult
+{
+    GameResult() :
+        mStats(0, 0, 0, 0, 0, 0),
+        mBlockCount(0),
+        mNodeCount(0),
+        mSeconds(0),
+        mError()
+    {
+    }
+
+    GameStateStats mStats;
+    std::size_t mBlockCount;
+    std::size_t mNodeCount;
+    double mSeconds;
+    std::string mError;
+};
+
+
+void PrintUsage()
+{
+    std::cout << "Usage: TetrisBench [options]" << std::endl
+              << "  --games N              number of games (default 8)" << std::endl
+              << "  --threads N            number of games that run at the same time (default: all cores)" << std::endl
+              << "  --seed N               seed of the first game, the next games count up (default 1)" << std::endl
+              << "  --evaluators A,B,...   evaluators that take turns over the games (default Balanced)" << std::endl
+              << "  --depth N              search depth (default 4)" << std::endl
+              << "  --width N              search width (default 4)" << std::endl
+              << "  --search TYPE          tree, beam or expectimax (default tree)" << std::endl
+              << "  --blocks N             maximum number of blocks per game, 0 for no limit (default 1000)" << std::endl
+              << "  --rows N               number of rows (default 20)" << std::endl
+              << "  --columns N            number of columns (default 10)" << std::endl
+              << "  --garbage-interval N   add garbage every N ms of game time, 0 for none (default 0)" << std::endl
+              << "  --garbage-lines N      opponent lines per garbage event (default 2)" << std::endl
+              << std::endl
+              << "Tuning:" << std::endl
+              << "  --tune N               tune the factors of the first evaluator for N generations, by score" << std::endl
+              << "                         (also uses --blocks and the garbage options)" << std::endl
+              << "  --population N         candidates per generation (default 12)" << std::endl
+              << "  --games-per-candidate N  games that each candidate plays (default 4)" << std::endl
+              << "  --checkpoint FILE      resume from FILE if it exists and save to it after each generation" << std::endl;
+}
+
+
+std::vector<std::string> Split(const std::string& inText, char inSeparator)
+{
+    std::vector<std::string> result;
+    std::stringstream ss(inText);
+    std::string item;
+    while (std::getline(ss, item, inSeparator))
+    {
+        result.push_back(item);
+    }
+    return result;
+}
+
+
+NodeCalculator::SearchType ParseSearchType(const std::string& inValue)
+{
+    if (inValue == "tree")
+    {
+        return NodeCalculator::SearchType_Tree;
+    }
+    else if (inValue == "beam")
+    {
+        return NodeCalculator::SearchType_Beam;
+    }
+    else if (inValue == "expectimax")
+    {
+        return NodeCalculator::SearchType_Expectimax;
+    }
+    throw std::invalid_argument("Invalid search type: " + inValue);
+}
+
+
+const Evaluator& GetEvaluator(const std::string& inName)
+{
+    if (inName == "Balanced")
+    {
+        return Balanced::Instance();
+    }
+    else if (inName == "Survival")
+    {
+        return Survival::Instance();
+    }
+    else if (inName == "MakeTetrises")
+    {
+        return MakeTetrises::Instance();
+    }
+    else if (inName == "Multiplayer")
+    {
+        return Multiplayer::Instance();
+    }
+    else if (inName == "Confused")
+    {
+        return Confused::Instance();
+    }
+    throw std::invalid_argument("Unknown evaluator: " + inName);
+}
+
+
+// Returns false if only the usage was requested.
+bool ParseOptions(int argc, char* argv[], Options& outOptions)
+{
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string option = argv[idx];
+        if (option == "--help" || option == "-h")
+        {
+            PrintUsage();
+            return false;
+        }
+        if (idx + 1 == argc)
+        {
+            throw std::invalid_argument("Missing value for " + option);
+        }
+        std::string value = argv[++idx];
+        if (option == "--games")
+        {
+            outOptions.mGameCount = ParseInt(option, value, 1);
+        }
+        else if (option == "--threads")
+        {
+            outOptions.mThreadCount = ParseInt(option, value, 1);
+        }
+        else if (option == "--seed")
+        {
+            outOptions.mSeed = ParseInt(option, value, 0);
+        }
+        else if (option == "--evaluators")
+        {
+            outOptions.mEvaluators = Split(value, ',');
+        }
+        else if (option == "--depth")
+        {
+            outOptions.mSearchDepth = ParseInt(option, value, 1);
+        }
+        else if (option == "--width")
+        {
+            outOptions.mSearchWidth = ParseInt(option, value, 1);
+        }
+        else if (option == "--search")
+        {
+            outOptions.mSearchType = ParseSearchType(value);
+        }
+        else if (option == "--blocks")
+        {
+            outOptions.mMaxBlockCount = ParseInt(option, value, 0);
+        }
+        else if (option == "--rows")
+        {
+            outOptions.mRowCount = ParseInt(option, value, 4);
+        }
+        else if (option == "--columns")
+        {
+            outOptions.mColumnCount = ParseInt(option, value, 4);
+        }
+        else if (option == "--garbage-interval")
+        {
+            outOptions.mGarbageInterval = ParseInt(option, value, 0);
+        }
+        else if (option == "--garbage-lines")
+        {
+            outOptions.mGarbageLineCount = ParseInt(option, value, 0);
+        }
+        else if (option == "--tune")
+        {
+            outOptions.mGenerationCount = ParseInt(option, value, 1);
+        }
+        else if (option == "--population")
+        {
+            outOptions.mPopulationSize = ParseInt(option, value, 2);
+        }
+        else if (option == "--games-per-candidate")
+        {
+            outOptions.mGamesPerCandidate = ParseInt(option, value, 1);
+        }
+        else if (option == "--checkpoint")
+        {
+            outOptions.mCheckpoint = value;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option: " + option);
+        }
+    }
+
+    if (outOptions.mEvaluators.empty())
+    {
+        throw std::invalid_argument("No evaluators were given.");
+    }
+    if (outOptions.mThreadCount == 0)
+    {
+        outOptions.mThreadCount = 1;
+    }
+    return true;
+}
+
+
+// Runs in a worker of the game pool.
+void RunGame(const Options& inOptions, const GameSettings& inSettings, GameResult* outResult)
+{
+    try
+    {
+        // The games run side by side, so each one searches in a single thread.
+        WorkerPool searchPool("TetrisBench Search", 1);
+        Simulation simulation(inOptions.mRowCount,
+                              inOptions.mColumnCount,
+                              inSettings.mSeed,
+                              *inSettings.mEvaluator,
+                              searchPool);
+        simulation.setSearchDepth(inSettings.mSearchDepth);
+        simulation.setSearchWidth(inSettings.mSearchWidth);
+        simulation.setSearchType(inSettings.mSearchType);
+        simulation.setMaxBlockCount(inOptions.mMaxBlockCount);
+        simulation.setGarbage(inOptions.mGarbageInterval, inOptions.mGarbageLineCount);
+
+        Poco::Stopwatch stopwatch;
+        stopwatch.start();
+        outResult->mStats = simulation.run();
+        outResult->mSeconds = stopwatch.elapsed() / 1000000.0;
+        outResult->mBlockCount = simulation.blockCount();
+        outResult->mNodeCount = simulation.nodeCount();
+    }
+    catch (const std::exception& inException)
+    {
+        outResult->mError = inException.what();
+    }
+}
+
+
+// Sums up the results of a group of games.
+struct Summary
+{
+    Summary() :
+        mGameCount(0),
+        mErrorCount(0),
+        mLines(0),
+        mMinLines(0),
+        mMaxLines(0),
+        mScore(0),
+        mBlockCount(0),
+        mNodeCount(0),
+        mSeconds(0)
+    {
+    }
+
+    void add(const GameResult& inResult)
+    {
+        if (!inResult.mError.empty())
+        {
+            mErrorCount++;
+            return;
+        }
+        int lines = inResult.mStats.numLines();
+        mMinLines = mGameCount == 0 ? lines : std::min(mMinLines, lines);
+        mMaxLines = mGameCount == 0 ? lines : std::max(mMaxLines, lines);
+        mGameCount++;
+        mLines += lines;
+        mScore += inResult.mStats.score();
+        mBlockCount += inResult.mBlockCount;
+        mNodeCount += inResult.mNodeCount;
+        mSeconds += inResult.mSeconds;
+    }
+
+    std::size_t mGameCount;
+    std::size_t mErrorCount;
+    long long mLines;
+    int mMinLines;
+    int mMaxLines;
+    long long mScore;
+    std::size_t mBlockCount;
+    std::size_t mNodeCount;
+    double mSeconds;
+};
+
+
+void PrintSummary(const std::string& inName, const Summary& inSummary)
+{
+    // The rates are per game: the sum of the work divided by the time the games took.
+    std::cout << std::left << std::setw(14) << inName << std::right
+              << " games=" << inSummary.mGameCount
+              << " errors=" << inSummary.mErrorCount
+              << " lines(avg/min/max)=" << std::fixed << std::setprecision(1)
+              << Divide(inSummary.mLines, inSummary.mGameCount)
+              << "/" << inSummary.mMinLines
+              << "/" << inSummary.mMaxLines
+              << " score(avg)=" << Divide(inSummary.mScore, inSummary.mGameCount)
+              << " pieces/s=" << Divide(inSummary.mBlockCount, inSummary.mSeconds)
+              << " nodes/s=" << std::setprecision(0) << Divide(inSummary.mNodeCount, inSummary.mSeconds)
+              << std::endl;
+}
+
+
+int Run(const Options& inOptions)
+{
+    std::vector<GameSettings> settings(inOptions.mGameCount);
+    for (std::size_t idx = 0; idx != settings.size(); ++idx)
+    {
+        GameSettings& gameSettings = settings[idx];
+        gameSettings.mSeed = inOptions.mSeed + static_cast<unsigned>(idx);
+        gameSettings.mEvaluator = &GetEvaluator(inOptions.mEvaluators[idx % inOptions.mEvaluators.size()]);
+        gameSettings.mSearchDepth = inOptions.mSearchDepth;
+        gameSettings.mSearchWidth = inOptions.mSearchWidth;
+        gameSettings.mSearchType = inOptions.mSearchType;
+    }
+
+    // The results are written by the workers, so they must outlive the pool.
+    std::vector<GameResult> results(settings.size());
+    Poco::Stopwatch stopwatch;
+    stopwatch.start();
+    {
+        WorkerPool gamePool("TetrisBench", std::min(inOptions.mThreadCount, settings.size()));
+        for (std::size_t idx = 0; idx != settings.size(); ++idx)
+        {
+            gamePool.schedule(boost::bind(&RunGame, boost::cref(inOptions), boost::cref(settings[idx]), &results[idx]));
+        }
+        gamePool.wait();
+    }
+    double seconds = stopwatch.elapsed() / 1000000.0;
+
+    Summary total;
+    std::map<std::string, Summary> summaries;
+    for (std::size_t idx = 0; idx != results.size(); ++idx)
+    {
+        const GameResult& result = results[idx];
+        std::string name = settings[idx].mEvaluator->name();
+        std::cout << "game " << idx
+                  << " seed=" << settings[idx].mSeed
+                  << " evaluator=" << name;
+        if (!result.mError.empty())
+        {
+            std::cout << " error=" << result.mError << std::endl;
+        }
+        else
+        {
+            std::cout << " lines=" << result.mStats.numLines()
+                      << " score=" << result.mStats.score()
+                      << " tetrises=" << result.mStats.numTetrises()
+                      << " blocks=" << result.mBlockCount
+                      << " height=" << result.mStats.currentHeight()
+                      << " seconds=" << std::fixed << std::setprecision(2) << result.mSeconds
+                      << std::endl;
+        }
+        summaries[name].add(result);
+        total.add(result);
+    }
+
+    std::cout << std::endl;
+    for (std::map<std::string, Summary>::const_iterator it = summaries.begin(); it != summaries.end(); ++it)
+    {
+        PrintSummary(it->first, it->second);
+    }
+    PrintSummary("total", total);
+    std::cout << "wall time=" << std::fixed << std::setprecision(2) << seconds << "s"
+              << " pieces/s=" << Divide(total.mBlockCount, seconds)
+              << " threads=" << std::min(inOptions.mThreadCount, settings.size())
+              << std::endl;
+    return total.mErrorCount == 0 ? 0 : 1;
+}
+
+
+void PrintFactors(const EvaluatorTuner::Factors& inFactors)
+{
+    for (std::size_t idx = 0; idx != inFactors.size(); ++idx)
+    {
+        std::cout << (idx == 0 ? "" : ", ") << EvaluatorTuner::GetFactorName(idx) << "(" << inFactors[idx] << ")";
+    }
+    std::cout << std::endl;
+}
+
+
+int Tune(const Options& inOptions)
+{
+    EvaluatorTuner tuner(EvaluatorTuner::GetFactors(GetEvaluator(inOptions.mEvaluators.front())),
+                         inOptions.mThreadCount);
+    tuner.setBoardSize(inOptions.mRowCount, inOptions.mColumnCount);
+    tuner.setSearch(inOptions.mSearchDepth, inOptions.mSearchWidth, inOptions.mSearchType);
+    tuner.setPopulationSize(inOptions.mPopulationSize);
+    tuner.setGamesPerCandidate(inOptions.mGamesPerCandidate);
+    tuner.setMaxBlockCount(inOptions.mMaxBlockCount);
+    tuner.setGarbage(inOptions.mGarbageInterval, inOptions.mGarbageLineCount);
+    tuner.setSeed(inOptions.mSeed);
+
+    if (!inOptions.mCheckpoint.empty() && std::ifstream(inOptions.mCheckpoint.c_str()))
+    {
+        tuner.loadCheckpoint(inOptions.mCheckpoint);
+        std::cout << "resumed from " << inOptions.mCheckpoint << " at generation " << tuner.generation() << std::endl;
+    }
+
+    while (tuner.generation() < inOptions.mGenerationCount)
+    {
+        Poco::Stopwatch stopwatch;
+        stopwatch.start();
+        tuner.runGeneration();
+        if (!inOptions.mCheckpoint.empty())
+        {
+            tuner.saveCheckpoint(inOptions.mCheckpoint);
+        }
+        std::cout << "generation " << tuner.generation()
+                  << " score(avg)=" << std::fixed << std::setprecision(1) << tuner.averageFitness()
+                  << " score(best)=" << tuner.bestFitness()
+                  << " seconds=" << std::setprecision(2) << stopwatch.elapsed() / 1000000.0
+                  << std::endl;
+    }
+
+    std::cout << std::endl << "best: ";
+    PrintFactors(tuner.bestFactors());
+    return 0;
+}
+
+
+int Main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        return 0;
+    }
+    return options.mGenerationCount == 0 ? Run(options) : Tune(options);
+}
+
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+    return RunHeadless(argc, argv, &Main);
+}